@@ -1,13 +1,90 @@
 #include <iostream>
 #include <string>
+#include <string_view>
+#include <algorithm>
 #include <fstream>
+#include <sstream>
 #include <vector>
+#include <deque>
 #include <unordered_map>
-#include <tchar.h>
-#include <windows.h>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <cmath>
+#include <chrono>
+#include <new>
+#include <cstdint>
+#include <charconv>
+#include <type_traits>
+#include <filesystem>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <optional>
+#include <atomic>
+
+// Varredura vetorizada do analisador léxico: SSE2 é a base em x86-64 e AVX2 é
+// escolhido em tempo de execução quando o processador tem
+#if defined(__x86_64__) || defined(_M_X64)
+#define VARREDURA_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <csignal>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
 
 using namespace std;
 
+#ifdef COMPILADORES_BENCH
+// Contador de alocações da thread atual, usado pelo benchmark de alocações.
+// A troca do operator new global fica só no executável de benchmarks.
+thread_local size_t totalAlocacoes = 0;
+
+// Todas as formas não alinhadas passam por alocar/liberar, para que cada
+// operator delete devolva memória de um operator new deste mesmo conjunto.
+// Os dois ficam fora de linha: vendo o free() de dentro de um delete
+// expandido, o GCC o acusaria de não combinar com o new.
+[[gnu::noinline]] static void* alocar(size_t tamanho) noexcept {
+    totalAlocacoes++;
+    return malloc(tamanho ? tamanho : 1);
+}
+
+[[gnu::noinline]] static void liberar(void* p) noexcept { free(p); }
+
+void* operator new(size_t tamanho) {
+    if (void* p = alocar(tamanho)) return p;
+    throw bad_alloc();
+}
+
+void* operator new[](size_t tamanho) {
+    if (void* p = alocar(tamanho)) return p;
+    throw bad_alloc();
+}
+
+void* operator new(size_t tamanho, const nothrow_t&) noexcept { return alocar(tamanho); }
+void* operator new[](size_t tamanho, const nothrow_t&) noexcept { return alocar(tamanho); }
+
+void operator delete(void* p) noexcept { liberar(p); }
+void operator delete[](void* p) noexcept { liberar(p); }
+void operator delete(void* p, size_t) noexcept { liberar(p); }
+void operator delete[](void* p, size_t) noexcept { liberar(p); }
+void operator delete(void* p, const nothrow_t&) noexcept { liberar(p); }
+void operator delete[](void* p, const nothrow_t&) noexcept { liberar(p); }
+#endif
+
 // Definição dos tokens
 enum Token {
     T_INTEIRO, T_REAL,
@@ -29,1013 +106,7178 @@ enum Token {
 };
 
 
-struct TokenValue {
-    Token token;
-    string lexema;
-    double value;
+// Tipos de dado da linguagem
+enum TipoDado : unsigned char {
+    TIPO_INDEFINIDO, TIPO_INTEIRO, TIPO_REAL,
+    TIPO_BOOLEANO  // resultado de comparações e operações lógicas; vale 0 ou 1 na execução
 };
 
-// Tabela de símbolos: armazena o tipo de cada variável
-unordered_map<string, string> tabelaDeSimbolos;  // variável -> tipo
+const char* const nomeTipoDado[] = { "indefinido", "inteiro", "real", "booleano" };
 
-// Estrutura para a árvore sintática
-struct ArvoreNode {
-    string type;
-    string value;
-    string semantico;
-    vector<ArvoreNode*> children;
+// Número usado em tokens que não são identificadores
+const uint32_t SEM_SIMBOLO = UINT32_MAX;
 
-    ArvoreNode(string t, string v = "", string s = "") : type(t), value(v), semantico(s) {}
-};
+// Associa cada identificador a um número denso de 32 bits. Os nomes são visões
+// da entrada, então só a tabela de espalhamento cresce (nunca por token).
+class Internador {
+    vector<string_view> nomes;
+    vector<uint32_t> slots;  // número + 1; 0 = posição vazia
+    uint32_t mascara = 0;
+    deque<string> copias;  // nomes copiados quando a entrada não fica toda na memória
+    bool copiar = false;
 
+    static uint32_t hash(string_view nome) {
+        uint32_t h = 2166136261u;  // FNV-1a
+        for (char c : nome) {
+            h = (h ^ (unsigned char)c) * 16777619u;
+        }
+        return h;
+    }
 
-ArvoreNode* Programa();
-ArvoreNode* Declaracao();
-ArvoreNode* Tipo();
-ArvoreNode* IdLista(string tipo);
-ArvoreNode* Id(string escopo);
-ArvoreNode* Corpo();
-ArvoreNode* Comando();
-ArvoreNode* Atribuicao();
-ArvoreNode* Repeticao();
-ArvoreNode* Enquanto();
-ArvoreNode* Condicao();
-ArvoreNode* Mostrar();
-ArvoreNode* Ler();
-ArvoreNode* Expressao(string tipo, string tipoParent);
-ArvoreNode* ExpressaoLogica();
-ArvoreNode* ExpressaoRelacional();
-ArvoreNode* ExpressaoAritimetica();
-void nextStep();
-
-
-TokenValue getNextToken();
-void printToken(TokenValue tok);
-
-string input;
-size_t posicao = 0;
-TokenValue currentToken;
-ofstream outputSintFile;
-ofstream outputSemFile;
-ofstream outputASFile;
+    void crescer() {
+        size_t tamanho = slots.empty() ? 256 : slots.size() * 2;
+        slots.assign(tamanho, 0);
+        mascara = (uint32_t)(tamanho - 1);
+        for (uint32_t id = 0; id < nomes.size(); id++) {
+            uint32_t i = hash(nomes[id]) & mascara;
+            while (slots[i]) i = (i + 1) & mascara;
+            slots[i] = id + 1;
+        }
+    }
 
-// Avança para o próximo token
-void nextStep() {
-    currentToken = getNextToken();
-}
+public:
+    uint32_t internar(string_view nome) {
+        if ((nomes.size() + 1) * 2 > slots.size()) crescer();
 
-// Função de erro para imprimir mensagem e finalizar o programa quando a sintaxe está incorreta
-void error(string msg) {
-    cout << "Erro: " << msg << " na posição " << posicao << endl;
-    exit(1);
-}
+        uint32_t i = hash(nome) & mascara;
+        while (slots[i]) {
+            uint32_t id = slots[i] - 1;
+            if (nomes[id] == nome) return id;
+            i = (i + 1) & mascara;
+        }
 
-// Verifica se o token atual é o esperado e avança se verdadeiro
-void match(Token expectedToken) {
-    if (currentToken.token == expectedToken) {
-        nextStep();
-    }
-    else {
-        error("Token inesperado: " + currentToken.lexema);
+        uint32_t id = (uint32_t)nomes.size();
+        if (copiar) {
+            copias.emplace_back(nome);
+            nome = copias.back();
+        }
+        nomes.push_back(nome);
+        slots[i] = id + 1;
+        return id;
     }
-}
 
-// Função para imprimir a árvore sintática no arquivo de saída
-void printArvoreSintatica(ArvoreNode* node, int depth = 0) {
-    for (int i = 0; i < depth; ++i) {
-        outputSintFile << "  ";
-    }
+    string_view nome(uint32_t id) const { return nomes[id]; }
+    size_t quantidade() const { return nomes.size(); }
 
-    outputSintFile << node->type;
+    // Guarda uma cópia de cada nome novo, para a entrada poder ser descartada (--fluxo)
+    void copiarNomes(bool sim) { copiar = sim; }
 
-    if (!node->value.empty()) {
-        outputSintFile << " (" << node->value << ")";
+    void limpar() {
+        nomes.clear();
+        copias.clear();
+        fill(slots.begin(), slots.end(), 0);
     }
+};
 
-    outputSintFile << endl;
+// Tabela de símbolos indexada pelo número do identificador. Escopos de bloco podem
+// ser aninhados: cada um guarda as entradas que sombreou e as restaura ao fechar.
+// Consultas nunca alteram a tabela.
+class TabelaDeSimbolos {
+    struct Entrada {
+        TipoDado tipo = TIPO_INDEFINIDO;
+        uint32_t escopo = 0;
+    };
+
+    struct Sombreada {
+        uint32_t simbolo;
+        Entrada anterior;
+    };
+
+    vector<Entrada> entradas;
+    vector<Sombreada> sombreadas;
+    vector<uint32_t> declarados;  // em ordem de declaração
+    vector<pair<size_t, size_t>> escopos;  // início em 'sombreadas' e em 'declarados'
+
+    // Contadores do relatório de fases
+    mutable uint64_t consultas = 0;
+    uint64_t insercoes = 0;
+
+public:
+    TipoDado tipo(uint32_t simbolo) const {
+        consultas++;
+        return simbolo < entradas.size() ? entradas[simbolo].tipo : TIPO_INDEFINIDO;
+    }
 
-    for (ArvoreNode* child : node->children) {
-        printArvoreSintatica(child, depth + 1);
+    // Consulta sem contar, para leituras de várias threads depois que a tabela
+    // parou de mudar; quem consulta soma as suas depois, em somarConsultas()
+    TipoDado tipoSemContar(uint32_t simbolo) const {
+        return simbolo < entradas.size() ? entradas[simbolo].tipo : TIPO_INDEFINIDO;
     }
-}
+    void somarConsultas(uint64_t n) const { consultas += n; }
 
-bool firstComando = false;
-void printArvoreSemantica(ArvoreNode* node, int depth = 0, string atrib = "") {
-    // Exibe a árvore com informações de tipo e valor
+    bool declaradoNoEscopoAtual(uint32_t simbolo) const {
+        return tipo(simbolo) != TIPO_INDEFINIDO && entradas[simbolo].escopo == escopos.size();
+    }
 
-    if (node->type == "Comando") {
-        if (firstComando == false) {
-            firstComando = true;
-            for (ArvoreNode* child : node->children) {
-                printArvoreSemantica(child, depth + 1);
-            }
-        }
-        else {
-            for (size_t i = 0; i < node->children.size(); i++)
-            {
-                printArvoreSemantica(node->children[i], depth + 1 + i);
-            }
-        }
-    }else
-    if (node->type == "Expressao") {
-        if (atrib == "ate") {
-            for (ArvoreNode* child : node->children) {
-                if (node->children[0] == child) {
-                    printArvoreSemantica(child, depth + 1, atrib);
-                }
-                else {
-                    printArvoreSemantica(child, depth + 1);
-                }
-            }
-        }
-        else {
-            for (ArvoreNode* child : node->children) {
-                printArvoreSemantica(child, depth + 1);
-            }
-        }
+    void declarar(uint32_t simbolo, TipoDado tipo) {
+        if (simbolo >= entradas.size()) entradas.resize(simbolo + 1);
+        if (!escopos.empty()) sombreadas.push_back({ simbolo, entradas[simbolo] });
+        entradas[simbolo] = { tipo, (uint32_t)escopos.size() };
+        declarados.push_back(simbolo);
+        insercoes++;
     }
-    else {
 
-        if (node->type == "Tipo") {
-            outputSemFile << endl;
-            for (int i = 0; i < depth; ++i) {
-                outputSemFile << "  ";
-            }
-            outputSemFile << node->value << " ";
-            for (ArvoreNode* child : node->children) {
-                printArvoreSemantica(child, depth + 1);
-            }
-        }
-        else if (node->type == "IdLista") {
-            for (ArvoreNode* child : node->children) {
-                printArvoreSemantica(child, depth + 1);
-            }
-        }
-        else if (node->type == "ID" || node->type == "INTEIRO" || node->type == "REAL" || node->value == "==" ||
-            node->value == "+" || node->value == "-" || node->value == "*" || node->value == "/" || node->value == "<" ||
-            node->value == "<=" || node->value == ">" || node->value == ">=" || node->value == "!=") {
-            if (atrib == "ate") {
-            //outputFile << endl << node->type << " " << node->value ;
-                outputSemFile << endl;
-                for (int i = 0; i < depth; ++i) {
-                    outputSemFile << "  ";
-                }
-                outputSemFile << node->value;
-                //outputFile << endl << endl << endl << endl;
-            }else
-            if (atrib == "=") {
-                for (int i = 0; i < depth; ++i) {
-                    outputSemFile << "  ";
-                }
-                outputSemFile << node->value << " =";
-            }
-            else if (node->type == "INTEIRO") {
-                outputSemFile << " " << (int) stod(node->value);
-            }
-            else if (node->type == "REAL") {
-                outputSemFile << " " << nextafter(stod(node->value), 0.00);
-            }
-            else {
-                outputSemFile <<  " " << node->value;
-            }
+    void abrirEscopo() {
+        escopos.push_back({ sombreadas.size(), declarados.size() });
+    }
+
+    void fecharEscopo() {
+        for (size_t i = sombreadas.size(); i > escopos.back().first; i--) {
+            entradas[sombreadas[i - 1].simbolo] = sombreadas[i - 1].anterior;
         }
-        else if (node->type == "Atribuição") {
-            outputSemFile << endl;
+        sombreadas.resize(escopos.back().first);
+        declarados.resize(escopos.back().second);
+        escopos.pop_back();
+    }
 
-            //for (int i = 0; i < depth; ++i) {
-            //    outputFile << "  ";
-            //}
-            //outputFile << node->type;
-            //outputFile << endl;
+    const vector<uint32_t>& emOrdemDeDeclaracao() const { return declarados; }
+    uint64_t totalConsultas() const { return consultas; }
+    uint64_t totalInsercoes() const { return insercoes; }
+
+    void limpar() {
+        entradas.clear();
+        sombreadas.clear();
+        declarados.clear();
+        escopos.clear();
+        consultas = 0;
+        insercoes = 0;
+    }
+};
 
-            for (ArvoreNode* child : node->children) {
-                printArvoreSemantica(child, depth + 1, "=");
-            }
-        }
-        else {
-            outputSemFile << endl;
 
-            for (int i = 0; i < depth; ++i) {
-                outputSemFile << "  ";
-            }
-            outputSemFile << node->type;
-            if (!node->value.empty()) {
-                outputSemFile << " (" << node->value << ")";
-            }
+// Valor de um literal numérico: 'inteiro' nos inteiros e 'real' nos reais.
+// Quem sabe qual dos dois vale é o token ou o NodeKind ao lado.
+union Numero {
+    int64_t inteiro;
+    double real;
+};
 
-            if (node->type == "Repeticao" || node->type == "Enquanto") {
-                for (ArvoreNode* child : node->children) {
+// O lexema aponta diretamente para o trecho correspondente em 'input',
+// então nenhum token aloca memória. Identificadores já saem com seu número.
+struct TokenValue {
+    Token token;
+    string_view lexema;
+    Numero numero;
+    uint32_t simbolo = SEM_SIMBOLO;
+};
 
-                    if ((node->type == "Repeticao" && node->children[1] == child) || 
-                        (node->type == "Enquanto" && node->children[0] == child)) {
-                        //outputFile << "endl";
-                        //for (int i = 0; i < (depth + 2); ++i) {
-                        //    outputFile << "  ";
-                        //}
-                        printArvoreSemantica(child, depth + 1, "ate");
-                    }
-                    else {
-                        printArvoreSemantica(child, depth + 1);
-                    }
-                }
-            }
-            else {
-                for (ArvoreNode* child : node->children) {
-                    printArvoreSemantica(child, depth + 1);
-                }
-            }
+// Rastro dos tokens lidos. O nível de execução vem de --rastro; RASTRO_MAXIMO
+// limita em tempo de compilação o que existe no binário. Com
+// -DRASTRO_MAXIMO=0 o registro some de getNextToken().
+enum NivelRastro : unsigned char {
+    RASTRO_NENHUM,  // nada é registrado
+    RASTRO_ERROS,   // os últimos tokens ficam no anel e são impressos quando error() dispara
+    RASTRO_TOKENS,  // além do anel, cada token é impresso no console
+};
 
+#ifndef RASTRO_MAXIMO
+#define RASTRO_MAXIMO RASTRO_TOKENS
+#endif
+
+// Anel com os últimos TAMANHO tokens. Registrar é uma cópia e um incremento.
+template <size_t TAMANHO>
+class AnelTokens {
+    static_assert((TAMANHO & (TAMANHO - 1)) == 0, "TAMANHO precisa ser potência de 2");
+    TokenValue tokens[TAMANHO];
+    size_t total = 0;
+
+public:
+    void registrar(const TokenValue& tok) { tokens[total++ & (TAMANHO - 1)] = tok; }
+    void limpar() { total = 0; }
+
+    // Percorre do mais antigo ao mais recente
+    template <typename F>
+    void paraCada(F f) const {
+        size_t inicio = total > TAMANHO ? total - TAMANHO : 0;
+        for (size_t i = inicio; i < total; i++) {
+            f(tokens[i & (TAMANHO - 1)]);
         }
+    }
+};
 
+// Tipos de nó da árvore sintática
+enum NodeKind : unsigned char {
+    N_PROGRAMA, N_DECL, N_TIPO, N_IDLISTA, N_ID,
+    N_CORPO, N_COMANDO, N_ATRIBUICAO, N_REPETICAO, N_ENQUANTO, N_CONDICAO, N_MOSTRAR, N_LER,
+    N_EXPRESSAO, N_INTEIRO, N_REAL,
+    N_MAIOR, N_MAIOR_IGUAL, N_MENOR, N_MENOR_IGUAL, N_IGUAL_IGUAL, N_DIFERENTE,
+    N_OU, N_E,
+    N_MAIS, N_MENOS, N_MULT, N_DIV,
+    N_NEGACAO,
+    NUM_NODE_KINDS
+};
 
-        // Adiciona o tipo de dado do nó se disponível
-        //if (!node->children.empty() && node->type != "Corpo") {
-        //    outputFile << ": " << node->children[0]->type;
-        //}
+// Nome de cada tipo de nó, como aparece nas árvores impressas
+const char* const nomeNodeKind[NUM_NODE_KINDS] = {
+    "Programa", "Decl", "Tipo", "IdLista", "ID",
+    "Corpo", "Comando", "Atribuição", "Repeticao", "Enquanto", "Condicao", "Mostrar", "Ler",
+    "Expressao", "INTEIRO", "REAL",
+    "MAIOR", "MAIOR IGUAL", "MENOR", "MENOR IGUAL", "IGUAL IGUAL", "DIFERENTE",
+    "OU", "E",
+    "MAIS", "MENOS", "MULT", "DIV",
+    "NEGACAO",
+};
 
+// Texto dos operadores, usado quando o lexema não está disponível (árvore plana)
+const char* const textoNodeKind[NUM_NODE_KINDS] = {
+    "", "", "", "", "",
+    "", "", "", "", "", "", "", "",
+    "", "", "",
+    ">", ">=", "<", "<=", "==", "!=",
+    "||", "&&",
+    "+", "-", "*", "/",
+    "-",
+};
 
+// Precedência dos operadores, da menor para a maior. Operandos ficam acima de
+// todas, e 0 marca o que não é operador.
+enum Precedencia : unsigned char {
+    PREC_NENHUMA, PREC_OU, PREC_E, PREC_RELACIONAL, PREC_ADITIVA, PREC_MULTIPLICATIVA, PREC_UNARIA, PREC_OPERANDO
+};
 
+Precedencia precedenciaNo(NodeKind kind) {
+    switch (kind) {
+    case N_OU: return PREC_OU;
+    case N_E: return PREC_E;
+    case N_MAIOR: case N_MAIOR_IGUAL: case N_MENOR: case N_MENOR_IGUAL: case N_IGUAL_IGUAL: case N_DIFERENTE:
+        return PREC_RELACIONAL;
+    case N_MAIS: case N_MENOS: return PREC_ADITIVA;
+    case N_MULT: case N_DIV: return PREC_MULTIPLICATIVA;
+    case N_NEGACAO: return PREC_UNARIA;
+    default: return PREC_OPERANDO;
     }
-
 }
 
+// Alocador por incremento. Todos os nós de uma compilação vivem na arena e são
+// liberados de uma só vez em liberar().
+class Arena {
+    vector<char*> blocos;
+    char* atual = nullptr;
+    char* fim = nullptr;
+    size_t usados = 0;
+    size_t maximo = 0;
+    size_t proximoBloco = TAMANHO_BLOCO_INICIAL;
+    size_t tamanhoPrimeiro = 0;
+
+    // Os blocos dobram de tamanho até o limite, para árvores grandes não fragmentarem
+    static const size_t TAMANHO_BLOCO_INICIAL = 1 << 16;
+    static const size_t TAMANHO_BLOCO_MAXIMO = 1 << 22;
+
+public:
+    Arena() = default;
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+    ~Arena() { liberar(); }
+
+    void* alocar(size_t bytes, size_t alinhamento) {
+        char* p = (char*)(((uintptr_t)atual + alinhamento - 1) & ~(uintptr_t)(alinhamento - 1));
+        if (atual == nullptr || p + bytes > fim) {
+            size_t tamanho = bytes + alinhamento > proximoBloco ? bytes + alinhamento : proximoBloco;
+            if (proximoBloco < TAMANHO_BLOCO_MAXIMO) proximoBloco *= 2;
+            char* bloco = (char*)::operator new(tamanho);
+            if (blocos.empty()) tamanhoPrimeiro = tamanho;
+            blocos.push_back(bloco);
+            atual = bloco;
+            fim = bloco + tamanho;
+            p = (char*)(((uintptr_t)atual + alinhamento - 1) & ~(uintptr_t)(alinhamento - 1));
+        }
+        atual = p + bytes;
+        usados += bytes;
+        if (usados > maximo) maximo = usados;
+        return p;
+    }
 
-void printTabelaDeSimbolos() {
-    for (auto value : tabelaDeSimbolos) {
-        outputASFile << value.first << ": " << value.second << endl;
+    template <typename T>
+    T* alocarArray(size_t n) {
+        return (T*)alocar(sizeof(T) * n, alignof(T));
     }
-}
-//void printArvore(ArvoreNode* node, int depth = 0) {
-//    for (int i = 0; i < depth; ++i) {
-//        outputFile << "  ";
-//    }
-//
-//    outputFile << node->type;
-//
-//    if (!node->value.empty()) {
-//        outputFile << " (" << node->value << ")";
-//    }
-//
-//    outputFile << endl;
-//
-//    for (ArvoreNode* child : node->children) {
-//        printArvore(child, depth + 1);
-//    }
-//}
 
-// Função para verificar se uma variável foi declarada
-void verificarDeclaracao(string id) {
-    if (tabelaDeSimbolos.find(id) == tabelaDeSimbolos.end()) error("Variável '" + id + "' não foi declarada.");
-}
+    void liberar() {
+        for (char* bloco : blocos) ::operator delete(bloco);
+        blocos.clear();
+        atual = fim = nullptr;
+        usados = 0;
+        proximoBloco = TAMANHO_BLOCO_INICIAL;
+    }
 
-// Função para verificar se uma variável já foi declarada
-void verificarRedeclaracao(string id) {
-    if (tabelaDeSimbolos.find(id) != tabelaDeSimbolos.end()) error("Variável '" + id + "' já foi declarada.");
-}
+    // Descarta tudo mas fica com o primeiro bloco, para quem libera e volta a
+    // alocar o tempo todo (um comando por vez em --fluxo)
+    void reaproveitar() {
+        if (blocos.empty()) return;
+        for (size_t i = 1; i < blocos.size(); i++) ::operator delete(blocos[i]);
+        blocos.resize(1);
+        atual = blocos[0];
+        fim = blocos[0] + tamanhoPrimeiro;
+        usados = 0;
+        proximoBloco = TAMANHO_BLOCO_INICIAL * 2;
+    }
+
+    size_t bytesUsados() const { return usados; }
+
+    // Maior quantidade de bytes em uso desde o último reiniciarPico()
+    size_t pico() const { return maximo; }
+    void reiniciarPico() { maximo = usados; }
+};
+
+struct ArvoreNode;
+
+// Filhos de um nó: faixa contígua de ponteiros alocada na arena
+struct ListaFilhos {
+    ArvoreNode** dados = nullptr;
+    uint32_t tamanho = 0;
+
+    ArvoreNode** begin() const { return dados; }
+    ArvoreNode** end() const { return dados + tamanho; }
+    size_t size() const { return tamanho; }
+    bool empty() const { return tamanho == 0; }
+    ArvoreNode* operator[](size_t i) const { return dados[i]; }
+};
+
+// Estrutura para a árvore sintática
+// 'value' aponta para o lexema na entrada (ou para um literal). Literais numéricos
+// guardam o valor em 'numero' e só são formatados na impressão.
+struct ArvoreNode {
+    NodeKind kind;
+    unsigned char semantico = 0;  // TipoDado de nós de expressão, anotado uma vez por verificarSemantica()
+    uint32_t simbolo = SEM_SIMBOLO;  // número do identificador em nós ID
+    string_view value;
+    Numero numero = {};
+    ListaFilhos children;
+
+    ArvoreNode(NodeKind k, string_view v = {}, Numero n = {}) : kind(k), value(v), numero(n) {}
 
-// Função para verificar o tipo da expressão na atribuição
-void verificarAtribuicao(string tipoVar, ArvoreNode* expressao) {
-    string tipoExpr = expressao->type;
+    const char* type() const { return nomeNodeKind[kind]; }
+};
 
-    if (tipoExpr == "Expressao") {
-        tipoExpr = expressao->children[0]->type;
+const uint32_t SEM_NO = UINT32_MAX;
+
+// Árvore sintática plana: vetores paralelos indexados pelo número do nó, em pré-ordem.
+// Os filhos de um nó são encadeados por primeiroFilho/proximoIrmao, e percorrer a
+// árvore inteira é uma varredura linear dos vetores.
+struct ArvorePlana {
+    vector<NodeKind> kind;
+    vector<uint32_t> payload;  // símbolo (ID), índice em 'numeros' (INTEIRO/REAL) ou TipoDado (Tipo)
+    vector<uint32_t> primeiroFilho;
+    vector<uint32_t> proximoIrmao;
+    vector<uint32_t> profundidade;
+    vector<Numero> numeros;
+
+    // Nós que ainda recebem filhos durante a análise e o último filho de cada um
+    vector<uint32_t> abertos;
+    vector<uint32_t> ultimoFilho;
+
+    uint32_t size() const { return (uint32_t)kind.size(); }
+
+    // Acrescenta um nó como último filho do nó aberto mais interno
+    uint32_t adicionar(NodeKind k, uint32_t valor) {
+        uint32_t no = size();
+        kind.push_back(k);
+        payload.push_back(valor);
+        primeiroFilho.push_back(SEM_NO);
+        proximoIrmao.push_back(SEM_NO);
+        profundidade.push_back((uint32_t)abertos.size());
+
+        if (!abertos.empty()) {
+            if (ultimoFilho.back() == SEM_NO) primeiroFilho[abertos.back()] = no;
+            else proximoIrmao[ultimoFilho.back()] = no;
+            ultimoFilho.back() = no;
+        }
+        return no;
     }
 
-    if (tipoVar == "INTEIRO" && tipoExpr != "INTEIRO" && tipoExpr != "ID") {
-        error("Tipo incompatível: Esperado inteiro na expressão.");
+    void abrir(uint32_t no) {
+        abertos.push_back(no);
+        ultimoFilho.push_back(SEM_NO);
     }
-    //cout << '\n\n' << tipoVar << '\n'<<'\n';
-    if (tipoVar == "REAL" && (tipoExpr != "REAL" && tipoExpr != "ID")) {
-        error("Tipo incompatível: Esperado real ou inteiro na expressão. " + tipoExpr + " --");
+
+    void fechar() {
+        abertos.pop_back();
+        ultimoFilho.pop_back();
     }
-}
 
+    size_t bytes() const {
+        return kind.size() * (sizeof(NodeKind) + 4 * sizeof(uint32_t)) + numeros.size() * sizeof(Numero);
+    }
 
-void verificarLerMostrar(string lex) {
-    verificarDeclaracao(lex);
+    void limpar() {
+        kind.clear();
+        payload.clear();
+        primeiroFilho.clear();
+        proximoIrmao.clear();
+        profundidade.clear();
+        numeros.clear();
+        abertos.clear();
+        ultimoFilho.clear();
+    }
+};
 
-    //if (lex == "desconhecido") {
-    //    error("Tipo incompatível: Esperado real ou inteiro na função.");
-    //}
-    //cout << endl << tabelaDeSimbolos.at(lex) << endl << endl;
+// Artefato de saída montado inteiro na memória. As impressões só acrescentam
+// ao buffer; o arquivo é gravado de uma vez em gravarArquivo().
+class BufferSaida {
+    string dados;
+
+public:
+    BufferSaida& operator<<(string_view texto) { dados.append(texto); return *this; }
+    BufferSaida& operator<<(const char* texto) { dados.append(texto); return *this; }
+    BufferSaida& operator<<(char c) { dados += c; return *this; }
+
+    template <typename T, enable_if_t<is_integral_v<T> && !is_same_v<T, char>, int> = 0>
+    BufferSaida& operator<<(T valor) {
+        char texto[24];
+        to_chars_result r = to_chars(texto, texto + sizeof(texto), valor);
+        dados.append(texto, (size_t)(r.ptr - texto));
+        return *this;
+    }
 
-    //cout << tipo << '\n';
-    if (tabelaDeSimbolos.at(lex) != "inteiro" && tabelaDeSimbolos.at(lex) != "real") {
-        error("Tipo incompatível: Esperado real ou inteiro na função 'ler()'.");
+    // Mesmo formato de 'ostream << double' (%g com 6 dígitos)
+    BufferSaida& operator<<(double valor) {
+        char texto[32];
+        int n = snprintf(texto, sizeof(texto), "%g", valor);
+        dados.append(texto, (size_t)n);
+        return *this;
     }
 
+    const string& str() const { return dados; }
+    void limpar() { dados.clear(); }
+};
+
+double comoReal(NodeKind kind, Numero n) { return kind == N_INTEIRO ? (double)n.inteiro : n.real; }
+
+// Literal no formato de to_string(double) ("%f"), sem passar por string. O
+// inteiro sai exato, com a mesma parte fracionária zerada.
+void escreverLiteral(BufferSaida& saida, NodeKind kind, Numero n) {
+    if (kind == N_INTEIRO) {
+        saida << n.inteiro << ".000000";
+        return;
+    }
+    char texto[320];
+    int tamanho = snprintf(texto, sizeof(texto), "%f", n.real);
+    saida << string_view(texto, min((size_t)tamanho, sizeof(texto) - 1));
 }
 
-bool verificarBooleano(string operador) {
-    //cout << operador << '\n';
-    return operador == "<" || operador == ">" || operador == "<=" || operador == ">=" || operador == "==" || operador == "!=";
+// Grava o conteúdo inteiro com uma única escrita (em POSIX, write() só é
+// repetido se o sistema gravar parte do buffer)
+bool gravarArquivo(const string& caminho, string_view dados) {
+#ifndef _WIN32
+    int fd = open(caminho.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return false;
+    size_t gravados = 0;
+    while (gravados < dados.size()) {
+        ssize_t n = write(fd, dados.data() + gravados, dados.size() - gravados);
+        if (n <= 0) break;
+        gravados += (size_t)n;
+    }
+    return close(fd) == 0 && gravados == dados.size();
+#else
+    FILE* arquivo = fopen(caminho.c_str(), "wb");
+    if (!arquivo) return false;
+    setvbuf(arquivo, nullptr, _IONBF, 0);
+    bool ok = fwrite(dados.data(), 1, dados.size(), arquivo) == dados.size();
+    return fclose(arquivo) == 0 && ok;
+#endif
 }
 
+// Artefatos que a compilação grava, selecionados com --emit
+enum Artefato : unsigned {
+    EMITIR_SINTATICA = 1 << 0,  // arvore_sintatica.txt
+    EMITIR_SEMANTICA = 1 << 1,  // arvore_semantica.txt
+    EMITIR_SIMBOLOS = 1 << 2,   // arvore_de_simbolos.txt
+    EMITIR_JSON = 1 << 3,       // arvore.json: árvore sintática e tabela de símbolos
+};
+constexpr unsigned NUM_ARTEFATOS = 4;  // na ordem dos bits acima
+
+// Relatório de fases (--relatorio): tempo de cada fase e contadores da compilação
+enum FaseCompilacao {
+    FASE_CACHE,
+    FASE_LEXICA,
+    FASE_SINTATICA,
+    FASE_SEMANTICA,
+    FASE_OTIMIZACAO,
+    FASE_IMPRESSAO_SEMANTICA,
+    FASE_IMPRESSAO_SINTATICA,
+    FASE_IMPRESSAO_SIMBOLOS,
+    FASE_IMPRESSAO_JSON,
+    FASE_GERACAO_C,
+    FASE_GRAVACAO,
+    FASE_EXECUCAO,
+    NUM_FASES
+};
 
-Token verificarExpressaoEritimetica(ArvoreNode* esquerda, string operador, ArvoreNode* direita) {
-    string tipoEsq = esquerda->type == "ID" ? tabelaDeSimbolos[esquerda->value] : esquerda->type;
-    string tipoDir = direita->type == "ID" ? tabelaDeSimbolos[direita->value] : direita->type;
+const char* const nomeFaseCompilacao[NUM_FASES] = {
+    "cache", "lexica", "sintatica", "semantica", "otimizacao",
+    "impressao_semantica", "impressao_sintatica", "impressao_simbolos", "impressao_json",
+    "geracao_c", "gravacao", "execucao",
+};
 
-    //cout << '\n' << node->type << " => " << node->value << '\n' << '\n';
-    //cout << '\n' << tipoEsq << " => " << esquerda[1] << '\n' << tipoDir << " => " << direita[1] << '\n' << '\n';
+enum FormatoRelatorio : unsigned char { RELATORIO_NENHUM, RELATORIO_TABELA, RELATORIO_JSON };
 
-    if (operador == "+" || operador == "-" || operador == "/" || operador == "*") {
-        if ((tipoEsq == "inteiro" || tipoEsq == "real" || tipoEsq == "INTEIRO" || tipoEsq == "REAL") &&
-            (tipoDir == "inteiro" || tipoDir == "real" || tipoDir == "INTEIRO" || tipoDir == "REAL")) {
-            if (operador == "/" && direita->value == "0") {
-                error("Erro: divisão por zero.");
-                return T_UNKNOWN;
-            }
-            if (((tipoEsq == "inteiro" || tipoEsq == "INTEIRO") && (tipoDir == "real" || tipoDir == "REAL")) || 
-                (tipoEsq == "real" || tipoEsq == "REAL") && (tipoDir == "inteiro" || tipoDir == "INTEIRO")) {
-                esquerda->type == "ID" ? tabelaDeSimbolos[esquerda->value] : esquerda->value;
-                return T_REAL;
-            }
-            return T_INTEIRO;
-        }
-        else {
-            error("Tipos incompativeis");
-            return T_UNKNOWN;
-        }
-    }
-}
+using Relogio = chrono::steady_clock;
 
+// A fase léxica acontece dentro de Programa(), uma chamada por token.
+// Cronometrar todas custaria mais que a própria fase, então só uma em cada
+// INTERVALO_AMOSTRA é medida e o total é estimado pela média.
+constexpr uint64_t INTERVALO_AMOSTRA = 64;
 
-ArvoreNode* Programa() {
-    ArvoreNode* node = new ArvoreNode("Programa");
+struct FaseAmostrada {
+    uint64_t chamadas = 0;
+    uint64_t amostras = 0;
+    double tempoAmostras = 0;
 
-    // Primeira parte → Seção onde são declaradas as variáveis do programa.
-    node->children.push_back(Declaracao());
+    double estimativa() const { return amostras ? tempoAmostras / amostras * chamadas : 0; }
+};
 
-    // Segunda parte → Corpo do programa, onde são colocados os comandos que serão executados.
-    node->children.push_back(Corpo());
+enum SituacaoCache : unsigned char { CACHE_DESLIGADO, CACHE_FALTA, CACHE_ACERTO };
+const char* const nomeSituacaoCache[] = { "desligado", "falta", "acerto" };
+
+struct Estatisticas {
+    double tempo[NUM_FASES] = {};
+    FaseAmostrada lexica;
+    SituacaoCache cache = CACHE_DESLIGADO;
+    bool lexicaParalela = false;  // tempo[FASE_LEXICA] foi medido nas threads de LexicoParalelo
+    uint64_t nos = 0;
+    uint64_t bytesGravados = 0;
+    uint64_t picoArvore = 0;  // bytes da arena da árvore
+    uint64_t picoFonte = 0;   // bytes da fonte na memória, só com --fluxo
+};
 
-    if (currentToken.token != T_EOF) {
-        error("Esperado EOF no final do programa");
-    }
-    return node;
+// Custo de uma leitura do relógio, descontado de cada amostra
+double custoRelogio() {
+    static const double custo = [] {
+        const int leituras = 1000;
+        Relogio::time_point inicio = Relogio::now();
+        for (int i = 0; i < leituras; i++) (void)Relogio::now();
+        return chrono::duration<double>(Relogio::now() - inicio).count() / leituras;
+    }();
+    return custo;
 }
 
-ArvoreNode* Declaracao() {
-    ArvoreNode* node = new ArvoreNode("Decl");
-    //cout << '\n' << node->children.size() << '\n' << '\n';
+// Mede a chamada atual se ela for a amostra da vez
+class AmostraFase {
+    FaseAmostrada* fase = nullptr;
+    Relogio::time_point inicio;
 
-    if (currentToken.token != T_INTEIRO && currentToken.token != T_REAL) {
-        //cout << to_string(currentToken.token);
-        error("Esperado declaração de tipo (inteiro ou real)");
+public:
+    AmostraFase(FaseAmostrada& f, bool ativo) {
+        if (ativo && (f.chamadas++ & (INTERVALO_AMOSTRA - 1)) == 0) {
+            fase = &f;
+            inicio = Relogio::now();
+        }
     }
-    while (currentToken.token == T_INTEIRO || currentToken.token == T_REAL) {
-        //if (!node->children.empty()) {
-        //    node->children.push_back(Tipo());
-        //    for (size_t i = 1; i < node->children.size(); i++)
-        //    {
-        //        //if (node->children[i + 1]) {
-        //            //cout << '\n' << node->children.size() << '\n' << '\n';
-        //            //node->children[i]->siblings.push_back(node->children[i + 1]);
-        //        //}
-        //    }
-        //}
-        //else
-        //{
-            node->children.push_back(Tipo());
-
-            string tipoDeclaracao = currentToken.lexema;
-            //}
-        //for (size_t j = 0; j < node->children.size(); j++)
-        //    cout << '\n' << node->children[j]->siblings[0]->value << '\n' << '\n';
-        nextStep();
 
-        node->children.push_back(IdLista(tipoDeclaracao));
-        match(T_PONTO_VIRGULA);
+    ~AmostraFase() {
+        if (fase) {
+            double tempo = chrono::duration<double>(Relogio::now() - inicio).count() - custoRelogio();
+            fase->tempoAmostras += max(0.0, tempo);
+            fase->amostras++;
+        }
     }
+};
 
-        /*if (currentToken.token == T_INTEIRO || currentToken.token == T_REAL) {
-            node->children.push_back(Declaracao());
-        }*/
+// Soma a duração do bloco em 'destino'
+class CronometroFase {
+    double& destino;
+    Relogio::time_point inicio = Relogio::now();
 
+public:
+    explicit CronometroFase(double& d) : destino(d) {}
+    ~CronometroFase() { destino += chrono::duration<double>(Relogio::now() - inicio).count(); }
+};
 
-    return node;
-}
+// Opções de uma compilação, lidas da linha de comando
+struct OpcoesCompilacao {
+    NivelRastro rastro = RASTRO_ERROS;
+    bool arvorePlana = false;  // o parser também emite a árvore plana, usada para imprimir a árvore sintática
+    bool executar = false;
+    bool otimizar = false;
+    bool gerarC = false;
+    bool parserIterativo = false;  // Comando() sem recursão, para programas com aninhamento profundo
+    bool parserTabela = false;  // parser LL(1) dirigido pela tabela gerada da gramática
+    unsigned threadsAnalise = 0;  // threads da análise léxica e da verificação semântica (0: uma por núcleo)
+    unsigned artefatos = EMITIR_SINTATICA | EMITIR_SEMANTICA | EMITIR_SIMBOLOS;
+    FormatoRelatorio relatorio = RELATORIO_NENHUM;
+    string diretorioCache;  // cache de compilações em disco (vazio: desligado)
+    uint64_t limiteCache = 512ull << 20;  // bytes do diretório do cache antes de apagar as entradas menos usadas
+};
 
-ArvoreNode* Tipo() {
-    ArvoreNode* node = new ArvoreNode("Tipo", currentToken.token == T_INTEIRO ? "inteiro" : "real");
+// Erro de compilação. error() lança e compilar() devolve como resultado, então
+// um erro num programa não derruba o processo nem as outras compilações.
+struct ErroCompilacao {
+    string mensagem;
+    size_t posicao;
+};
 
-    return node;
-}
+// Pilhas de uma thread da verificação semântica e quantas consultas ela fez à
+// tabela de símbolos
+struct ContextoSemantico {
+    vector<ArvoreNode*> comandos;
+    vector<pair<ArvoreNode*, bool>> expressao;  // nó e se os filhos já foram tipados
+    uint64_t consultas = 0;
+};
 
-ArvoreNode* IdLista(string tipo) {
-    ArvoreNode* node = new ArvoreNode("IdLista");
+struct ResultadoCompilacao {
+    bool sucesso = true;
+    string erro;
+};
 
-    node->children.push_back(Id(tipo));
+struct Bytecode;
+struct Valor;
 
-    while (currentToken.token == T_VIRGULA) {
-        nextStep();
-        node->children.push_back(Id(tipo));
-    }
+// Conversão aplicada ao resultado de uma subexpressão gerada para a máquina
+// virtual: promoção a real, truncamento a inteiro ou teste de verdade
+enum ConversaoExpressao : unsigned char {
+    SEM_CONVERSAO,
+    PARA_REAL,
+    PARA_INTEIRO,
+    PARA_LOGICO
+};
+struct EstadoOtimizacao;
+class FonteEmFluxo;
+class LexicoParalelo;
+
+// Estado de uma compilação: entrada, posição do analisador, tabelas, árvore e
+// arquivos de saída. Nada disso é global, então cada thread pode compilar um
+// programa com o seu próprio Compilador.
+struct Compilador {
+    OpcoesCompilacao opcoes;
+
+    // Mensagens, erros e a saída do programa executado
+    ostream& console;
+
+    // Texto do programa sendo compilado. Aponta para o arquivo mapeado em memória
+    // ou para o buffer lido da entrada; nunca é copiado.
+    string_view input;
+    size_t posicao = 0;
+    TokenValue currentToken;
+
+    // Em --fluxo, 'input' é só o último bloco lido da fonte, que começa na
+    // posição 'deslocamento' do arquivo
+    FonteEmFluxo* fluxo = nullptr;
+    size_t deslocamento = 0;
+
+    // Se não for nulo, os tokens vêm já lidos por threads (fontes grandes)
+    LexicoParalelo* lexicoParalelo = nullptr;
+    AnelTokens<32> ultimosTokens;
+
+    Internador simbolos;
+    TabelaDeSimbolos tabelaDeSimbolos;
+
+    Arena arenaArvore;
+    vector<ArvoreNode*> pilhaFilhos;
+    ArvorePlana arvorePlana;
+
+    // Pilhas de Expressao(): operandos já montados e operadores à espera do operando da direita
+    struct OperadorPendente {
+        NodeKind kind;
+        Precedencia precedencia;  // PREC_NENHUMA marca um '(' aberto
+        string_view texto;
+    };
+    vector<ArvoreNode*> pilhaOperandos;
+    vector<OperadorPendente> pilhaOperadores;
+
+    // Pilha de printExpressaoSemantica(): subexpressão a percorrer ou, com
+    // 'texto', só o operador do nó ou um parêntese
+    struct TermoExpressao {
+        ArvoreNode* node;
+        const char* parentese;
+        bool texto;
+    };
+    vector<TermoExpressao> pilhaTermos;
+    // Pilha de gerarExpressaoC(), com os mesmos termos: nós ou trechos de texto
+    vector<TermoExpressao> pilhaTraducao;
+
+    // Pilha de gerarExpressao(): subexpressão, conversão pedida pelo pai e se
+    // o código dos filhos já foi gerado
+    struct SubexpressaoPendente {
+        ArvoreNode* node;
+        ConversaoExpressao conversao;
+        bool filhosGerados;
+    };
+    vector<SubexpressaoPendente> pilhaGeracao;
+
+    BufferSaida saidaSintatica;
+    BufferSaida saidaSemantica;
+    BufferSaida saidaSimbolos;
+    bool firstComando = false;
+
+    Estatisticas estatisticas;
+
+    // Valores lidos por 'ler()' na execução
+    istream* entrada = &cin;
+
+    // Se não for nulo, compilar() guarda aqui os arquivos (nome e conteúdo) em
+    // vez de gravá-los no diretório; usado pelo modo servidor
+    vector<pair<string, string>>* arquivosEmMemoria = nullptr;
+
+    explicit Compilador(const OpcoesCompilacao& o = OpcoesCompilacao(), ostream& saida = cout) : opcoes(o), console(saida) {}
+
+    ResultadoCompilacao compilar(string_view fonte, const string& diretorio);
+    ResultadoCompilacao compilarEmFluxo(const string& caminho, const string& diretorio);
+    bool gravarSaida(const string& diretorio, const char* nome, string_view dados);
+    void reiniciar(string_view fonte);
+    ArvoreNode* analisar(string_view fonte);
+    void imprimirRelatorio(double total);
+
+    // Árvore
+    uint32_t payloadPlano(NodeKind kind, string_view value, Numero numero, uint32_t simbolo);
+    ArvoreNode* alocarNo(NodeKind kind, string_view value = {}, Numero numero = {}, uint32_t simbolo = SEM_SIMBOLO);
+    ArvoreNode* novoNo(NodeKind kind, string_view value = {}, Numero numero = {}, uint32_t simbolo = SEM_SIMBOLO);
+    ArvoreNode* novoNoId(const TokenValue& tok);
+    void reconstruirArvorePlana(ArvoreNode* node);
+
+    // Cache de compilações (--cache)
+    void serializarParaCache(string& entrada, ArvoreNode* ast, uint64_t eliminados, const string_view* artefatos);
+    bool restaurarDoCache(string_view corpo, string_view fonte, string_view* artefatos, uint64_t& eliminados, ArvoreNode** ast);
+
+    // Análise léxica
+    TokenValue proximoToken();
+    bool recarregarEntrada(size_t desde);
+    size_t posicaoNaFonte(const char* p) const;
+    size_t inicioRetido() const;
+    Numero lerNumero(Token token, string_view lexema);
+    TokenValue getNextToken();
+    void printToken(TokenValue tok);
+    void nextStep();
+    [[noreturn]] void error(string msg);
+    void match(Token expectedToken);
+
+    // Análise sintática
+    ArvoreNode* Programa();
+    ArvoreNode* ProgramaTabela();
+    ArvoreNode* Declaracao();
+    ArvoreNode* Tipo();
+    ArvoreNode* IdLista(TipoDado tipo);
+    ArvoreNode* Id(TipoDado tipo = TIPO_INDEFINIDO);
+    ArvoreNode* Corpo();
+    ArvoreNode* Comando();
+    ArvoreNode* Instrucao();
+    ArvoreNode* ComandoIterativo();
+    ArvoreNode* Atribuicao();
+    ArvoreNode* Repeticao();
+    ArvoreNode* Enquanto();
+    ArvoreNode* Condicao();
+    ArvoreNode* Mostrar();
+    ArvoreNode* Ler();
+    ArvoreNode* Expressao();
+    ArvoreNode* Operando(const TokenValue& tok);
+    void reduzirOperador();
+
+    // Análise semântica
+    void verificarRedeclaracao(const TokenValue& tok);
+    void verificarSemantica(ArvoreNode* programa);
+    void verificarComandos(ContextoSemantico& contexto, ArvoreNode* const* inicio, ArvoreNode* const* fim) const;
+    TipoDado verificarDeclaracao(ContextoSemantico& contexto, const ArvoreNode* id) const;
+    TipoDado tiparExpressao(ContextoSemantico& contexto, ArvoreNode* expressao) const;
+    void verificarAtribuicao(TipoDado tipoVar, const ArvoreNode* expressao) const;
+    TipoDado verificarOperacao(ArvoreNode* node) const;
+    [[noreturn]] void erroSemantico(string msg, const ArvoreNode* node) const;
+
+    // Impressão
+    void printArvoreSintatica(ArvoreNode* node, int depth, BufferSaida& saida);
+    void printArvoreSintaticaPlana(const ArvorePlana& arvore, BufferSaida& saida);
+    void printArvoreSemantica(ArvoreNode* node, int depth = 0, string_view atrib = "");
+    void printExpressaoSemantica(ArvoreNode* expressao, int depth, bool ate);
+    void printTabelaDeSimbolos();
+    void printArvoreJson(ArvoreNode* node, BufferSaida& saida);
+    void printJson(ArvoreNode* ast, BufferSaida& saida);
+    void printSimbolosJson(BufferSaida& saida);
+
+#ifdef COMPILADORES_BENCH
+    // Impressões recursivas, mantidas para comparação em --bench-profundidade
+    void printArvoreSintaticaRecursiva(ArvoreNode* node, int depth, BufferSaida& saida);
+    void printArvoreSemanticaRecursiva(ArvoreNode* node, int depth = 0, string_view atrib = "");
+    void printArvoreJsonRecursiva(ArvoreNode* node, BufferSaida& saida);
+#endif
+
+    // Bytecode
+    void gerarExpressao(Bytecode& bc, ArvoreNode* raiz, ConversaoExpressao conversao);
+    void gerarExpressaoComo(Bytecode& bc, ArvoreNode* node, bool real);
+    void gerarCondicao(Bytecode& bc, ArvoreNode* node);
+    void gerarComando(Bytecode& bc, ArvoreNode* raiz);
+    Bytecode gerarBytecode(ArvoreNode* ast);
+
+    // Otimização
+    void tornarLiteral(ArvoreNode* node, const Valor& v);
+    bool dobrarExpressao(EstadoOtimizacao& estado, ArvoreNode* node, Valor& v);
+    size_t otimizar(ArvoreNode* ast);
+
+    // Tradução para C
+    TipoDado tipoExpressaoC(ArvoreNode* node);
+    void gerarExpressaoC(string& c, ArvoreNode* node);
+    void gerarComandoC(string& c, ArvoreNode* raiz, int nivelRaiz);
+    string gerarC(ArvoreNode* ast);
+};
 
-    return node;
-}
+// Nó cujos filhos ainda estão sendo analisados. Os filhos são empilhados em
+// 'pilhaFilhos' e copiados de forma contígua para a arena em concluir().
+struct NoEmConstrucao {
+    Compilador& c;
+    ArvoreNode* node;
+    size_t base;
 
-ArvoreNode* Id(string tipo = "") {
-    ArvoreNode* node = new ArvoreNode("ID", currentToken.lexema);
+    NoEmConstrucao(Compilador& compilador, NodeKind kind, string_view value = {})
+        : c(compilador), node(compilador.novoNo(kind, value)), base(compilador.pilhaFilhos.size()) {
+        if (c.opcoes.arvorePlana) c.arvorePlana.abrir(c.arvorePlana.size() - 1);
+    }
 
-    if (tipo == "inteiro" || tipo == "real") {
-        // Verifica se a variável já foi declarada
-        verificarRedeclaracao(currentToken.lexema);
-        tabelaDeSimbolos[currentToken.lexema] = tipo == "inteiro" ? "inteiro" : "real";
+    void adicionar(ArvoreNode* filho) { c.pilhaFilhos.push_back(filho); }
+    size_t quantidade() const { return c.pilhaFilhos.size() - base; }
+    ArvoreNode* filho(size_t i) const { return c.pilhaFilhos[base + i]; }
+
+    ArvoreNode* concluir() {
+        size_t n = quantidade();
+        if (n > 0) {
+            node->children.dados = c.arenaArvore.alocarArray<ArvoreNode*>(n);
+            node->children.tamanho = (uint32_t)n;
+            memcpy(node->children.dados, c.pilhaFilhos.data() + base, n * sizeof(ArvoreNode*));
+            c.pilhaFilhos.resize(base);
+        }
+        if (c.opcoes.arvorePlana) c.arvorePlana.fechar();
+        return node;
     }
-    //cout << endl << tabelaDeSimbolos[currentToken.lexema] << endl << endl;
-    match(T_ID);
+};
+
 
+// Valor guardado na árvore plana para o nó: símbolo do ID, índice do literal
+// em 'numeros' ou o TipoDado do Tipo
+uint32_t Compilador::payloadPlano(NodeKind kind, string_view value, Numero numero, uint32_t simbolo) {
+    switch (kind) {
+    case N_ID:
+        return simbolo;
+    case N_INTEIRO: case N_REAL:
+        arvorePlana.numeros.push_back(numero);
+        return (uint32_t)arvorePlana.numeros.size() - 1;
+    case N_TIPO:
+        return value == "inteiro" ? TIPO_INTEIRO : TIPO_REAL;
+    default:
+        return 0;
+    }
+}
 
+// Nó na arena, ainda fora da árvore plana. Expressões são montadas de baixo
+// para cima e só entram na árvore plana quando estão completas.
+ArvoreNode* Compilador::alocarNo(NodeKind kind, string_view value, Numero numero, uint32_t simbolo) {
+    ArvoreNode* node = new (arenaArvore.alocar(sizeof(ArvoreNode), alignof(ArvoreNode))) ArvoreNode(kind, value, numero);
+    node->simbolo = simbolo;
+    estatisticas.nos++;
     return node;
 }
 
-ArvoreNode* Corpo() {
-    ArvoreNode* node = new ArvoreNode("Corpo");
+ArvoreNode* Compilador::novoNo(NodeKind kind, string_view value, Numero numero, uint32_t simbolo) {
+    ArvoreNode* node = alocarNo(kind, value, numero, simbolo);
 
-    if (currentToken.token == T_ID || currentToken.token == T_REPITA ||
-        currentToken.token == T_MOSTRAR || currentToken.token == T_ENQUANTO ||
-        currentToken.token == T_SE || currentToken.token == T_LER) {
-        node->children.push_back(Comando());
-    }
-    else {
-        error("Esperado corpo do programa");
+    if (opcoes.arvorePlana) {
+        arvorePlana.adicionar(kind, payloadPlano(kind, value, numero, simbolo));
     }
-
     return node;
 }
 
-
-ArvoreNode* Comando() {
-    ArvoreNode* node = new ArvoreNode("Comando");
-
-    while (currentToken.token == T_ID || currentToken.token == T_REPITA ||
-        currentToken.token == T_MOSTRAR || currentToken.token == T_ENQUANTO ||
-        currentToken.token == T_SE || currentToken.token == T_LER) {
-        
-        if (currentToken.token == T_ID) {
-            node->children.push_back(Atribuicao());
-        }
-        else if (currentToken.token == T_REPITA) {
-            node->children.push_back(Repeticao());
-        }
-        else if (currentToken.token == T_ENQUANTO) {
-            node->children.push_back(Enquanto());
-        }
-        else if (currentToken.token == T_SE) {
-            node->children.push_back(Condicao());
-        }
-        else if (currentToken.token == T_MOSTRAR) {
-            node->children.push_back(Mostrar());
+// Regrava a árvore plana a partir da árvore de nós, depois de uma passada que
+// alterou a árvore (a otimização, por exemplo)
+void Compilador::reconstruirArvorePlana(ArvoreNode* raiz) {
+    // Nós com filhos ainda por regravar e o próximo deles
+    vector<pair<ArvoreNode*, uint32_t>> pilha;
+    auto regravar = [&](ArvoreNode* node) {
+        uint32_t no = arvorePlana.adicionar(node->kind, payloadPlano(node->kind, node->value, node->numero, node->simbolo));
+        if (!node->children.empty()) {
+            arvorePlana.abrir(no);
+            pilha.push_back({ node, 0 });
         }
-        else if (currentToken.token == T_LER) {
-            node->children.push_back(Ler());
+    };
+
+    regravar(raiz);
+    while (!pilha.empty()) {
+        auto& [node, proximo] = pilha.back();
+        if (proximo < node->children.size()) {
+            regravar(node->children[proximo++]);
         }
         else {
-            error("Comando inválido");
+            arvorePlana.fechar();
+            pilha.pop_back();
         }
     }
-
-    return node;
 }
 
-ArvoreNode* Atribuicao() {
-    ArvoreNode* node = new ArvoreNode("Atribuição");
-
-    node->children.push_back(Id());
-
-    match(T_IGUAL);
+ArvoreNode* Compilador::novoNoId(const TokenValue& tok) {
+    return novoNo(N_ID, tok.lexema, {}, tok.simbolo);
+}
 
-    // Verificar o tipo da variável e o tipo da expressão à direita
-    string tipoVar = tabelaDeSimbolos[node->children[0]->value];
 
-    node->children.push_back(Expressao("Atribuicao", tipoVar));
-    match(T_PONTO_VIRGULA);
 
-    verificarAtribuicao(tipoVar, node->children[1]);
 
-    return node;
+// Avança para o próximo token
+void Compilador::nextStep() {
+    currentToken = getNextToken();
 }
 
-ArvoreNode* Repeticao() {
-    ArvoreNode* node = new ArvoreNode("Repeticao");
-    match(T_REPITA);
+// Função de erro: interrompe a compilação, que termina com o erro como resultado
+void Compilador::error(string msg) {
+    throw ErroCompilacao{ msg, deslocamento + posicao };
+}
 
-    if (currentToken.token == T_ABRE_CHAVES) {
-        match(T_ABRE_CHAVES);
-        node->children.push_back(Comando());
-        match(T_FECHA_CHAVES);
+// Verifica se o token atual é o esperado e avança se verdadeiro
+void Compilador::match(Token expectedToken) {
+    if (currentToken.token == expectedToken) {
+        nextStep();
     }
     else {
-        node->children.push_back(Comando());
+        error("Token inesperado: " + string(currentToken.lexema));
     }
-    match(T_ATE);
-    node->children.push_back(Expressao("booleano", ""));
-    match(T_PONTO_VIRGULA);
-
-    return node;
 }
 
-ArvoreNode* Enquanto() {
-    ArvoreNode* node = new ArvoreNode("Enquanto");
-    match(T_ENQUANTO);
-    match(T_ABRE_PARENTESES);
-
-    node->children.push_back(Expressao("booleano",""));
-
-    match(T_FECHA_PARENTESES);
-
-    //verificarExpressaoBooleana(node->children[0]);
+// Recuo de um nó das árvores sintática e semântica: dois espaços por nível até
+// PROFUNDIDADE_MAXIMA_RECUO. Abaixo disso o recuo para de crescer e o nível vem
+// escrito entre colchetes, senão uma cadeia como "1 + 1 + ... + 1", com um nível
+// por termo, ou blocos muito aninhados dariam uma saída quadrática.
+constexpr int PROFUNDIDADE_MAXIMA_RECUO = 32;
 
-    if (currentToken.token == T_ABRE_CHAVES) {
-        match(T_ABRE_CHAVES);
-        node->children.push_back(Comando());
-        match(T_FECHA_CHAVES);
+void escreverRecuo(BufferSaida& saida, int depth) {
+    for (int i = 0; i < min(depth, PROFUNDIDADE_MAXIMA_RECUO); ++i) {
+        saida << "  ";
     }
-    else {
-        node->children.push_back(Comando());
+    if (depth > PROFUNDIDADE_MAXIMA_RECUO) {
+        saida << '[' << depth << "] ";
     }
-
-    return node;
 }
 
-ArvoreNode* Condicao() {
-    ArvoreNode* node = new ArvoreNode("Condicao");
+// Função para imprimir a árvore sintática no arquivo de saída. A árvore é
+// percorrida com uma pilha explícita, então a profundidade não depende da pilha nativa.
+void Compilador::printArvoreSintatica(ArvoreNode* raiz, int profundidadeRaiz, BufferSaida& saida) {
+    vector<pair<ArvoreNode*, int>> pilha = { { raiz, profundidadeRaiz } };
 
-    match(T_SE);
-    node->children.push_back(Expressao("booleano", ""));
-    match(T_ENTAO);
+    while (!pilha.empty()) {
+        auto [node, depth] = pilha.back();
+        pilha.pop_back();
 
-    if (currentToken.token == T_ABRE_CHAVES) {
-        match(T_ABRE_CHAVES);
-        node->children.push_back(Comando());
-        match(T_FECHA_CHAVES);
-    }
-    else {
-        node->children.push_back(Comando());
-    }
+        escreverRecuo(saida, depth);
+        saida << node->type();
 
-    if (currentToken.token == T_SENAO) {
-        nextStep();
-        if (currentToken.token == T_ABRE_CHAVES) {
-            match(T_ABRE_CHAVES);
-            node->children.push_back(Comando());
-            match(T_FECHA_CHAVES);
+        if (node->kind == N_INTEIRO || node->kind == N_REAL) {
+            saida << " (";
+            escreverLiteral(saida, node->kind, node->numero);
+            saida << ")";
         }
-        else {
-            node->children.push_back(Comando());
+        else if (!node->value.empty()) {
+            saida << " (" << node->value << ")";
         }
-    }
-    return node;
 
+        saida << '\n';
+
+        // Empilhados do último para o primeiro, para sair na ordem original
+        for (size_t i = node->children.size(); i-- > 0;) {
+            pilha.push_back({ node->children[i], depth + 1 });
+        }
+    }
 }
 
-ArvoreNode* Mostrar() {
-    ArvoreNode* node = new ArvoreNode("Mostrar");
-    match(T_MOSTRAR);
-    match(T_ABRE_PARENTESES);
-    verificarLerMostrar(currentToken.lexema);
-    node->children.push_back(Expressao("", ""));
-    match(T_FECHA_PARENTESES);
-    match(T_PONTO_VIRGULA);
+// Mesma saída de printArvoreSintatica, numa única varredura da árvore plana
+void Compilador::printArvoreSintaticaPlana(const ArvorePlana& arvore, BufferSaida& saida) {
+    for (uint32_t no = 0; no < arvore.size(); no++) {
+        escreverRecuo(saida, (int)arvore.profundidade[no]);
+
+        NodeKind kind = arvore.kind[no];
+        saida << nomeNodeKind[kind];
+
+        switch (kind) {
+        case N_INTEIRO: case N_REAL:
+            saida << " (";
+            escreverLiteral(saida, kind, arvore.numeros[arvore.payload[no]]);
+            saida << ")";
+            break;
+        case N_ID:
+            saida << " (" << simbolos.nome(arvore.payload[no]) << ")";
+            break;
+        case N_TIPO:
+            saida << " (" << nomeTipoDado[arvore.payload[no]] << ")";
+            break;
+        default:
+            if (textoNodeKind[kind][0] != '\0') {
+                saida << " (" << textoNodeKind[kind] << ")";
+            }
+            break;
+        }
+
+        saida << '\n';
+    }
+}
+
+// Exibe a árvore com informações de tipo e valor. Cada nó é impresso ao sair
+// de uma pilha explícita, com a profundidade e o 'atrib' que a versão recursiva
+// passaria a ele; os filhos entram na pilha do último para o primeiro.
+void Compilador::printArvoreSemantica(ArvoreNode* raiz, int profundidadeRaiz, string_view atribRaiz) {
+    struct Pendente {
+        ArvoreNode* node;
+        int depth;
+        string_view atrib;
+    };
+    vector<Pendente> pilha = { { raiz, profundidadeRaiz, atribRaiz } };
+
+    // Empilha os filhos de 'node'; 'profundidade' e 'atributo' recebem o índice do filho
+    auto empilharFilhos = [&pilha](ArvoreNode* node, auto profundidade, auto atributo) {
+        for (size_t i = node->children.size(); i-- > 0;) {
+            pilha.push_back({ node->children[i], profundidade(i), atributo(i) });
+        }
+    };
+
+    while (!pilha.empty()) {
+        auto [node, depth, atrib] = pilha.back();
+        pilha.pop_back();
+
+        auto filho = [depth](size_t) { return depth + 1; };
+        auto semAtrib = [](size_t) { return string_view(); };
+
+        switch (node->kind) {
+        case N_COMANDO:
+            if (firstComando == false) {
+                firstComando = true;
+                empilharFilhos(node, filho, semAtrib);
+            }
+            else {
+                empilharFilhos(node, [depth](size_t i) { return depth + 1 + (int)i; }, semAtrib);
+            }
+            break;
+
+        case N_EXPRESSAO:
+            printExpressaoSemantica(node, depth, atrib == "ate");
+            break;
+
+        case N_TIPO:
+            saidaSemantica << '\n';
+            escreverRecuo(saidaSemantica, depth);
+            saidaSemantica << node->value << " ";
+            empilharFilhos(node, filho, semAtrib);
+            break;
+
+        case N_IDLISTA:
+            empilharFilhos(node, filho, semAtrib);
+            break;
+
+        // Operandos e operadores aritméticos/relacionais
+        case N_ID: case N_INTEIRO: case N_REAL:
+        case N_MAIOR: case N_MAIOR_IGUAL: case N_MENOR: case N_MENOR_IGUAL: case N_IGUAL_IGUAL: case N_DIFERENTE:
+        case N_MAIS: case N_MENOS: case N_MULT: case N_DIV:
+            if (atrib == "ate") {
+                saidaSemantica << '\n';
+                escreverRecuo(saidaSemantica, depth);
+                saidaSemantica << node->value;
+            }
+            else if (atrib == "=") {
+                escreverRecuo(saidaSemantica, depth);
+                saidaSemantica << node->value << " =";
+            }
+            else if (node->kind == N_INTEIRO) {
+                saidaSemantica << " " << node->numero.inteiro;
+            }
+            else if (node->kind == N_REAL) {
+                saidaSemantica << " " << nextafter(node->numero.real, 0.00);
+            }
+            else {
+                saidaSemantica << " " << node->value;
+            }
+            break;
+
+        case N_ATRIBUICAO:
+            saidaSemantica << '\n';
+            empilharFilhos(node, filho, [](size_t) { return string_view("="); });
+            break;
+
+        default:
+            saidaSemantica << '\n';
+
+            escreverRecuo(saidaSemantica, depth);
+            saidaSemantica << node->type();
+            if (!node->value.empty()) {
+                saidaSemantica << " (" << node->value << ")";
+            }
+
+            if (node->kind == N_REPETICAO || node->kind == N_ENQUANTO) {
+                // A condição do laço é impressa na forma "a < b"
+                size_t condicao = node->kind == N_REPETICAO ? 1 : 0;
+                empilharFilhos(node, filho, [condicao](size_t i) { return i == condicao ? string_view("ate") : string_view(); });
+            }
+            else {
+                empilharFilhos(node, filho, semAtrib);
+            }
+            break;
+        }
+    }
+}
+
+
+// Expressão em notação infixa, "a + b * c", com parênteses só onde a
+// precedência pede. Com 'ate' (condição de laço) o primeiro termo começa numa
+// linha nova; os outros vêm depois de um espaço.
+void Compilador::printExpressaoSemantica(ArvoreNode* expressao, int depth, bool ate) {
+    vector<TermoExpressao>& pilha = pilhaTermos;
+    bool primeiro = true;
+
+    auto escrever = [&](ArvoreNode* node, const char* parentese) {
+        if (primeiro && ate) {
+            saidaSemantica << '\n';
+            escreverRecuo(saidaSemantica, depth + 1);
+            if (parentese) saidaSemantica << parentese;
+            else saidaSemantica << node->value;
+        }
+        else if (parentese) {
+            saidaSemantica << " " << parentese;
+        }
+        else if (node->kind == N_INTEIRO) {
+            saidaSemantica << " " << node->numero.inteiro;
+        }
+        else if (node->kind == N_REAL) {
+            saidaSemantica << " " << nextafter(node->numero.real, 0.00);
+        }
+        else {
+            saidaSemantica << " " << node->value;
+        }
+        primeiro = false;
+    };
+
+    // Empilha 'node' como operando de um operador de precedência 'pai'
+    auto empilhar = [&pilha](ArvoreNode* node, Precedencia pai, bool direita) {
+        Precedencia propria = precedenciaNo(node->kind);
+        bool parenteses = propria < pai || (direita && propria == pai && pai != PREC_UNARIA);
+        if (parenteses) pilha.push_back({ nullptr, ")", true });
+        pilha.push_back({ node, nullptr, false });
+        if (parenteses) pilha.push_back({ nullptr, "(", true });
+    };
+
+    for (ArvoreNode* raiz : expressao->children) {
+        pilha.push_back({ raiz, nullptr, false });
+    }
+    while (!pilha.empty()) {
+        TermoExpressao termo = pilha.back();
+        pilha.pop_back();
+        ArvoreNode* node = termo.node;
+
+        if (termo.texto || node->children.empty()) {
+            escrever(node, termo.parentese);
+        }
+        else if (node->kind == N_NEGACAO) {
+            escrever(node, nullptr);
+            empilhar(node->children[0], PREC_UNARIA, true);
+        }
+        else {
+            // Operador binário: sai o da esquerda, o operador e o da direita
+            Precedencia propria = precedenciaNo(node->kind);
+            empilhar(node->children[1], propria, true);
+            pilha.push_back({ node, nullptr, true });
+            empilhar(node->children[0], propria, false);
+        }
+    }
+}
+
+void Compilador::printTabelaDeSimbolos() {
+    for (uint32_t simbolo : tabelaDeSimbolos.emOrdemDeDeclaracao()) {
+        saidaSimbolos << simbolos.nome(simbolo) << ": " << nomeTipoDado[tabelaDeSimbolos.tipo(simbolo)] << '\n';
+    }
+}
+
+// Escreve 'texto' como string JSON
+void escreverStringJson(BufferSaida& saida, string_view texto) {
+    saida << '"';
+    for (char c : texto) {
+        if (c == '"' || c == '\\') saida << '\\' << c;
+        else if ((unsigned char)c < 0x20) {
+            char escape[8];
+            snprintf(escape, sizeof(escape), "\\u%04x", (unsigned)c);
+            saida << escape;
+        }
+        else saida << c;
+    }
+    saida << '"';
+}
+
+// Escreve um real como número JSON. Infinito e NaN, que a otimização pode
+// produzir, não são números em JSON e saem como as strings "inf", "-inf" e "nan".
+void escreverRealJson(BufferSaida& saida, double v) {
+    if (isnan(v)) {
+        saida << "\"nan\"";
+        return;
+    }
+    if (isinf(v)) {
+        saida << (v > 0 ? "\"inf\"" : "\"-inf\"");
+        return;
+    }
+    char texto[32];
+    snprintf(texto, sizeof(texto), "%.17g", v);
+    saida << texto;
+}
+
+// Nó da árvore sintática em JSON: {"no": ..., "valor": ..., "filhos": [...]}
+void Compilador::printArvoreJson(ArvoreNode* raiz, BufferSaida& saida) {
+    // Nós cujo objeto já foi aberto e o próximo filho a escrever
+    vector<pair<ArvoreNode*, uint32_t>> pilha;
+    auto abrirObjeto = [&](ArvoreNode* node) {
+        saida << "{\"no\":";
+        escreverStringJson(saida, node->type());
+
+        if (node->kind == N_INTEIRO) {
+            saida << ",\"valor\":" << node->numero.inteiro;
+        }
+        else if (node->kind == N_REAL) {
+            saida << ",\"valor\":";
+            escreverRealJson(saida, node->numero.real);
+        }
+        else if (!node->value.empty()) {
+            saida << ",\"valor\":";
+            escreverStringJson(saida, node->value);
+        }
+
+        if (!node->children.empty()) {
+            saida << ",\"filhos\":[";
+        }
+        pilha.push_back({ node, 0 });
+    };
+
+    abrirObjeto(raiz);
+    while (!pilha.empty()) {
+        auto& [node, proximo] = pilha.back();
+        if (proximo < node->children.size()) {
+            if (proximo > 0) saida << ',';
+            abrirObjeto(node->children[proximo++]);
+        }
+        else {
+            if (!node->children.empty()) saida << ']';
+            saida << '}';
+            pilha.pop_back();
+        }
+    }
+}
+
+// Variante do resultado para outras ferramentas: {"arvore": ..., "simbolos": [...]}
+void Compilador::printJson(ArvoreNode* ast, BufferSaida& saida) {
+    saida << "{\"arvore\":";
+    printArvoreJson(ast, saida);
+    printSimbolosJson(saida);
+}
+
+// Fim do JSON de printJson(): ,"simbolos":[...]}
+void Compilador::printSimbolosJson(BufferSaida& saida) {
+    saida << ",\"simbolos\":[";
+    bool primeiro = true;
+    for (uint32_t simbolo : tabelaDeSimbolos.emOrdemDeDeclaracao()) {
+        if (!primeiro) saida << ',';
+        primeiro = false;
+        saida << "{\"nome\":";
+        escreverStringJson(saida, simbolos.nome(simbolo));
+        saida << ",\"tipo\":\"" << nomeTipoDado[tabelaDeSimbolos.tipo(simbolo)] << "\"}";
+    }
+    saida << "]}\n";
+}
+
+// Função para verificar se uma variável já foi declarada
+void Compilador::verificarRedeclaracao(const TokenValue& tok) {
+    if (tabelaDeSimbolos.declaradoNoEscopoAtual(tok.simbolo)) error("Variável '" + string(tok.lexema) + "' já foi declarada.");
+}
+
+// Erro da verificação semântica, na posição do primeiro lexema do nó
+void Compilador::erroSemantico(string msg, const ArvoreNode* node) const {
+    while (node->value.empty() && !node->children.empty()) {
+        node = node->children[0];
+    }
+    size_t lexema = posicaoNaFonte(node->value.data());
+    throw ErroCompilacao{ msg, lexema != SIZE_MAX ? lexema : deslocamento + posicao };
+}
+
+// Verificação semântica, depois que a árvore inteira foi montada. Anota o
+// tipo de cada nó de expressão em 'semantico', e as passadas seguintes só leem
+// a anotação. A tabela de símbolos não muda depois de Declaracao(), então num
+// Corpo com muitos comandos eles são divididos em faixas verificadas em
+// paralelo; o erro relatado é o primeiro do programa, como numa verificação
+// sequencial.
+constexpr size_t COMANDOS_POR_THREAD_SEMANTICA = 16384;
+
+void Compilador::verificarSemantica(ArvoreNode* programa) {
+    const ListaFilhos& comandos = programa->children[1]->children[0]->children;
+    unsigned threads = opcoes.threadsAnalise ? opcoes.threadsAnalise : max(1u, thread::hardware_concurrency());
+    threads = (unsigned)min<size_t>(threads, max<size_t>(1, comandos.size() / COMANDOS_POR_THREAD_SEMANTICA));
+
+    if (threads == 1) {
+        ContextoSemantico contexto;
+        try {
+            verificarComandos(contexto, comandos.begin(), comandos.end());
+        }
+        catch (const ErroCompilacao&) {
+            tabelaDeSimbolos.somarConsultas(contexto.consultas);
+            throw;
+        }
+        tabelaDeSimbolos.somarConsultas(contexto.consultas);
+        return;
+    }
+
+    struct Faixa {
+        ContextoSemantico contexto;
+        bool falhou = false;
+        ErroCompilacao erro;
+    };
+    vector<Faixa> faixas(threads);
+    auto verificarFaixa = [&](unsigned t) {
+        size_t inicio = comandos.size() * t / threads;
+        size_t fim = comandos.size() * (t + 1) / threads;
+        try {
+            verificarComandos(faixas[t].contexto, comandos.begin() + inicio, comandos.begin() + fim);
+        }
+        catch (const ErroCompilacao& e) {
+            faixas[t].falhou = true;
+            faixas[t].erro = e;
+        }
+    };
+
+    vector<thread> trabalhadores;
+    for (unsigned t = 1; t < threads; t++) {
+        trabalhadores.emplace_back(verificarFaixa, t);
+    }
+    verificarFaixa(0);
+    for (thread& t : trabalhadores) {
+        t.join();
+    }
+
+    for (const Faixa& faixa : faixas) {
+        tabelaDeSimbolos.somarConsultas(faixa.contexto.consultas);
+    }
+    for (const Faixa& faixa : faixas) {
+        if (faixa.falhou) throw faixa.erro;
+    }
+}
+
+// Verifica os comandos de [inicio, fim) e tudo o que eles contêm, na ordem do
+// programa. Só escreve em 'semantico' dos nós da própria faixa.
+void Compilador::verificarComandos(ContextoSemantico& contexto, ArvoreNode* const* inicio, ArvoreNode* const* fim) const {
+    vector<ArvoreNode*>& pilha = contexto.comandos;
+    pilha.clear();
+    for (ArvoreNode* const* p = fim; p != inicio;) {
+        pilha.push_back(*--p);
+    }
+
+    while (!pilha.empty()) {
+        ArvoreNode* node = pilha.back();
+        pilha.pop_back();
+        const ListaFilhos& filhos = node->children;
+
+        switch (node->kind) {
+        case N_ATRIBUICAO: {
+            TipoDado tipoVar = verificarDeclaracao(contexto, filhos[0]);
+            tiparExpressao(contexto, filhos[1]);
+            verificarAtribuicao(tipoVar, filhos[1]);
+            break;
+        }
+
+        case N_LER:
+            verificarDeclaracao(contexto, filhos[0]);
+            break;
+
+        case N_MOSTRAR: {
+            // Uma variável logo no início do 'mostrar' tem a mesma mensagem do 'ler'
+            const ArvoreNode* primeiro = filhos[0];
+            while (!primeiro->children.empty() && primeiro->kind != N_NEGACAO) {
+                primeiro = primeiro->children[0];
+            }
+            if (primeiro->kind == N_ID) {
+                verificarDeclaracao(contexto, primeiro);
+            }
+            tiparExpressao(contexto, filhos[0]);
+            break;
+        }
+
+        case N_EXPRESSAO:
+            tiparExpressao(contexto, node);
+            break;
+
+        default:
+            // Comando, Condicao, Enquanto e Repeticao: os filhos, na ordem do programa
+            for (size_t i = filhos.size(); i-- > 0;) {
+                pilha.push_back(filhos[i]);
+            }
+            break;
+        }
+    }
+}
+
+// Função para verificar se uma variável foi declarada. Retorna o tipo dela.
+TipoDado Compilador::verificarDeclaracao(ContextoSemantico& contexto, const ArvoreNode* id) const {
+    contexto.consultas++;
+    TipoDado tipo = tabelaDeSimbolos.tipoSemContar(id->simbolo);
+    if (tipo == TIPO_INDEFINIDO) erroSemantico("Variável '" + string(id->value) + "' não foi declarada.", id);
+    return tipo;
+}
+
+// Anota o tipo de cada nó da expressão, dos operandos para os operadores, e
+// retorna o da expressão inteira
+TipoDado Compilador::tiparExpressao(ContextoSemantico& contexto, ArvoreNode* expressao) const {
+    vector<pair<ArvoreNode*, bool>>& pilha = contexto.expressao;
+    pilha.clear();
+    pilha.push_back({ expressao->children[0], false });
+
+    while (!pilha.empty()) {
+        auto [node, filhosTipados] = pilha.back();
+
+        if (node->children.empty()) {
+            pilha.pop_back();
+            if (node->kind == N_ID) {
+                contexto.consultas++;
+                TipoDado tipo = tabelaDeSimbolos.tipoSemContar(node->simbolo);
+                if (tipo == TIPO_INDEFINIDO) {
+                    erroSemantico("Variável não declarada: " + string(node->value), node);
+                }
+                node->semantico = tipo;
+            }
+            else {
+                node->semantico = node->kind == N_INTEIRO ? TIPO_INTEIRO : TIPO_REAL;
+            }
+        }
+        else if (!filhosTipados) {
+            pilha.back().second = true;
+            for (size_t i = node->children.size(); i-- > 0;) {
+                pilha.push_back({ node->children[i], false });
+            }
+        }
+        else {
+            pilha.pop_back();
+            verificarOperacao(node);
+        }
+    }
+
+    expressao->semantico = expressao->children[0]->semantico;
+    return (TipoDado)expressao->semantico;
+}
+
+// Função para verificar o tipo da expressão na atribuição. Uma variável inteira
+// não recebe valor real; o contrário é uma promoção válida.
+void Compilador::verificarAtribuicao(TipoDado tipoVar, const ArvoreNode* expressao) const {
+    if (tipoVar == TIPO_INTEIRO && expressao->semantico == TIPO_REAL) {
+        erroSemantico("Tipo incompatível: Esperado inteiro na expressão.", expressao);
+    }
+}
+
+// Literal de valor zero, escrito como for: "0", "00", "0.0", "-0"
+bool literalZero(const ArvoreNode* node) {
+    return (node->kind == N_INTEIRO && node->numero.inteiro == 0) || (node->kind == N_REAL && node->numero.real == 0);
+}
+
+// Anota o tipo de um nó de operador a partir dos tipos já anotados nos
+// operandos, então cada subexpressão é tipada uma única vez
+TipoDado Compilador::verificarOperacao(ArvoreNode* node) const {
+    TipoDado tipoEsq = (TipoDado)node->children[0]->semantico;
+    TipoDado tipoDir = node->children.size() > 1 ? (TipoDado)node->children[1]->semantico : tipoEsq;
+    bool numericos = tipoEsq != TIPO_BOOLEANO && tipoDir != TIPO_BOOLEANO;
+    TipoDado tipo = TIPO_BOOLEANO;
+
+    switch (node->kind) {
+    case N_MAIS: case N_MENOS: case N_MULT: case N_DIV: case N_NEGACAO:
+        if (!numericos) {
+            erroSemantico("Tipos incompativeis", node);
+        }
+        if (node->kind == N_DIV && literalZero(node->children[1])) {
+            erroSemantico("Erro: divisão por zero.", node->children[1]);
+        }
+        tipo = (tipoEsq == TIPO_REAL || tipoDir == TIPO_REAL) ? TIPO_REAL : TIPO_INTEIRO;
+        break;
+    case N_IGUAL_IGUAL: case N_DIFERENTE:
+        // Dois booleanos também podem ser comparados
+        if (!numericos && tipoEsq != tipoDir) {
+            erroSemantico("Tipos incompativeis", node);
+        }
+        break;
+    case N_MAIOR: case N_MAIOR_IGUAL: case N_MENOR: case N_MENOR_IGUAL:
+        if (!numericos) {
+            erroSemantico("Tipos incompativeis", node);
+        }
+        break;
+    default:
+        // '&&' e '||' aceitam qualquer operando; zero é falso, como na execução
+        break;
+    }
+
+    node->semantico = tipo;
+    return tipo;
+}
+
+
+// Gramática da linguagem, descrita uma vez só. Os conjuntos FIRST e FOLLOW de
+// cada não terminal e a tabela LL(1) são calculados a partir dela em tempo de
+// compilação, como a tabela do léxico. O parser por tabela (--parser-tabela)
+// executa a tabela, e as funções recursivas usam os conjuntos para decidir se
+// um token começa um comando ou uma declaração.
+//
+// O corpo de uma produção tem tokens (terminais), não terminais e ações, que
+// montam a árvore na mesma ordem das funções recursivas.
+enum SimboloGramatica : unsigned char {
+    // Terminais: os próprios valores de Token, de T_INTEIRO a T_EOF
+    NT_PROGRAMA = T_EOF + 1,
+    NT_FIM,  // vazio, aceito só antes de EOF
+    NT_DECLARACAO, NT_MAIS_DECLARACOES, NT_TIPO, NT_ID_LISTA, NT_MAIS_IDS,
+    NT_CORPO, NT_COMANDO, NT_INSTRUCOES, NT_INSTRUCAO, NT_BLOCO, NT_SENAO,
+    NT_EXPRESSAO, NT_RESTO_EXPRESSAO, NT_TERMO, NT_OPERADOR,
+    FIM_NAO_TERMINAIS,
+
+    A_FECHAR = FIM_NAO_TERMINAIS,  // conclui o nó aberto mais recente e o entrega ao pai
+    A_TIPO,      // nó Tipo do token atual, que passa a ser o tipo das declarações seguintes
+    A_DECLARAR,  // nó ID do token atual, declarado com esse tipo
+    A_ID,        // nó ID do token atual
+    A_ABRIR,     // A_ABRIR + kind: abre um nó desse NodeKind
+};
+
+constexpr unsigned NUM_TOKENS = T_EOF + 1;
+constexpr unsigned NUM_NAO_TERMINAIS = FIM_NAO_TERMINAIS - NT_PROGRAMA;
+static_assert(NUM_TOKENS <= 64, "Os conjuntos de tokens são os bits de um uint64_t");
+static_assert(A_ABRIR + NUM_NODE_KINDS <= 256, "Os símbolos da gramática cabem num byte");
+
+constexpr unsigned char abrir(NodeKind kind) {
+    return (unsigned char)(A_ABRIR + kind);
+}
+
+constexpr size_t TAMANHO_MAXIMO_PRODUCAO = 10;
+
+struct Producao {
+    unsigned char cabeca;
+    unsigned char tamanho;
+    unsigned char corpo[TAMANHO_MAXIMO_PRODUCAO];
+};
+
+constexpr Producao regra(unsigned char cabeca, initializer_list<unsigned char> corpo) {
+    Producao p{};
+    p.cabeca = cabeca;
+    for (unsigned char simbolo : corpo) p.corpo[p.tamanho++] = simbolo;
+    return p;
+}
+
+// A repetição da descida recursiva vira recursão à direita (MaisDeclaracoes,
+// MaisIds, Instrucoes), que na pilha do parser por tabela não acumula símbolos.
+// As produções de Expressao só entram nos conjuntos: a árvore das expressões é
+// montada por Expressao(), por precedência, e o '-' que o léxico junta ao
+// número seguinte ("a -1") é tratado lá.
+constexpr Producao gramatica[] = {
+    regra(NT_PROGRAMA, { abrir(N_PROGRAMA), NT_DECLARACAO, NT_CORPO, NT_FIM, A_FECHAR }),
+    regra(NT_FIM, {}),
+
+    regra(NT_DECLARACAO, { abrir(N_DECL), NT_TIPO, NT_ID_LISTA, T_PONTO_VIRGULA, NT_MAIS_DECLARACOES, A_FECHAR }),
+    regra(NT_MAIS_DECLARACOES, { NT_TIPO, NT_ID_LISTA, T_PONTO_VIRGULA, NT_MAIS_DECLARACOES }),
+    regra(NT_MAIS_DECLARACOES, {}),
+    regra(NT_TIPO, { A_TIPO, T_INTEIRO }),
+    regra(NT_TIPO, { A_TIPO, T_REAL }),
+    regra(NT_ID_LISTA, { abrir(N_IDLISTA), A_DECLARAR, T_ID, NT_MAIS_IDS, A_FECHAR }),
+    regra(NT_MAIS_IDS, { T_VIRGULA, A_DECLARAR, T_ID, NT_MAIS_IDS }),
+    regra(NT_MAIS_IDS, {}),
+
+    regra(NT_CORPO, { abrir(N_CORPO), abrir(N_COMANDO), NT_INSTRUCAO, NT_INSTRUCOES, A_FECHAR, A_FECHAR }),
+    regra(NT_COMANDO, { abrir(N_COMANDO), NT_INSTRUCOES, A_FECHAR }),
+    regra(NT_INSTRUCOES, { NT_INSTRUCAO, NT_INSTRUCOES }),
+    regra(NT_INSTRUCOES, {}),
+    regra(NT_INSTRUCAO, { abrir(N_ATRIBUICAO), A_ID, T_ID, T_IGUAL, NT_EXPRESSAO, T_PONTO_VIRGULA, A_FECHAR }),
+    regra(NT_INSTRUCAO, { abrir(N_REPETICAO), T_REPITA, NT_BLOCO, T_ATE, NT_EXPRESSAO, T_PONTO_VIRGULA, A_FECHAR }),
+    regra(NT_INSTRUCAO, { abrir(N_ENQUANTO), T_ENQUANTO, T_ABRE_PARENTESES, NT_EXPRESSAO, T_FECHA_PARENTESES, NT_BLOCO, A_FECHAR }),
+    regra(NT_INSTRUCAO, { abrir(N_CONDICAO), T_SE, NT_EXPRESSAO, T_ENTAO, NT_BLOCO, NT_SENAO, A_FECHAR }),
+    regra(NT_INSTRUCAO, { abrir(N_MOSTRAR), T_MOSTRAR, T_ABRE_PARENTESES, NT_EXPRESSAO, T_FECHA_PARENTESES, T_PONTO_VIRGULA, A_FECHAR }),
+    regra(NT_INSTRUCAO, { abrir(N_LER), T_LER, T_ABRE_PARENTESES, A_ID, T_ID, T_FECHA_PARENTESES, T_PONTO_VIRGULA, A_FECHAR }),
+    regra(NT_BLOCO, { T_ABRE_CHAVES, NT_COMANDO, T_FECHA_CHAVES }),
+    regra(NT_BLOCO, { NT_COMANDO }),
+    regra(NT_SENAO, { T_SENAO, NT_BLOCO }),
+    regra(NT_SENAO, {}),
+
+    regra(NT_EXPRESSAO, { NT_TERMO, NT_RESTO_EXPRESSAO }),
+    regra(NT_RESTO_EXPRESSAO, { NT_OPERADOR, NT_TERMO, NT_RESTO_EXPRESSAO }),
+    regra(NT_RESTO_EXPRESSAO, {}),
+    regra(NT_TERMO, { T_ID }), regra(NT_TERMO, { T_NUM_INTEIRO }), regra(NT_TERMO, { T_NUM_REAL }),
+    regra(NT_TERMO, { T_ABRE_PARENTESES, NT_EXPRESSAO, T_FECHA_PARENTESES }),
+    regra(NT_TERMO, { T_MENOS, NT_TERMO }),
+    regra(NT_OPERADOR, { T_OU }), regra(NT_OPERADOR, { T_E }),
+    regra(NT_OPERADOR, { T_MAIOR }), regra(NT_OPERADOR, { T_MAIOR_IGUAL }), regra(NT_OPERADOR, { T_MENOR }),
+    regra(NT_OPERADOR, { T_MENOR_IGUAL }), regra(NT_OPERADOR, { T_IGUAL_IGUAL }), regra(NT_OPERADOR, { T_DIFERENTE }),
+    regra(NT_OPERADOR, { T_MAIS }), regra(NT_OPERADOR, { T_MENOS }), regra(NT_OPERADOR, { T_MULT }), regra(NT_OPERADOR, { T_DIV }),
+};
+constexpr int NUM_PRODUCOES = sizeof(gramatica) / sizeof(gramatica[0]);
+static_assert(NUM_PRODUCOES <= 127, "Os índices das produções cabem num signed char");
+
+// Erro quando o token atual não começa nenhuma produção do não terminal. Os
+// que não têm mensagem seguem pela produção vazia (ou pela única que têm), como
+// os laços das funções recursivas, e o erro aparece no match() seguinte.
+constexpr const char* erroNaoTerminal[NUM_NAO_TERMINAIS] = {
+    nullptr,                                          // Programa
+    "Esperado EOF no final do programa",              // Fim
+    "Esperado declaração de tipo (inteiro ou real)",  // Declaracao
+    nullptr, nullptr, nullptr, nullptr,               // MaisDeclaracoes, Tipo, IdLista, MaisIds
+    "Esperado corpo do programa",                     // Corpo
+    nullptr, nullptr,                                 // Comando, Instrucoes
+    "Comando inválido",                               // Instrucao
+    nullptr, nullptr,                                 // Bloco, Senao
+    "Expressão inválida", nullptr,                    // Expressao, RestoExpressao
+    "Expressão inválida", nullptr,                    // Termo, Operador
+};
+
+struct TabelaLL1 {
+    uint64_t primeiro[NUM_NAO_TERMINAIS];  // FIRST: bit t se o token t pode começar o não terminal
+    uint64_t seguinte[NUM_NAO_TERMINAIS];  // FOLLOW: bit t se o token t pode vir logo depois dele
+    bool anulavel[NUM_NAO_TERMINAIS];
+    signed char producao[NUM_NAO_TERMINAIS][NUM_TOKENS];  // índice em 'gramatica'; -1 = erro
+    unsigned char invertido[NUM_PRODUCOES][TAMANHO_MAXIMO_PRODUCAO];  // corpo de trás para frente, como vai para a pilha
+    int conflitos;  // tokens que escolhem duas produções do mesmo não terminal, fora as sobreposições aceitas
+};
+
+// FIRST de corpo[inicio..] e se ele pode ser vazio. Ações não leem tokens.
+constexpr uint64_t primeiroDoCorpo(const TabelaLL1& t, const Producao& p, unsigned inicio, bool& anulavel) {
+    uint64_t primeiro = 0;
+    anulavel = true;
+    for (unsigned i = inicio; i < p.tamanho && anulavel; i++) {
+        unsigned char s = p.corpo[i];
+        if (s < NUM_TOKENS) {
+            primeiro |= 1ull << s;
+            anulavel = false;
+        }
+        else if (s < FIM_NAO_TERMINAIS) {
+            primeiro |= t.primeiro[s - NT_PROGRAMA];
+            anulavel = t.anulavel[s - NT_PROGRAMA];
+        }
+    }
+    return primeiro;
+}
+
+// Tokens em FIRST e FOLLOW de um não terminal anulável que a tabela resolve de
+// propósito pela produção não vazia: o 'senao' pendente fica com o 'se' mais
+// próximo, como em Condicao(), e um bloco sem chaves leva todas as instruções
+// seguintes, como em Comando(). Qualquer outra sobreposição é conflito.
+constexpr bool sobreposicaoAceita(const TabelaLL1& t, unsigned naoTerminal, unsigned tok) {
+    switch (naoTerminal + NT_PROGRAMA) {
+    case NT_SENAO:
+        return tok == T_SENAO;
+    case NT_BLOCO: case NT_COMANDO: case NT_INSTRUCOES:
+        return t.primeiro[NT_INSTRUCAO - NT_PROGRAMA] >> tok & 1;
+    default:
+        return false;
+    }
+}
+
+constexpr TabelaLL1 construirTabelaLL1() {
+    TabelaLL1 t{};
+
+    // FIRST e anuláveis: ponto fixo sobre as produções
+    for (bool mudou = true; mudou;) {
+        mudou = false;
+        for (const Producao& p : gramatica) {
+            unsigned a = p.cabeca - NT_PROGRAMA;
+            bool anulavel = false;
+            uint64_t primeiro = t.primeiro[a] | primeiroDoCorpo(t, p, 0, anulavel);
+            anulavel = anulavel || t.anulavel[a];
+            mudou = mudou || primeiro != t.primeiro[a] || anulavel != t.anulavel[a];
+            t.primeiro[a] = primeiro;
+            t.anulavel[a] = anulavel;
+        }
+    }
+
+    // FOLLOW: o que pode vir depois de cada não terminal no corpo das produções
+    t.seguinte[NT_PROGRAMA - NT_PROGRAMA] = 1ull << T_EOF;
+    for (bool mudou = true; mudou;) {
+        mudou = false;
+        for (const Producao& p : gramatica) {
+            for (unsigned i = 0; i < p.tamanho; i++) {
+                unsigned char s = p.corpo[i];
+                if (s < NUM_TOKENS || s >= FIM_NAO_TERMINAIS) continue;
+                bool restoAnulavel = false;
+                uint64_t seguinte = t.seguinte[s - NT_PROGRAMA] | primeiroDoCorpo(t, p, i + 1, restoAnulavel);
+                if (restoAnulavel) seguinte |= t.seguinte[p.cabeca - NT_PROGRAMA];
+                mudou = mudou || seguinte != t.seguinte[s - NT_PROGRAMA];
+                t.seguinte[s - NT_PROGRAMA] = seguinte;
+            }
+        }
+    }
+
+    // Tabela: a produção vai para os tokens do seu FIRST e, se puder ser vazia,
+    // para os do FOLLOW que nenhuma outra produção usa. Um token do FOLLOW já
+    // tomado é conflito, a não ser nas sobreposições aceitas.
+    for (unsigned a = 0; a < NUM_NAO_TERMINAIS; a++) {
+        for (unsigned tok = 0; tok < NUM_TOKENS; tok++) t.producao[a][tok] = -1;
+    }
+    for (int i = 0; i < NUM_PRODUCOES; i++) {
+        for (unsigned j = 0; j < gramatica[i].tamanho; j++) t.invertido[i][j] = gramatica[i].corpo[gramatica[i].tamanho - 1 - j];
+    }
+    for (int i = 0; i < NUM_PRODUCOES; i++) {
+        unsigned a = gramatica[i].cabeca - NT_PROGRAMA;
+        bool anulavel = false;
+        uint64_t primeiro = primeiroDoCorpo(t, gramatica[i], 0, anulavel);
+        for (unsigned tok = 0; tok < NUM_TOKENS; tok++) {
+            if (!(primeiro >> tok & 1)) continue;
+            if (t.producao[a][tok] != -1) t.conflitos++;
+            t.producao[a][tok] = (signed char)i;
+        }
+    }
+    int vazia[NUM_NAO_TERMINAIS] = {};
+    int quantas[NUM_NAO_TERMINAIS] = {};
+    for (unsigned a = 0; a < NUM_NAO_TERMINAIS; a++) vazia[a] = -1;
+    for (int i = 0; i < NUM_PRODUCOES; i++) {
+        unsigned a = gramatica[i].cabeca - NT_PROGRAMA;
+        bool anulavel = false;
+        primeiroDoCorpo(t, gramatica[i], 0, anulavel);
+        quantas[a]++;
+        if (!anulavel) continue;
+        if (vazia[a] != -1) t.conflitos++;
+        vazia[a] = i;
+        for (unsigned tok = 0; tok < NUM_TOKENS; tok++) {
+            if (!(t.seguinte[a] >> tok & 1)) continue;
+            if (t.producao[a][tok] == -1) t.producao[a][tok] = (signed char)i;
+            else if (!sobreposicaoAceita(t, a, tok)) t.conflitos++;
+        }
+    }
+
+    // Sem mensagem de erro, os demais tokens seguem pela produção vazia ou pela única
+    for (unsigned a = 0; a < NUM_NAO_TERMINAIS; a++) {
+        int padrao = vazia[a];
+        if (padrao == -1 && quantas[a] == 1) {
+            for (int i = 0; i < NUM_PRODUCOES; i++) {
+                if (gramatica[i].cabeca - NT_PROGRAMA == (int)a) padrao = i;
+            }
+        }
+        if (erroNaoTerminal[a] != nullptr || padrao == -1) continue;
+        for (unsigned tok = 0; tok < NUM_TOKENS; tok++) {
+            if (t.producao[a][tok] == -1) t.producao[a][tok] = (signed char)padrao;
+        }
+    }
+    return t;
+}
+
+constexpr TabelaLL1 tabelaLL1 = construirTabelaLL1();
+static_assert(tabelaLL1.conflitos == 0, "A gramática não é LL(1)");
+
+// O token está no FIRST do não terminal: um teste de bit
+constexpr bool podeComecar(SimboloGramatica naoTerminal, Token token) {
+    return tabelaLL1.primeiro[naoTerminal - NT_PROGRAMA] >> token & 1;
+}
+
+ArvoreNode* Compilador::Programa() {
+    NoEmConstrucao node(*this, N_PROGRAMA);
+
+    // Primeira parte → Seção onde são declaradas as variáveis do programa.
+    node.adicionar(Declaracao());
+
+    // Segunda parte → Corpo do programa, onde são colocados os comandos que serão executados.
+    node.adicionar(Corpo());
+
+    if (currentToken.token != T_EOF) {
+        error("Esperado EOF no final do programa");
+    }
+    return node.concluir();
+}
+
+ArvoreNode* Compilador::Declaracao() {
+    NoEmConstrucao node(*this, N_DECL);
+
+    if (!podeComecar(NT_TIPO, currentToken.token)) {
+        error("Esperado declaração de tipo (inteiro ou real)");
+    }
+    while (podeComecar(NT_TIPO, currentToken.token)) {
+        node.adicionar(Tipo());
+
+        TipoDado tipoDeclaracao = currentToken.token == T_INTEIRO ? TIPO_INTEIRO : TIPO_REAL;
+        nextStep();
+
+        node.adicionar(IdLista(tipoDeclaracao));
+        match(T_PONTO_VIRGULA);
+    }
+
+    return node.concluir();
+}
+
+ArvoreNode* Compilador::Tipo() {
+    ArvoreNode* node = novoNo(N_TIPO, currentToken.token == T_INTEIRO ? "inteiro" : "real");
+
     return node;
 }
 
-ArvoreNode* Ler() {
-    ArvoreNode* node = new ArvoreNode("Ler");
-    match(T_LER);
-    match(T_ABRE_PARENTESES);
-    verificarLerMostrar(currentToken.lexema);
-    node->children.push_back(new ArvoreNode("ID", currentToken.lexema));
+ArvoreNode* Compilador::IdLista(TipoDado tipo) {
+    NoEmConstrucao node(*this, N_IDLISTA);
+
+    node.adicionar(Id(tipo));
+
+    while (currentToken.token == T_VIRGULA) {
+        nextStep();
+        node.adicionar(Id(tipo));
+    }
+
+    return node.concluir();
+}
+
+ArvoreNode* Compilador::Id(TipoDado tipo) {
+    ArvoreNode* node = novoNoId(currentToken);
+
+    if (tipo != TIPO_INDEFINIDO && currentToken.token == T_ID) {
+        // Verifica se a variável já foi declarada
+        verificarRedeclaracao(currentToken);
+        tabelaDeSimbolos.declarar(currentToken.simbolo, tipo);
+    }
     match(T_ID);
-    match(T_FECHA_PARENTESES);
-    match(T_PONTO_VIRGULA);
+
+
     return node;
 }
 
+// Tokens que começam um comando
+bool iniciaComando(Token token) {
+    return podeComecar(NT_INSTRUCAO, token);
+}
+
+ArvoreNode* Compilador::Corpo() {
+    NoEmConstrucao node(*this, N_CORPO);
+
+    if (iniciaComando(currentToken.token)) {
+        node.adicionar(opcoes.parserIterativo ? ComandoIterativo() : Comando());
+    }
+    else {
+        error("Esperado corpo do programa");
+    }
+
+    return node.concluir();
+}
+
+
+ArvoreNode* Compilador::Comando() {
+    NoEmConstrucao node(*this, N_COMANDO);
+
+    while (iniciaComando(currentToken.token)) {
+        node.adicionar(Instrucao());
+    }
+
+    return node.concluir();
+}
+
+// Um comando da sequência, escolhido pelo token atual
+ArvoreNode* Compilador::Instrucao() {
+    switch (currentToken.token) {
+    case T_ID: return Atribuicao();
+    case T_REPITA: return Repeticao();
+    case T_ENQUANTO: return Enquanto();
+    case T_SE: return Condicao();
+    case T_MOSTRAR: return Mostrar();
+    case T_LER: return Ler();
+    default: error("Comando inválido");
+    }
+}
+
+// Comando() sem recursão (--parser-iterativo). Cada 'repita', 'enquanto' e 'se'
+// em análise vira um quadro numa pilha explícita que espera o Comando do seu
+// bloco. As chamadas a novoNo(), match() e às verificações acontecem na mesma
+// ordem que em Comando(), Repeticao(), Enquanto() e Condicao(), então a árvore
+// e os erros são os mesmos, e a profundidade só é limitada pela memória.
+ArvoreNode* Compilador::ComandoIterativo() {
+    enum Etapa : unsigned char {
+        BLOCO,     // Comando: lendo a sequência de comandos
+        REPITA,    // Repeticao: esperando o bloco antes de 'ate'
+        ENQUANTO,  // Enquanto: esperando o bloco
+        ENTAO,     // Condicao: esperando o bloco do 'entao'
+        SENAO,     // Condicao: esperando o bloco do 'senao'
+    };
+    struct Quadro {
+        NoEmConstrucao node;
+        Etapa etapa;
+        bool chaves;  // o bloco esperado foi aberto com '{'
+    };
+    vector<Quadro> pilha;
+
+    auto abrirChaves = [this]() {
+        if (currentToken.token != T_ABRE_CHAVES) return false;
+        match(T_ABRE_CHAVES);
+        return true;
+    };
+
+    pilha.push_back({ NoEmConstrucao(*this, N_COMANDO), BLOCO, false });
+    while (true) {
+        Quadro& topo = pilha.back();
+
+        if (topo.etapa == BLOCO) {
+            switch (currentToken.token) {
+            case T_ID:
+                topo.node.adicionar(Atribuicao());
+                continue;
+            case T_MOSTRAR:
+                topo.node.adicionar(Mostrar());
+                continue;
+            case T_LER:
+                topo.node.adicionar(Ler());
+                continue;
+            case T_REPITA: {
+                Quadro repita = { NoEmConstrucao(*this, N_REPETICAO), REPITA, false };
+                match(T_REPITA);
+                repita.chaves = abrirChaves();
+                pilha.push_back(repita);
+                pilha.push_back({ NoEmConstrucao(*this, N_COMANDO), BLOCO, false });
+                continue;
+            }
+            case T_ENQUANTO: {
+                Quadro enquanto = { NoEmConstrucao(*this, N_ENQUANTO), ENQUANTO, false };
+                match(T_ENQUANTO);
+                match(T_ABRE_PARENTESES);
+                enquanto.node.adicionar(Expressao());
+                match(T_FECHA_PARENTESES);
+                enquanto.chaves = abrirChaves();
+                pilha.push_back(enquanto);
+                pilha.push_back({ NoEmConstrucao(*this, N_COMANDO), BLOCO, false });
+                continue;
+            }
+            case T_SE: {
+                Quadro se = { NoEmConstrucao(*this, N_CONDICAO), ENTAO, false };
+                match(T_SE);
+                se.node.adicionar(Expressao());
+                match(T_ENTAO);
+                se.chaves = abrirChaves();
+                pilha.push_back(se);
+                pilha.push_back({ NoEmConstrucao(*this, N_COMANDO), BLOCO, false });
+                continue;
+            }
+            default:
+                break;
+            }
+
+            // Fim da sequência: o Comando volta para o quadro que o esperava
+            ArvoreNode* bloco = topo.node.concluir();
+            pilha.pop_back();
+            if (pilha.empty()) {
+                return bloco;
+            }
+            pilha.back().node.adicionar(bloco);
+        }
+
+        Quadro& comando = pilha.back();
+        if (comando.chaves) {
+            match(T_FECHA_CHAVES);
+        }
+        if (comando.etapa == REPITA) {
+            match(T_ATE);
+            comando.node.adicionar(Expressao());
+            match(T_PONTO_VIRGULA);
+        }
+        else if (comando.etapa == ENTAO && currentToken.token == T_SENAO) {
+            nextStep();
+            comando.etapa = SENAO;
+            comando.chaves = abrirChaves();
+            pilha.push_back({ NoEmConstrucao(*this, N_COMANDO), BLOCO, false });
+            continue;
+        }
+
+        ArvoreNode* concluido = comando.node.concluir();
+        pilha.pop_back();
+        pilha.back().node.adicionar(concluido);
+    }
+}
+
+// Programa() dirigido pela tabela LL(1) (--parser-tabela). A pilha guarda os
+// símbolos ainda por reconhecer: um token é conferido com match(), um não
+// terminal é trocado pelo corpo da produção que a tabela indica para o token
+// atual e uma ação monta a árvore. As expressões ficam com Expressao(). Os nós,
+// as verificações e os erros saem na mesma ordem da descida recursiva, e o
+// aninhamento, como em --parser-iterativo, só é limitado pela memória.
+ArvoreNode* Compilador::ProgramaTabela() {
+    vector<unsigned char> pilha = { NT_PROGRAMA };
+    vector<NoEmConstrucao> abertos;
+    ArvoreNode* raiz = nullptr;
+    TipoDado tipoDeclaracao = TIPO_INDEFINIDO;
+
+    while (!pilha.empty()) {
+        unsigned char simbolo = pilha.back();
+        pilha.pop_back();
+
+        if (simbolo < NUM_TOKENS) {
+            match((Token)simbolo);
+        }
+        else if (simbolo == NT_EXPRESSAO) {
+            abertos.back().adicionar(Expressao());
+        }
+        else if (simbolo < FIM_NAO_TERMINAIS) {
+            int indice = tabelaLL1.producao[simbolo - NT_PROGRAMA][currentToken.token];
+            if (indice < 0) {
+                const char* mensagem = erroNaoTerminal[simbolo - NT_PROGRAMA];
+                error(mensagem ? string(mensagem) : "Token inesperado: " + string(currentToken.lexema));
+            }
+            const unsigned char* corpo = tabelaLL1.invertido[indice];
+            pilha.insert(pilha.end(), corpo, corpo + gramatica[indice].tamanho);
+        }
+        else if (simbolo == A_FECHAR) {
+            ArvoreNode* node = abertos.back().concluir();
+            abertos.pop_back();
+            if (abertos.empty()) {
+                raiz = node;
+            }
+            else {
+                abertos.back().adicionar(node);
+            }
+        }
+        else if (simbolo == A_TIPO) {
+            abertos.back().adicionar(Tipo());
+            tipoDeclaracao = currentToken.token == T_INTEIRO ? TIPO_INTEIRO : TIPO_REAL;
+        }
+        else if (simbolo == A_DECLARAR || simbolo == A_ID) {
+            abertos.back().adicionar(novoNoId(currentToken));
+            if (simbolo == A_DECLARAR && currentToken.token == T_ID) {
+                verificarRedeclaracao(currentToken);
+                tabelaDeSimbolos.declarar(currentToken.simbolo, tipoDeclaracao);
+            }
+        }
+        else {
+            abertos.emplace_back(*this, (NodeKind)(simbolo - A_ABRIR));
+        }
+    }
+    return raiz;
+}
+
+ArvoreNode* Compilador::Atribuicao() {
+    NoEmConstrucao node(*this, N_ATRIBUICAO);
+
+    node.adicionar(Id());
+    match(T_IGUAL);
+    node.adicionar(Expressao());
+    match(T_PONTO_VIRGULA);
+
+    return node.concluir();
+}
+
+ArvoreNode* Compilador::Repeticao() {
+    NoEmConstrucao node(*this, N_REPETICAO);
+    match(T_REPITA);
+
+    if (currentToken.token == T_ABRE_CHAVES) {
+        match(T_ABRE_CHAVES);
+        node.adicionar(Comando());
+        match(T_FECHA_CHAVES);
+    }
+    else {
+        node.adicionar(Comando());
+    }
+    match(T_ATE);
+    node.adicionar(Expressao());
+    match(T_PONTO_VIRGULA);
+
+    return node.concluir();
+}
+
+ArvoreNode* Compilador::Enquanto() {
+    NoEmConstrucao node(*this, N_ENQUANTO);
+    match(T_ENQUANTO);
+    match(T_ABRE_PARENTESES);
+
+    node.adicionar(Expressao());
+
+    match(T_FECHA_PARENTESES);
+
+    if (currentToken.token == T_ABRE_CHAVES) {
+        match(T_ABRE_CHAVES);
+        node.adicionar(Comando());
+        match(T_FECHA_CHAVES);
+    }
+    else {
+        node.adicionar(Comando());
+    }
+
+    return node.concluir();
+}
+
+ArvoreNode* Compilador::Condicao() {
+    NoEmConstrucao node(*this, N_CONDICAO);
+
+    match(T_SE);
+    node.adicionar(Expressao());
+    match(T_ENTAO);
+
+    if (currentToken.token == T_ABRE_CHAVES) {
+        match(T_ABRE_CHAVES);
+        node.adicionar(Comando());
+        match(T_FECHA_CHAVES);
+    }
+    else {
+        node.adicionar(Comando());
+    }
+
+    if (currentToken.token == T_SENAO) {
+        nextStep();
+        if (currentToken.token == T_ABRE_CHAVES) {
+            match(T_ABRE_CHAVES);
+            node.adicionar(Comando());
+            match(T_FECHA_CHAVES);
+        }
+        else {
+            node.adicionar(Comando());
+        }
+    }
+    return node.concluir();
+
+}
+
+ArvoreNode* Compilador::Mostrar() {
+    NoEmConstrucao node(*this, N_MOSTRAR);
+    match(T_MOSTRAR);
+    match(T_ABRE_PARENTESES);
+    node.adicionar(Expressao());
+    match(T_FECHA_PARENTESES);
+    match(T_PONTO_VIRGULA);
+    return node.concluir();
+}
+
+ArvoreNode* Compilador::Ler() {
+    NoEmConstrucao node(*this, N_LER);
+    match(T_LER);
+    match(T_ABRE_PARENTESES);
+    node.adicionar(novoNoId(currentToken));
+    match(T_ID);
+    match(T_FECHA_PARENTESES);
+    match(T_PONTO_VIRGULA);
+    return node.concluir();
+}
+
+
+// Operador binário representado pelo token, ou N_EXPRESSAO se não for um
+constexpr NodeKind operadorBinario(Token token) {
+    switch (token) {
+    case T_OU: return N_OU;
+    case T_E: return N_E;
+    case T_MAIOR: return N_MAIOR;
+    case T_MAIOR_IGUAL: return N_MAIOR_IGUAL;
+    case T_MENOR: return N_MENOR;
+    case T_MENOR_IGUAL: return N_MENOR_IGUAL;
+    case T_IGUAL_IGUAL: return N_IGUAL_IGUAL;
+    case T_DIFERENTE: return N_DIFERENTE;
+    case T_MAIS: return N_MAIS;
+    case T_MENOS: return N_MENOS;
+    case T_MULT: return N_MULT;
+    case T_DIV: return N_DIV;
+    default: return N_EXPRESSAO;
+    }
+}
+
+// Os tokens que começam um Operador na gramática são os que têm nó de operador
+constexpr bool operadoresConferem() {
+    for (unsigned tok = 0; tok < NUM_TOKENS; tok++) {
+        if (podeComecar(NT_OPERADOR, (Token)tok) != (operadorBinario((Token)tok) != N_EXPRESSAO)) return false;
+    }
+    return true;
+}
+static_assert(operadoresConferem(), "operadorBinario() e as produções de NT_OPERADOR divergem");
+
+// Expressao → Termo (OperadorBinario Termo)*
+// Termo     → ID | NUM | '(' Expressao ')' | '-' Termo
+//
+// São as produções de NT_EXPRESSAO e NT_TERMO em 'gramatica': os tokens que
+// podem vir como operando ou operador são os FIRST de NT_TERMO e NT_OPERADOR.
+//
+// Precedência, da menor para a maior: '||', '&&', relacionais, '+' '-',
+// '*' '/' e o '-' unário. Os binários associam à esquerda. A análise é por
+// precedência com duas pilhas (operandos e operadores), sem recursão, e cada
+// token é empilhado e desempilhado uma vez, então o tempo é linear no tamanho
+// da expressão. Cada operador vira um nó com os dois operandos como filhos, e o
+// nó Expressao fica com a raiz como único filho. Tipos e variáveis são
+// conferidos depois, em verificarSemantica().
+ArvoreNode* Compilador::Expressao() {
+    NoEmConstrucao node(*this, N_EXPRESSAO);
+    pilhaOperandos.clear();
+    pilhaOperadores.clear();
+    uint32_t parentesesAbertos = 0;
+    bool esperandoOperando = true;
+
+    while (true) {
+        Token token = currentToken.token;
+
+        if (esperandoOperando) {
+            if (!podeComecar(NT_TERMO, token)) {
+                error("Expressão inválida");
+            }
+            if (token == T_ABRE_PARENTESES) {
+                pilhaOperadores.push_back({ N_EXPRESSAO, PREC_NENHUMA, currentToken.lexema });
+                parentesesAbertos++;
+            }
+            else if (token == T_MENOS) {
+                pilhaOperadores.push_back({ N_NEGACAO, PREC_UNARIA, currentToken.lexema });
+            }
+            else {
+                pilhaOperandos.push_back(Operando(currentToken));
+                esperandoOperando = false;
+            }
+            nextStep();
+            continue;
+        }
+
+        // O léxico junta o '-' ao número seguinte ("a -1" chega como 'a' e '-1').
+        // Depois de um operando, esse '-' é a subtração.
+        bool negativoColado = (token == T_NUM_INTEIRO || token == T_NUM_REAL) && currentToken.lexema[0] == '-';
+        if (negativoColado || podeComecar(NT_OPERADOR, token)) {
+            NodeKind kind = negativoColado ? N_MENOS : operadorBinario(token);
+            Precedencia precedencia = precedenciaNo(kind);
+            while (!pilhaOperadores.empty() && pilhaOperadores.back().precedencia >= precedencia) {
+                reduzirOperador();
+            }
+            if (negativoColado) {
+                pilhaOperadores.push_back({ N_MENOS, precedencia, currentToken.lexema.substr(0, 1) });
+                // O valor já foi lido com o sinal; o operando é o oposto dele. Para
+                // -9223372036854775808 o oposto dá a volta e continua INT64_MIN,
+                // e 'a - INT64_MIN' vale o mesmo que na aritmética da máquina
+                TokenValue positivo = currentToken;
+                positivo.lexema.remove_prefix(1);
+                if (token == T_NUM_INTEIRO) {
+                    positivo.numero.inteiro = (int64_t)(0 - (uint64_t)currentToken.numero.inteiro);
+                }
+                else {
+                    positivo.numero.real = -currentToken.numero.real;
+                }
+                pilhaOperandos.push_back(Operando(positivo));
+            }
+            else {
+                pilhaOperadores.push_back({ kind, precedencia, currentToken.lexema });
+                esperandoOperando = true;
+            }
+            nextStep();
+            continue;
+        }
+
+        // Um ')' sem '(' aberto aqui pertence ao comando ('enquanto (...)', 'mostrar(...)')
+        if (token == T_FECHA_PARENTESES && parentesesAbertos > 0) {
+            while (pilhaOperadores.back().precedencia != PREC_NENHUMA) {
+                reduzirOperador();
+            }
+            pilhaOperadores.pop_back();
+            parentesesAbertos--;
+            nextStep();
+            continue;
+        }
+        break;
+    }
+
+    if (parentesesAbertos > 0) {
+        error("Esperado ')' na expressão");
+    }
+    while (!pilhaOperadores.empty()) {
+        reduzirOperador();
+    }
+
+    ArvoreNode* raiz = pilhaOperandos.back();
+    node.adicionar(raiz);
+    if (opcoes.arvorePlana) {
+        reconstruirArvorePlana(raiz);
+    }
+    return node.concluir();
+}
+
+// Folha de uma expressão. O tipo é anotado depois, por verificarSemantica().
+ArvoreNode* Compilador::Operando(const TokenValue& tok) {
+    switch (tok.token) {
+    case T_ID: return alocarNo(N_ID, tok.lexema, {}, tok.simbolo);
+    case T_NUM_INTEIRO: return alocarNo(N_INTEIRO, tok.lexema, tok.numero);
+    default: return alocarNo(N_REAL, tok.lexema, tok.numero);
+    }
+}
+
+// Tira o operador do topo e monta o nó dele com os operandos do topo
+void Compilador::reduzirOperador() {
+    OperadorPendente operador = pilhaOperadores.back();
+    pilhaOperadores.pop_back();
+
+    size_t aridade = operador.kind == N_NEGACAO ? 1 : 2;
+    ArvoreNode* node = alocarNo(operador.kind, operador.texto);
+    node->children.dados = arenaArvore.alocarArray<ArvoreNode*>(aridade);
+    node->children.tamanho = (uint32_t)aridade;
+    memcpy(node->children.dados, pilhaOperandos.data() + pilhaOperandos.size() - aridade, aridade * sizeof(ArvoreNode*));
+    pilhaOperandos.resize(pilhaOperandos.size() - aridade);
+    pilhaOperandos.push_back(node);
+}
+
+// Analisador léxico dirigido por tabela.
+// Cada byte da entrada é mapeado para uma classe de caractere e o autômato avança
+// pela tabela de transições enquanto houver transição válida; o último estado
+// alcançado decide qual token foi reconhecido.
+
+// Classes de caracteres reconhecidas pelo autômato
+enum ClasseChar : unsigned char {
+    C_OUTRO, C_ESPACO, C_LETRA, C_DIGITO, C_PONTO,
+    C_MAIS, C_MENOS, C_MULT, C_DIV,
+    C_IGUAL, C_EXCLAMACAO, C_MAIOR, C_MENOR, C_E_COMERCIAL, C_BARRA,
+    C_PONTO_VIRGULA, C_VIRGULA, C_ABRE_CHAVES, C_FECHA_CHAVES, C_ABRE_PARENTESES, C_FECHA_PARENTESES,
+    NUM_CLASSES
+};
+
+// Estados do autômato (E_ERRO = não há transição)
+enum EstadoLexico : unsigned char {
+    E_ERRO, E_INICIO,
+    E_ID, E_NUM_INTEIRO, E_NUM_REAL,
+    E_MAIS, E_MENOS, E_MULT, E_DIV,
+    E_IGUAL, E_IGUAL_IGUAL, E_EXCLAMACAO, E_DIFERENTE,
+    E_MAIOR, E_MAIOR_IGUAL, E_MENOR, E_MENOR_IGUAL,
+    E_E_COMERCIAL, E_E, E_BARRA, E_OU,
+    E_PONTO_VIRGULA, E_VIRGULA, E_ABRE_CHAVES, E_FECHA_CHAVES, E_ABRE_PARENTESES, E_FECHA_PARENTESES,
+    NUM_ESTADOS
+};
+
+struct TabelaLexica {
+    unsigned char classe[256];
+    unsigned char transicao[NUM_ESTADOS][NUM_CLASSES];
+    Token aceita[NUM_ESTADOS];  // T_UNKNOWN nos estados que não são finais
+};
+
+constexpr TabelaLexica construirTabelaLexica() {
+    TabelaLexica t{};
+
+    for (int c = 'a'; c <= 'z'; c++) t.classe[c] = C_LETRA;
+    for (int c = 'A'; c <= 'Z'; c++) t.classe[c] = C_LETRA;
+    for (int c = '0'; c <= '9'; c++) t.classe[c] = C_DIGITO;
+    t.classe[(unsigned char)' '] = C_ESPACO;
+    t.classe[(unsigned char)'\t'] = C_ESPACO;
+    t.classe[(unsigned char)'\n'] = C_ESPACO;
+    t.classe[(unsigned char)'\v'] = C_ESPACO;
+    t.classe[(unsigned char)'\f'] = C_ESPACO;
+    t.classe[(unsigned char)'\r'] = C_ESPACO;
+    t.classe[(unsigned char)'.'] = C_PONTO;
+    t.classe[(unsigned char)'+'] = C_MAIS;
+    t.classe[(unsigned char)'-'] = C_MENOS;
+    t.classe[(unsigned char)'*'] = C_MULT;
+    t.classe[(unsigned char)'/'] = C_DIV;
+    t.classe[(unsigned char)'='] = C_IGUAL;
+    t.classe[(unsigned char)'!'] = C_EXCLAMACAO;
+    t.classe[(unsigned char)'>'] = C_MAIOR;
+    t.classe[(unsigned char)'<'] = C_MENOR;
+    t.classe[(unsigned char)'&'] = C_E_COMERCIAL;
+    t.classe[(unsigned char)'|'] = C_BARRA;
+    t.classe[(unsigned char)';'] = C_PONTO_VIRGULA;
+    t.classe[(unsigned char)','] = C_VIRGULA;
+    t.classe[(unsigned char)'{'] = C_ABRE_CHAVES;
+    t.classe[(unsigned char)'}'] = C_FECHA_CHAVES;
+    t.classe[(unsigned char)'('] = C_ABRE_PARENTESES;
+    t.classe[(unsigned char)')'] = C_FECHA_PARENTESES;
+
+    // Símbolos de um caractere saem direto do estado inicial
+    t.transicao[E_INICIO][C_LETRA] = E_ID;
+    t.transicao[E_INICIO][C_DIGITO] = E_NUM_INTEIRO;
+    t.transicao[E_INICIO][C_MAIS] = E_MAIS;
+    t.transicao[E_INICIO][C_MENOS] = E_MENOS;
+    t.transicao[E_INICIO][C_MULT] = E_MULT;
+    t.transicao[E_INICIO][C_DIV] = E_DIV;
+    t.transicao[E_INICIO][C_IGUAL] = E_IGUAL;
+    t.transicao[E_INICIO][C_EXCLAMACAO] = E_EXCLAMACAO;
+    t.transicao[E_INICIO][C_MAIOR] = E_MAIOR;
+    t.transicao[E_INICIO][C_MENOR] = E_MENOR;
+    t.transicao[E_INICIO][C_E_COMERCIAL] = E_E_COMERCIAL;
+    t.transicao[E_INICIO][C_BARRA] = E_BARRA;
+    t.transicao[E_INICIO][C_PONTO_VIRGULA] = E_PONTO_VIRGULA;
+    t.transicao[E_INICIO][C_VIRGULA] = E_VIRGULA;
+    t.transicao[E_INICIO][C_ABRE_CHAVES] = E_ABRE_CHAVES;
+    t.transicao[E_INICIO][C_FECHA_CHAVES] = E_FECHA_CHAVES;
+    t.transicao[E_INICIO][C_ABRE_PARENTESES] = E_ABRE_PARENTESES;
+    t.transicao[E_INICIO][C_FECHA_PARENTESES] = E_FECHA_PARENTESES;
+
+    // Identificadores: apenas letras
+    t.transicao[E_ID][C_LETRA] = E_ID;
+
+    // Números: '-' seguido de dígito inicia um número negativo
+    t.transicao[E_MENOS][C_DIGITO] = E_NUM_INTEIRO;
+    t.transicao[E_NUM_INTEIRO][C_DIGITO] = E_NUM_INTEIRO;
+    t.transicao[E_NUM_INTEIRO][C_PONTO] = E_NUM_REAL;
+    t.transicao[E_NUM_REAL][C_DIGITO] = E_NUM_REAL;
+
+    // Operadores de dois caracteres
+    t.transicao[E_IGUAL][C_IGUAL] = E_IGUAL_IGUAL;
+    t.transicao[E_EXCLAMACAO][C_IGUAL] = E_DIFERENTE;
+    t.transicao[E_MAIOR][C_IGUAL] = E_MAIOR_IGUAL;
+    t.transicao[E_MENOR][C_IGUAL] = E_MENOR_IGUAL;
+    t.transicao[E_E_COMERCIAL][C_E_COMERCIAL] = E_E;
+    t.transicao[E_BARRA][C_BARRA] = E_OU;
+
+    for (int e = 0; e < NUM_ESTADOS; e++) t.aceita[e] = T_UNKNOWN;
+    t.aceita[E_ID] = T_ID;
+    t.aceita[E_NUM_INTEIRO] = T_NUM_INTEIRO;
+    t.aceita[E_NUM_REAL] = T_NUM_REAL;
+    t.aceita[E_MAIS] = T_MAIS;
+    t.aceita[E_MENOS] = T_MENOS;
+    t.aceita[E_MULT] = T_MULT;
+    t.aceita[E_DIV] = T_DIV;
+    t.aceita[E_IGUAL] = T_IGUAL;
+    t.aceita[E_IGUAL_IGUAL] = T_IGUAL_IGUAL;
+    t.aceita[E_DIFERENTE] = T_DIFERENTE;
+    t.aceita[E_MAIOR] = T_MAIOR;
+    t.aceita[E_MAIOR_IGUAL] = T_MAIOR_IGUAL;
+    t.aceita[E_MENOR] = T_MENOR;
+    t.aceita[E_MENOR_IGUAL] = T_MENOR_IGUAL;
+    t.aceita[E_E] = T_E;
+    t.aceita[E_OU] = T_OU;
+    t.aceita[E_PONTO_VIRGULA] = T_PONTO_VIRGULA;
+    t.aceita[E_VIRGULA] = T_VIRGULA;
+    t.aceita[E_ABRE_CHAVES] = T_ABRE_CHAVES;
+    t.aceita[E_FECHA_CHAVES] = T_FECHA_CHAVES;
+    t.aceita[E_ABRE_PARENTESES] = T_ABRE_PARENTESES;
+    t.aceita[E_FECHA_PARENTESES] = T_FECHA_PARENTESES;
+
+    return t;
+}
+
+constexpr TabelaLexica tabelaLexica = construirTabelaLexica();
+
+
+// Palavras reservadas, localizadas por um hash perfeito calculado em tempo de compilação:
+// h = (primeira letra + 7 * última letra + tamanho) mod 16
+struct PalavraReservada {
+    const char* texto;
+    size_t tamanho;
+    Token token;
+};
+
+constexpr PalavraReservada palavrasReservadas[] = {
+    { "inteiro", 7, T_INTEIRO }, { "real", 4, T_REAL },
+    { "repita", 6, T_REPITA }, { "enquanto", 8, T_ENQUANTO },
+    { "se", 2, T_SE }, { "senao", 5, T_SENAO }, { "entao", 5, T_ENTAO },
+    { "ate", 3, T_ATE }, { "mostrar", 7, T_MOSTRAR }, { "ler", 3, T_LER },
+};
+constexpr int NUM_PALAVRAS_RESERVADAS = sizeof(palavrasReservadas) / sizeof(palavrasReservadas[0]);
+constexpr unsigned TAMANHO_HASH_PALAVRAS = 16;
+
+constexpr unsigned hashPalavra(unsigned char primeira, unsigned char ultima, size_t tamanho) {
+    return (primeira + 7u * ultima + (unsigned)tamanho) & (TAMANHO_HASH_PALAVRAS - 1);
+}
+
+struct TabelaPalavras {
+    signed char indice[TAMANHO_HASH_PALAVRAS];  // -1 = posição vazia
+    bool perfeito;
+};
+
+constexpr TabelaPalavras construirTabelaPalavras() {
+    TabelaPalavras t{};
+    t.perfeito = true;
+    for (unsigned h = 0; h < TAMANHO_HASH_PALAVRAS; h++) t.indice[h] = -1;
+    for (int i = 0; i < NUM_PALAVRAS_RESERVADAS; i++) {
+        const PalavraReservada& p = palavrasReservadas[i];
+        unsigned h = hashPalavra(p.texto[0], p.texto[p.tamanho - 1], p.tamanho);
+        if (t.indice[h] != -1) t.perfeito = false;
+        t.indice[h] = (signed char)i;
+    }
+    return t;
+}
+
+constexpr TabelaPalavras tabelaPalavras = construirTabelaPalavras();
+static_assert(tabelaPalavras.perfeito, "Colisão no hash das palavras reservadas");
+
+// Retorna o token da palavra reservada ou T_ID quando o lexema é um identificador comum
+Token palavraReservada(const char* texto, size_t tamanho) {
+    if (tamanho < 2 || tamanho > 8) return T_ID;
+
+    int i = tabelaPalavras.indice[hashPalavra(texto[0], texto[tamanho - 1], tamanho)];
+    if (i < 0) return T_ID;
+
+    const PalavraReservada& p = palavrasReservadas[i];
+    return (p.tamanho == tamanho && memcmp(p.texto, texto, tamanho) == 0) ? p.token : T_ID;
+}
+
+// Fim de uma sequência de espaços, letras ou dígitos: a primeira posição em
+// [i, fim) cuja classe não é CLASSE. Dentro de uma sequência o autômato só
+// repetiria o mesmo estado, então o analisador pula a sequência inteira. Os
+// núcleos vetorizados classificam 16 ou 32 bytes por vez e terminam o resto
+// com o escalar, que é a definição: as classes vêm de tabelaLexica.
+template <ClasseChar CLASSE>
+size_t varrerEscalar(const char* fonte, size_t i, size_t fim) {
+    while (i < fim && tabelaLexica.classe[(unsigned char)fonte[i]] == CLASSE) i++;
+    return i;
+}
+
+#ifdef VARREDURA_X86
+#if defined(__GNUC__) || defined(__clang__)
+#define ALVO_AVX2 __attribute__((target("avx2")))
+#else
+#define ALVO_AVX2
+#endif
+
+inline unsigned primeiroBit(uint32_t mascara) {
+#ifdef _MSC_VER
+    unsigned long i;
+    _BitScanForward(&i, mascara);
+    return (unsigned)i;
+#else
+    return (unsigned)__builtin_ctz(mascara);
+#endif
+}
+
+// 0xFF nos bytes com d <= n, sem sinal. O SSE2 e o AVX2 não comparam sem
+// sinal, então 'd <= n' vira 'subtração saturada de n dá zero'.
+inline __m128i ate(__m128i d, char n) {
+    return _mm_cmpeq_epi8(_mm_subs_epu8(d, _mm_set1_epi8(n)), _mm_setzero_si128());
+}
+
+ALVO_AVX2 inline __m256i ate(__m256i d, char n) {
+    return _mm256_cmpeq_epi8(_mm256_subs_epu8(d, _mm256_set1_epi8(n)), _mm256_setzero_si256());
+}
+
+// 0xFF nos bytes da classe
+template <ClasseChar CLASSE>
+inline __m128i naClasse(__m128i x) {
+    if constexpr (CLASSE == C_ESPACO) {
+        return _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8(' ')), ate(_mm_sub_epi8(x, _mm_set1_epi8('\t')), '\r' - '\t'));
+    }
+    else if constexpr (CLASSE == C_LETRA) {
+        return ate(_mm_sub_epi8(_mm_or_si128(x, _mm_set1_epi8(0x20)), _mm_set1_epi8('a')), 'z' - 'a');
+    }
+    else {
+        return ate(_mm_sub_epi8(x, _mm_set1_epi8('0')), '9' - '0');
+    }
+}
+
+template <ClasseChar CLASSE>
+size_t varrerSse2(const char* fonte, size_t i, size_t fim) {
+    for (; i + 16 <= fim; i += 16) {
+        __m128i bloco = _mm_loadu_si128((const __m128i*)(fonte + i));
+        uint32_t fora = ~(uint32_t)_mm_movemask_epi8(naClasse<CLASSE>(bloco)) & 0xFFFF;
+        if (fora) return i + primeiroBit(fora);
+    }
+    return varrerEscalar<CLASSE>(fonte, i, fim);
+}
+
+template <ClasseChar CLASSE>
+ALVO_AVX2 inline __m256i naClasse(__m256i x) {
+    if constexpr (CLASSE == C_ESPACO) {
+        return _mm256_or_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8(' ')), ate(_mm256_sub_epi8(x, _mm256_set1_epi8('\t')), '\r' - '\t'));
+    }
+    else if constexpr (CLASSE == C_LETRA) {
+        return ate(_mm256_sub_epi8(_mm256_or_si256(x, _mm256_set1_epi8(0x20)), _mm256_set1_epi8('a')), 'z' - 'a');
+    }
+    else {
+        return ate(_mm256_sub_epi8(x, _mm256_set1_epi8('0')), '9' - '0');
+    }
+}
+
+template <ClasseChar CLASSE>
+ALVO_AVX2 size_t varrerAvx2(const char* fonte, size_t i, size_t fim) {
+    for (; i + 32 <= fim; i += 32) {
+        __m256i bloco = _mm256_loadu_si256((const __m256i*)(fonte + i));
+        uint32_t fora = ~(uint32_t)_mm256_movemask_epi8(naClasse<CLASSE>(bloco));
+        if (fora) return i + primeiroBit(fora);
+    }
+    return varrerSse2<CLASSE>(fonte, i, fim);
+}
+
+bool temAvx2() {
+#ifdef _MSC_VER
+    int registros[4];
+    __cpuid(registros, 1);
+    bool osxsave = (registros[2] & (1 << 27)) != 0;
+    if (!osxsave || (_xgetbv(0) & 6) != 6) return false;
+    __cpuidex(registros, 7, 0);
+    return (registros[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+
+struct NucleoVarredura {
+    const char* nome;
+    size_t (*espacos)(const char*, size_t, size_t);
+    size_t (*letras)(const char*, size_t, size_t);
+    size_t (*digitos)(const char*, size_t, size_t);
+};
+
+// Os primeiros bytes são conferidos aqui mesmo: a maioria das sequências é
+// curta e termina antes de a chamada ao núcleo compensar
+template <ClasseChar CLASSE>
+inline size_t varrer(size_t (*nucleo)(const char*, size_t, size_t), const char* fonte, size_t i, size_t fim) {
+    for (size_t limite = min(i + 8, fim); i < limite; i++) {
+        if (tabelaLexica.classe[(unsigned char)fonte[i]] != CLASSE) return i;
+    }
+    return i < fim ? nucleo(fonte, i, fim) : i;
+}
+
+const NucleoVarredura nucleosVarredura[] = {
+    { "escalar", varrerEscalar<C_ESPACO>, varrerEscalar<C_LETRA>, varrerEscalar<C_DIGITO> },
+#ifdef VARREDURA_X86
+    { "sse2", varrerSse2<C_ESPACO>, varrerSse2<C_LETRA>, varrerSse2<C_DIGITO> },
+    { "avx2", varrerAvx2<C_ESPACO>, varrerAvx2<C_LETRA>, varrerAvx2<C_DIGITO> },
+#endif
+};
+
+// Núcleo pelo nome, se este processador o executa
+const NucleoVarredura* nucleoVarredura(string_view nome) {
+    for (const NucleoVarredura& n : nucleosVarredura) {
+        if (nome != n.nome) continue;
+#ifdef VARREDURA_X86
+        if (&n == &nucleosVarredura[2] && !temAvx2()) return nullptr;
+#endif
+        return &n;
+    }
+    return nullptr;
+}
+
+// O melhor núcleo disponível, trocado só por --varredura e pelo benchmark
+const NucleoVarredura* varredura = [] {
+    const NucleoVarredura* n = nucleoVarredura("avx2");
+    return n ? n : nucleoVarredura(size(nucleosVarredura) > 1 ? "sse2" : "escalar");
+}();
+
+// Reconhece o próximo token da entrada percorrendo o autômato
+TokenValue Compilador::proximoToken() {
+    const TabelaLexica& t = tabelaLexica;
+    const char* fonte = input.data();
+    const size_t tamanho = input.size();
+
+    // ignora espaços em branco
+    const NucleoVarredura& nucleo = *varredura;
+    posicao = varrer<C_ESPACO>(nucleo.espacos, fonte, posicao, tamanho);
+
+    if (posicao >= tamanho) {
+        if (fluxo && recarregarEntrada(posicao)) return proximoToken();
+        return { T_EOF, "", 0 };
+    }
+
+    size_t inicio = posicao;
+    unsigned char estado = E_INICIO;
+    while (posicao < tamanho) {
+        unsigned char proximo = t.transicao[estado][t.classe[(unsigned char)fonte[posicao]]];
+        if (proximo == E_ERRO) break;
+        estado = proximo;
+        posicao++;
+
+        if (estado == E_ID) posicao = varrer<C_LETRA>(nucleo.letras, fonte, posicao, tamanho);
+        else if (estado == E_NUM_INTEIRO || estado == E_NUM_REAL) posicao = varrer<C_DIGITO>(nucleo.digitos, fonte, posicao, tamanho);
+    }
+
+    // Em --fluxo, um token que chega ao fim do bloco pode continuar no
+    // próximo: ele é lido de novo num bloco que começa nele
+    if (posicao == tamanho && fluxo && recarregarEntrada(inicio)) {
+        return proximoToken();
+    }
+
+    Token token = t.aceita[estado];
+    if (token == T_UNKNOWN) {
+        if (estado == E_EXCLAMACAO) {
+            error("Token inesperado");
+        }
+
+        // Caractere desconhecido ('&' ou '|' isolados também caem aqui)
+        if (estado == E_INICIO) posicao++;
+        return { T_UNKNOWN, "desconhecido", 0 };
+    }
+
+    if (token == T_ID) {
+        token = palavraReservada(fonte + inicio, posicao - inicio);
+    }
+
+    TokenValue tok = { token, string_view(fonte + inicio, posicao - inicio), 0 };
+    if (token == T_ID) {
+        tok.simbolo = simbolos.internar(tok.lexema);
+    }
+    if (token == T_NUM_INTEIRO || token == T_NUM_REAL) {
+        tok.numero = lerNumero(token, tok.lexema);
+    }
+    return tok;
+}
+
+// Valor do literal, convertido uma única vez a partir do lexema. from_chars
+// arredonda os reais corretamente e recusa inteiros fora de int64.
+Numero Compilador::lerNumero(Token token, string_view lexema) {
+    Numero n;
+    const char* fim = lexema.data() + lexema.size();
+    from_chars_result r = token == T_NUM_INTEIRO ? from_chars(lexema.data(), fim, n.inteiro) : from_chars(lexema.data(), fim, n.real);
+    if (r.ec != errc() || r.ptr != fim) {
+        error("Número fora do intervalo: " + string(lexema));
+    }
+    return n;
+}
+
+// Análise léxica de fontes grandes em várias threads. A linguagem não tem
+// strings nem comentários, e ';' e '}' são tokens de um caractere, então um
+// corte logo depois de um deles nunca divide um token. Cada trecho é lido por
+// uma thread, com um Compilador próprio e números de identificador locais, e o
+// parser consome os trechos em ordem: ao chegar num trecho, os nomes dele são
+// internados na tabela global na ordem em que apareceram, que é a ordem da
+// leitura sequencial, e os números locais são trocados pelos globais. Tokens,
+// números, posições e erros saem iguais aos de proximoToken().
+//
+// As threads ficam no máximo TRECHOS_ADIANTADOS trechos à frente do parser, e
+// cada trecho é liberado quando ele termina, então a memória dos tokens não
+// cresce com a fonte.
+class LexicoParalelo {
+    struct Trecho {
+        Trecho(size_t i, size_t f) : inicio(i), fim(f) {}
+
+        size_t inicio;
+        size_t fim;  // logo depois de um ';' ou '}', ou o fim da fonte
+        vector<TokenValue> tokens;  // T_ID com o número local; T_UNKNOWN com a posição final em numero.inteiro
+        vector<string_view> nomes;  // nome de cada número local
+        bool pronto = false;
+        bool falhou = false;  // 'erro' vem depois do último token
+        ErroCompilacao erro;
+    };
+
+    Compilador& c;
+    string_view fonte;
+    vector<Trecho> trechos;
+    size_t trechosAdiantados;
+
+    // Do parser: trecho atual, próximo token dele e os números globais dos seus nomes
+    size_t atual = 0;
+    size_t indice = 0;
+    vector<uint32_t> globais;
+    bool traduzido = false;
+
+    mutex trava;
+    condition_variable avisar;
+    size_t proximoLivre = 0;
+    bool parar = false;
+    vector<thread> trabalhadores;
+    vector<double> tempos;
+
+    void trabalhar(unsigned t) {
+        Compilador leitor(c.opcoes, c.console);
+        while (true) {
+            size_t i;
+            {
+                unique_lock<mutex> l(trava);
+                avisar.wait(l, [&] { return parar || proximoLivre >= trechos.size() || proximoLivre < atual + trechosAdiantados; });
+                if (parar || proximoLivre >= trechos.size()) return;
+                i = proximoLivre++;
+            }
+
+            Relogio::time_point inicio = Relogio::now();
+            Trecho& trecho = trechos[i];
+            // A entrada termina no fim do trecho, então o T_EOF marca o fim dele
+            leitor.input = fonte.substr(0, trecho.fim);
+            leitor.posicao = trecho.inicio;
+            leitor.simbolos.limpar();
+            try {
+                for (TokenValue tok = leitor.proximoToken(); tok.token != T_EOF; tok = leitor.proximoToken()) {
+                    if (tok.token == T_UNKNOWN) tok.numero.inteiro = (int64_t)leitor.posicao;
+                    trecho.tokens.push_back(tok);
+                }
+            }
+            catch (const ErroCompilacao& e) {
+                trecho.falhou = true;
+                trecho.erro = e;
+            }
+            for (uint32_t id = 0; id < leitor.simbolos.quantidade(); id++) {
+                trecho.nomes.push_back(leitor.simbolos.nome(id));
+            }
+            tempos[t] += chrono::duration<double>(Relogio::now() - inicio).count();
+
+            lock_guard<mutex> l(trava);
+            trecho.pronto = true;
+            avisar.notify_all();
+        }
+    }
+
+public:
+    static const size_t TAMANHO_TRECHO = 256 << 10;
+
+    LexicoParalelo(Compilador& compilador, unsigned threads)
+        : c(compilador), fonte(compilador.input), trechosAdiantados(4 * (size_t)threads), tempos(threads) {
+        for (size_t inicio = 0; inicio < fonte.size();) {
+            size_t fim = inicio + TAMANHO_TRECHO < fonte.size() ? fonte.find_first_of(";}", inicio + TAMANHO_TRECHO) : string_view::npos;
+            fim = fim == string_view::npos ? fonte.size() : fim + 1;
+            trechos.emplace_back(inicio, fim);
+            inicio = fim;
+        }
+        for (unsigned t = 0; t < threads; t++) {
+            trabalhadores.emplace_back([this, t] { trabalhar(t); });
+        }
+        c.lexicoParalelo = this;
+    }
+
+    LexicoParalelo(const LexicoParalelo&) = delete;
+    LexicoParalelo& operator=(const LexicoParalelo&) = delete;
+
+    ~LexicoParalelo() {
+        {
+            lock_guard<mutex> l(trava);
+            parar = true;
+        }
+        avisar.notify_all();
+        for (thread& t : trabalhadores) t.join();
+        c.lexicoParalelo = nullptr;
+    }
+
+    // Próximo token do arquivo, com c.posicao onde proximoToken() a deixaria
+    TokenValue proximo() {
+        while (atual < trechos.size()) {
+            Trecho& trecho = trechos[atual];
+            if (!traduzido) {
+                unique_lock<mutex> l(trava);
+                avisar.wait(l, [&] { return trecho.pronto; });
+                l.unlock();
+                globais.clear();
+                for (string_view nome : trecho.nomes) globais.push_back(c.simbolos.internar(nome));
+                traduzido = true;
+            }
+
+            if (indice < trecho.tokens.size()) {
+                TokenValue tok = trecho.tokens[indice++];
+                if (tok.token == T_ID) {
+                    tok.simbolo = globais[tok.simbolo];
+                }
+                if (tok.token == T_UNKNOWN) {
+                    c.posicao = (size_t)tok.numero.inteiro;
+                    tok.numero = {};
+                }
+                else {
+                    c.posicao = (size_t)(tok.lexema.data() - fonte.data()) + tok.lexema.size();
+                }
+                return tok;
+            }
+            if (trecho.falhou) {
+                c.posicao = trecho.erro.posicao;
+                throw trecho.erro;
+            }
+
+            // Trecho consumido: a memória volta e uma thread pode pegar o próximo
+            vector<TokenValue>().swap(trecho.tokens);
+            vector<string_view>().swap(trecho.nomes);
+            indice = 0;
+            traduzido = false;
+            {
+                lock_guard<mutex> l(trava);
+                atual++;
+            }
+            avisar.notify_all();
+        }
+        c.posicao = fonte.size();
+        return { T_EOF, "", 0 };
+    }
+
+    // Soma do tempo que as threads passaram lendo
+    double tempoTrabalho() const {
+        double total = 0;
+        for (double t : tempos) total += t;
+        return total;
+    }
+};
+
+// Threads para a análise léxica de 'tamanho' bytes: ao menos dois trechos por thread
+unsigned threadsLexica(unsigned threads, size_t tamanho) {
+    return (unsigned)min<size_t>(threads, tamanho / (2 * LexicoParalelo::TAMANHO_TRECHO));
+}
+
+TokenValue Compilador::getNextToken() {
+    TokenValue tok;
+    if (lexicoParalelo) {
+        estatisticas.lexica.chamadas++;
+        tok = lexicoParalelo->proximo();
+    }
+    else {
+        AmostraFase amostra(estatisticas.lexica, opcoes.relatorio != RELATORIO_NENHUM);
+        tok = proximoToken();
+    }
+
+    if constexpr (RASTRO_MAXIMO >= RASTRO_ERROS) {
+        if (opcoes.rastro >= RASTRO_ERROS) {
+            ultimosTokens.registrar(tok);
+            if (RASTRO_MAXIMO >= RASTRO_TOKENS && opcoes.rastro >= RASTRO_TOKENS && tok.token != T_UNKNOWN) {
+                printToken(tok);
+            }
+        }
+    }
+    return tok;
+}
+
+
+// Função para exibir os tokens
+void Compilador::printToken(TokenValue tok) {
+    switch (tok.token) {
+    case T_INTEIRO: console << "Token: T_INTEIRO, " << tok.lexema << '\n'; break;
+    case T_REAL: console << "Token: T_REAL, " << tok.lexema << '\n'; break;
+    case T_REPITA: console << "Token: T_REPITA, " << tok.lexema << '\n'; break;
+    case T_ENQUANTO: console << "Token: T_ENQUANTO, " << tok.lexema << '\n'; break;
+    case T_SE: console << "Token: T_SE, " << tok.lexema << '\n'; break;
+    case T_SENAO: console << "Token: T_SENAO, " << tok.lexema << '\n'; break;
+    case T_ENTAO: console << "Token: T_ENTAO, " << tok.lexema << '\n'; break;
+    case T_ATE: console << "Token: T_ATE, " << tok.lexema << '\n'; break;
+    case T_MOSTRAR: console << "Token: T_MOSTRAR, " << tok.lexema << '\n'; break;
+    case T_LER: console << "Token: T_LER, " << tok.lexema << '\n'; break;
+    case T_ID: console << "Token: T_ID, " << tok.lexema << '\n'; break;
+    case T_NUM_REAL: console << "Token: T_NUM_REAL, " << tok.lexema << ", Valor: " << tok.numero.real << '\n'; break;
+    case T_NUM_INTEIRO: console << "Token: T_NUM_INTEIRO, " << tok.lexema << ", Valor: " << tok.numero.inteiro << '\n'; break;
+    case T_IGUAL: console << "Token: T_IGUAL, " << tok.lexema << '\n'; break;
+    case T_IGUAL_IGUAL: console << "Token: T_IGUAL_IGUAL, " << tok.lexema << '\n'; break;
+    case T_DIFERENTE: console << "Token: T_DIFERENTE, " << tok.lexema << '\n'; break;
+    case T_MAIS: console << "Token: T_MAIS, " << tok.lexema << '\n'; break;
+    case T_MENOS: console << "Token: T_MENOS, " << tok.lexema << '\n'; break;
+    case T_MULT: console << "Token: T_MULT, " << tok.lexema << '\n'; break;
+    case T_DIV: console << "Token: T_DIV, " << tok.lexema << '\n'; break;
+    case T_MAIOR: console << "Token: T_MAIOR, " << tok.lexema << '\n'; break;
+    case T_MAIOR_IGUAL: console << "Token: T_MAIOR_IGUAL, " << tok.lexema << '\n'; break;
+    case T_MENOR: console << "Token: T_MENOR, " << tok.lexema << '\n'; break;
+    case T_MENOR_IGUAL: console << "Token: T_MENOR_IGUAL, " << tok.lexema << '\n'; break;
+    case T_OU: console << "Token: T_OU, " << tok.lexema << '\n'; break;
+    case T_E: console << "Token: T_E, " << tok.lexema << '\n'; break;
+    case T_ABRE_CHAVES: console << "Token: T_ABRE_CHAVES, " << tok.lexema << '\n'; break;
+    case T_FECHA_CHAVES: console << "Token: T_FECHA_CHAVES, " << tok.lexema << '\n'; break;
+    case T_ABRE_PARENTESES: console << "Token: T_ABRE_PARENTESES, " << tok.lexema << '\n'; break;
+    case T_FECHA_PARENTESES: console << "Token: T_FECHA_PARENTESES, " << tok.lexema << '\n'; break;
+    case T_PONTO_VIRGULA: console << "Token: T_PONTO_VIRGULA, " << tok.lexema << '\n'; break;
+    case T_VIRGULA: console << "Token: T_VIRGULA, " << tok.lexema << '\n'; break;
+    case T_EOF: console << "Token: T_EOF" << '\n'; break;
+    case T_UNKNOWN: console << "Token: T_UNKNOWN, " << tok.lexema << '\n'; break;
+    }
+}
+
+
+// Geração de bytecode e máquina virtual.
+// A árvore já verificada é traduzida para instruções de uma máquina de pilha.
+// Os tipos de todas as variáveis são conhecidos depois de Declaracao(), então
+// as inteiras ficam num vetor denso de int64 e as reais num de double, cada uma
+// com um índice no vetor do seu tipo. Cada operação é escolhida na geração pelos
+// tipos que verificarSemantica() anotou nos operandos, e a promoção de inteiro
+// para real vira uma instrução de conversão: a máquina não testa tipos.
+
+enum OpCode : unsigned char {
+    OP_CONSTANTE,                               // empilha constantes[operando]
+    OP_CARREGAR_INTEIRO, OP_CARREGAR_REAL,      // empilha a variável de índice 'operando'
+    OP_ARMAZENAR_INTEIRO, OP_ARMAZENAR_REAL,    // desempilha para a variável de índice 'operando'
+    OP_SOMA_INTEIRO, OP_SUBTRACAO_INTEIRO, OP_MULTIPLICACAO_INTEIRO, OP_DIVISAO_INTEIRO,
+    OP_SOMA_REAL, OP_SUBTRACAO_REAL, OP_MULTIPLICACAO_REAL, OP_DIVISAO_REAL,
+    OP_MAIOR_INTEIRO, OP_MAIOR_IGUAL_INTEIRO, OP_MENOR_INTEIRO, OP_MENOR_IGUAL_INTEIRO, OP_IGUAL_INTEIRO, OP_DIFERENTE_INTEIRO,
+    OP_MAIOR_REAL, OP_MAIOR_IGUAL_REAL, OP_MENOR_REAL, OP_MENOR_IGUAL_REAL, OP_IGUAL_REAL, OP_DIFERENTE_REAL,
+    OP_E, OP_OU,                                // sobre inteiros; zero é falso
+    OP_NEGACAO_INTEIRO, OP_NEGACAO_REAL,        // troca o sinal do topo
+    OP_INTEIRO_PARA_REAL,                       // converte o topo
+    OP_REAL_PARA_INTEIRO,                       // trunca o topo
+    OP_REAL_PARA_LOGICO,                        // topo real vira 1 se for diferente de zero, 0 se não
+    OP_SALTO,                                   // vai para a instrução 'operando'
+    OP_SALTO_SE_FALSO,                          // desempilha um inteiro e salta se for zero
+    OP_MOSTRAR_INTEIRO, OP_MOSTRAR_REAL,        // desempilha e escreve na saída
+    OP_LER_INTEIRO, OP_LER_REAL,                // lê da entrada para a variável de índice 'operando'
+    OP_FIM
+};
+
+struct Instrucao {
+    OpCode op;
+    uint32_t operando;
+};
+
+// Onde a variável de cada símbolo fica na execução
+struct LugarVariavel {
+    bool real;
+    uint32_t indice;  // no vetor de inteiros ou no de reais
+};
+
+struct Bytecode {
+    vector<Instrucao> codigo;
+    vector<Numero> constantes;  // já no tipo em que são usadas
+    uint32_t inteiros = 0;      // tamanho de cada vetor de variáveis
+    uint32_t reais = 0;
+    vector<LugarVariavel> lugares;  // indexado pelo símbolo
+    uint32_t pilhaAtual = 0;
+    uint32_t pilhaMaxima = 0;
+};
+
+// Quanto cada instrução altera a altura da pilha
+int efeitoNaPilha(OpCode op) {
+    switch (op) {
+    case OP_CONSTANTE: case OP_CARREGAR_INTEIRO: case OP_CARREGAR_REAL: return 1;
+    case OP_SALTO: case OP_LER_INTEIRO: case OP_LER_REAL: case OP_FIM:
+    case OP_NEGACAO_INTEIRO: case OP_NEGACAO_REAL:
+    case OP_INTEIRO_PARA_REAL: case OP_REAL_PARA_INTEIRO: case OP_REAL_PARA_LOGICO:
+        return 0;
+    default: return -1;
+    }
+}
+
+uint32_t emitir(Bytecode& bc, OpCode op, uint32_t operando = 0) {
+    bc.codigo.push_back({ op, operando });
+    bc.pilhaAtual += efeitoNaPilha(op);
+    if (bc.pilhaAtual > bc.pilhaMaxima) bc.pilhaMaxima = bc.pilhaAtual;
+    return (uint32_t)bc.codigo.size() - 1;
+}
+
+uint32_t proximaInstrucao(const Bytecode& bc) {
+    return (uint32_t)bc.codigo.size();
+}
+
+// Instrução do operador binário com os dois operandos inteiros ou, com 'reais',
+// os dois reais. '&&' e '||' só existem sobre inteiros.
+OpCode opcodeDoOperador(NodeKind kind, bool reais = false) {
+    int r = reais ? 1 : 0;
+    switch (kind) {
+    case N_MAIS: return r ? OP_SOMA_REAL : OP_SOMA_INTEIRO;
+    case N_MENOS: return r ? OP_SUBTRACAO_REAL : OP_SUBTRACAO_INTEIRO;
+    case N_MULT: return r ? OP_MULTIPLICACAO_REAL : OP_MULTIPLICACAO_INTEIRO;
+    case N_DIV: return r ? OP_DIVISAO_REAL : OP_DIVISAO_INTEIRO;
+    case N_MAIOR: return r ? OP_MAIOR_REAL : OP_MAIOR_INTEIRO;
+    case N_MAIOR_IGUAL: return r ? OP_MAIOR_IGUAL_REAL : OP_MAIOR_IGUAL_INTEIRO;
+    case N_MENOR: return r ? OP_MENOR_REAL : OP_MENOR_INTEIRO;
+    case N_MENOR_IGUAL: return r ? OP_MENOR_IGUAL_REAL : OP_MENOR_IGUAL_INTEIRO;
+    case N_IGUAL_IGUAL: return r ? OP_IGUAL_REAL : OP_IGUAL_INTEIRO;
+    case N_DIFERENTE: return r ? OP_DIFERENTE_REAL : OP_DIFERENTE_INTEIRO;
+    case N_E: return OP_E;
+    case N_OU: return OP_OU;
+    default: return OP_FIM;
+    }
+}
+
+// Tipo do valor que a expressão deixa na pilha: booleanos são inteiros 0 ou 1
+bool expressaoReal(const ArvoreNode* node) {
+    return node->semantico == TIPO_REAL;
+}
+
+// Gera a expressão e converte o resultado para real ou inteiro, se preciso
+void Compilador::gerarExpressaoComo(Bytecode& bc, ArvoreNode* node, bool real) {
+    gerarExpressao(bc, node, real ? PARA_REAL : PARA_INTEIRO);
+}
+
+// Gera a expressão como valor lógico: inteiro, com zero para falso
+void Compilador::gerarCondicao(Bytecode& bc, ArvoreNode* node) {
+    gerarExpressao(bc, node, PARA_LOGICO);
+}
+
+// Gera a expressão em pós-ordem com uma pilha explícita, então uma cadeia
+// longa como "1 + 1 + ... + 1", que vira uma árvore tão funda quanto o número
+// de termos, não depende da pilha nativa. Cada subexpressão leva a conversão
+// que o pai precisa que ela tenha ao terminar.
+void Compilador::gerarExpressao(Bytecode& bc, ArvoreNode* raiz, ConversaoExpressao conversaoRaiz) {
+    vector<SubexpressaoPendente>& pilha = pilhaGeracao;
+    pilha.clear();
+    pilha.push_back({ raiz, conversaoRaiz, false });
+
+    while (!pilha.empty()) {
+        SubexpressaoPendente& topo = pilha.back();
+        ArvoreNode* node = topo.node;
+        ConversaoExpressao conversao = topo.conversao;
+
+        if (!topo.filhosGerados && !node->children.empty()) {
+            topo.filhosGerados = true;
+            ConversaoExpressao conversaoFilhos = SEM_CONVERSAO;
+            if (node->kind == N_E || node->kind == N_OU) {
+                if (node->children.size() != 2) {
+                    error("Expressão não pode ser executada");
+                }
+                conversaoFilhos = PARA_LOGICO;
+            }
+            else if (node->kind != N_EXPRESSAO && node->kind != N_NEGACAO) {
+                if (opcodeDoOperador(node->kind) == OP_FIM || node->children.size() != 2) {
+                    error("Expressão não pode ser executada");
+                }
+                // Com um operando real, o outro é promovido e a operação é a de reais
+                bool reais = expressaoReal(node->children[0]) || expressaoReal(node->children[1]);
+                conversaoFilhos = reais ? PARA_REAL : SEM_CONVERSAO;
+            }
+            // Do último para o primeiro, para o primeiro ser gerado antes
+            for (size_t i = node->children.size(); i-- > 0;) {
+                pilha.push_back({ node->children[i], conversaoFilhos, false });
+            }
+            continue;
+        }
+        pilha.pop_back();
+
+        switch (node->kind) {
+        case N_ID: {
+            LugarVariavel lugar = bc.lugares[node->simbolo];
+            emitir(bc, lugar.real ? OP_CARREGAR_REAL : OP_CARREGAR_INTEIRO, lugar.indice);
+            break;
+        }
+        case N_INTEIRO: case N_REAL:
+            bc.constantes.push_back(node->numero);
+            // Um literal inteiro usado como real já vai convertido para as constantes
+            if (conversao == PARA_REAL && node->kind == N_INTEIRO) {
+                bc.constantes.back().real = (double)node->numero.inteiro;
+                conversao = SEM_CONVERSAO;
+            }
+            emitir(bc, OP_CONSTANTE, (uint32_t)bc.constantes.size() - 1);
+            break;
+        case N_EXPRESSAO:
+            break;
+        case N_NEGACAO:
+            emitir(bc, expressaoReal(node->children[0]) ? OP_NEGACAO_REAL : OP_NEGACAO_INTEIRO);
+            break;
+        default:
+            emitir(bc, opcodeDoOperador(node->kind, expressaoReal(node->children[0]) || expressaoReal(node->children[1])));
+            break;
+        }
+
+        bool real = expressaoReal(node);
+        if (conversao == PARA_REAL && !real) emitir(bc, OP_INTEIRO_PARA_REAL);
+        if (conversao == PARA_INTEIRO && real) emitir(bc, OP_REAL_PARA_INTEIRO);
+        if (conversao == PARA_LOGICO && real) emitir(bc, OP_REAL_PARA_LOGICO);
+    }
+}
+
+// Gera os comandos com uma pilha explícita, como printArvoreSintatica(). Um
+// comando composto fica na pilha enquanto o seu bloco é gerado; 'etapa' diz
+// em que ponto ele retoma e 'salto'/'inicio' guardam as instruções que ainda
+// precisam do endereço de destino.
+void Compilador::gerarComando(Bytecode& bc, ArvoreNode* raiz) {
+    struct ComandoPendente {
+        ArvoreNode* node;
+        uint32_t etapa;
+        uint32_t salto;
+        uint32_t inicio;
+    };
+    vector<ComandoPendente> pilha = { { raiz, 0, 0, 0 } };
+
+    while (!pilha.empty()) {
+        ComandoPendente& topo = pilha.back();
+        ArvoreNode* node = topo.node;
+
+        switch (node->kind) {
+        case N_PROGRAMA:
+            topo = { node->children[1], 0, 0, 0 };
+            break;
+
+        case N_CORPO: case N_COMANDO:
+            pilha.pop_back();
+            for (size_t i = node->children.size(); i-- > 0;) {
+                pilha.push_back({ node->children[i], 0, 0, 0 });
+            }
+            break;
+
+        case N_ATRIBUICAO: {
+            pilha.pop_back();
+            LugarVariavel lugar = bc.lugares[node->children[0]->simbolo];
+            gerarExpressaoComo(bc, node->children[1], lugar.real);
+            emitir(bc, lugar.real ? OP_ARMAZENAR_REAL : OP_ARMAZENAR_INTEIRO, lugar.indice);
+            break;
+        }
+
+        case N_MOSTRAR:
+            pilha.pop_back();
+            gerarExpressao(bc, node->children[0], SEM_CONVERSAO);
+            emitir(bc, expressaoReal(node->children[0]) ? OP_MOSTRAR_REAL : OP_MOSTRAR_INTEIRO);
+            break;
+
+        case N_LER: {
+            pilha.pop_back();
+            LugarVariavel lugar = bc.lugares[node->children[0]->simbolo];
+            emitir(bc, lugar.real ? OP_LER_REAL : OP_LER_INTEIRO, lugar.indice);
+            break;
+        }
+
+        case N_CONDICAO:
+            if (topo.etapa == 0) {
+                gerarCondicao(bc, node->children[0]);
+                topo.salto = emitir(bc, OP_SALTO_SE_FALSO);
+                topo.etapa = 1;
+                pilha.push_back({ node->children[1], 0, 0, 0 });
+            }
+            else if (topo.etapa == 1 && node->children.size() > 2) {
+                // Fim do 'entao': pula o 'senao', que começa logo depois
+                uint32_t fim = emitir(bc, OP_SALTO);
+                bc.codigo[topo.salto].operando = proximaInstrucao(bc);
+                topo.salto = fim;
+                topo.etapa = 2;
+                pilha.push_back({ node->children[2], 0, 0, 0 });
+            }
+            else {
+                bc.codigo[topo.salto].operando = proximaInstrucao(bc);
+                pilha.pop_back();
+            }
+            break;
+
+        case N_ENQUANTO:
+            if (topo.etapa == 0) {
+                topo.inicio = proximaInstrucao(bc);
+                gerarCondicao(bc, node->children[0]);
+                topo.salto = emitir(bc, OP_SALTO_SE_FALSO);
+                topo.etapa = 1;
+                pilha.push_back({ node->children[1], 0, 0, 0 });
+            }
+            else {
+                emitir(bc, OP_SALTO, topo.inicio);
+                bc.codigo[topo.salto].operando = proximaInstrucao(bc);
+                pilha.pop_back();
+            }
+            break;
+
+        case N_REPETICAO:
+            // repita ... ate condição: volta ao início enquanto a condição for falsa
+            if (topo.etapa == 0) {
+                topo.inicio = proximaInstrucao(bc);
+                topo.etapa = 1;
+                pilha.push_back({ node->children[0], 0, 0, 0 });
+            }
+            else {
+                gerarCondicao(bc, node->children[1]);
+                emitir(bc, OP_SALTO_SE_FALSO, topo.inicio);
+                pilha.pop_back();
+            }
+            break;
+
+        default:
+            pilha.pop_back();
+            break;
+        }
+    }
+}
+
+Bytecode Compilador::gerarBytecode(ArvoreNode* ast) {
+    Bytecode bc;
+
+    bc.lugares.resize(simbolos.quantidade(), { false, 0 });
+    for (uint32_t simbolo : tabelaDeSimbolos.emOrdemDeDeclaracao()) {
+        bool real = tabelaDeSimbolos.tipo(simbolo) == TIPO_REAL;
+        bc.lugares[simbolo] = { real, real ? bc.reais++ : bc.inteiros++ };
+    }
+
+    gerarComando(bc, ast);
+    emitir(bc, OP_FIM);
+    return bc;
+}
+
+void escreverInteiro(string& saida, int64_t v) {
+    char texto[32];
+    int n = snprintf(texto, sizeof(texto), "%lld", (long long)v);
+    saida.append(texto, (size_t)n);
+    saida += '\n';
+}
+
+void escreverReal(string& saida, double v) {
+    char texto[32];
+    int n = snprintf(texto, sizeof(texto), "%.15g", v);
+    saida.append(texto, (size_t)n);
+    saida += '\n';
+}
+
+mutex travaEntrada;
+
+// Aritmética inteira com volta em complemento de dois: o estouro de int64 é
+// indefinido em C++, então a conta é feita sem sinal e convertida de volta
+int64_t somaComVolta(int64_t a, int64_t b) { return (int64_t)((uint64_t)a + (uint64_t)b); }
+int64_t subtracaoComVolta(int64_t a, int64_t b) { return (int64_t)((uint64_t)a - (uint64_t)b); }
+int64_t multiplicacaoComVolta(int64_t a, int64_t b) { return (int64_t)((uint64_t)a * (uint64_t)b); }
+int64_t negacaoComVolta(int64_t a) { return (int64_t)(0 - (uint64_t)a); }
+
+// Única divisão inteira com divisor diferente de zero cujo resultado não cabe em int64
+bool divisaoEstoura(int64_t a, int64_t b) { return a == INT64_MIN && b == -1; }
+
+// Executa o bytecode. Retorna o número de instruções executadas ou -1 em erro de execução.
+// As células da pilha não guardam o tipo: cada instrução já sabe se lê int64 ou double.
+int64_t executar(const Bytecode& bc, string& saida, ostream& console, istream& entrada = cin) {
+    vector<int64_t> inteiros(bc.inteiros);
+    vector<double> reais(bc.reais);
+    vector<Numero> pilha(bc.pilhaMaxima + 1);
+    Numero* topo = pilha.data() - 1;
+    const Instrucao* codigo = bc.codigo.data();
+    uint32_t pc = 0;
+    int64_t executadas = 0;
+
+    auto descarregar = [&saida, &console]() {
+        console.write(saida.data(), (streamsize)saida.size());
+        saida.clear();
+    };
+
+// Operação binária sobre os campos 'operandos' das duas células do topo, com o
+// resultado no campo 'resultado' da de baixo
+#define OPERACAO_BINARIA(resultado, operandos, operador)                    \
+    {                                                                       \
+        Numero b = *topo--;                                                 \
+        topo->resultado = topo->operandos operador b.operandos;             \
+        break;                                                              \
+    }
+
+    for (;;) {
+        const Instrucao& in = codigo[pc++];
+        executadas++;
+
+        switch (in.op) {
+        case OP_CONSTANTE:
+            *++topo = bc.constantes[in.operando];
+            break;
+        case OP_CARREGAR_INTEIRO:
+            (++topo)->inteiro = inteiros[in.operando];
+            break;
+        case OP_CARREGAR_REAL:
+            (++topo)->real = reais[in.operando];
+            break;
+        case OP_ARMAZENAR_INTEIRO:
+            inteiros[in.operando] = (topo--)->inteiro;
+            break;
+        case OP_ARMAZENAR_REAL:
+            reais[in.operando] = (topo--)->real;
+            break;
+
+        case OP_SOMA_INTEIRO:
+            topo[-1].inteiro = somaComVolta(topo[-1].inteiro, topo->inteiro);
+            topo--;
+            break;
+        case OP_SUBTRACAO_INTEIRO:
+            topo[-1].inteiro = subtracaoComVolta(topo[-1].inteiro, topo->inteiro);
+            topo--;
+            break;
+        case OP_MULTIPLICACAO_INTEIRO:
+            topo[-1].inteiro = multiplicacaoComVolta(topo[-1].inteiro, topo->inteiro);
+            topo--;
+            break;
+        case OP_DIVISAO_INTEIRO:
+            if (topo->inteiro == 0) {
+                descarregar();
+                console << "Erro de execução: divisão por zero" << endl;
+                return -1;
+            }
+            if (divisaoEstoura(topo[-1].inteiro, topo->inteiro)) {
+                descarregar();
+                console << "Erro de execução: estouro na divisão inteira" << endl;
+                return -1;
+            }
+            OPERACAO_BINARIA(inteiro, inteiro, /)
+        case OP_SOMA_REAL: OPERACAO_BINARIA(real, real, +)
+        case OP_SUBTRACAO_REAL: OPERACAO_BINARIA(real, real, -)
+        case OP_MULTIPLICACAO_REAL: OPERACAO_BINARIA(real, real, *)
+        case OP_DIVISAO_REAL: OPERACAO_BINARIA(real, real, /)
+
+        case OP_MAIOR_INTEIRO: OPERACAO_BINARIA(inteiro, inteiro, >)
+        case OP_MAIOR_IGUAL_INTEIRO: OPERACAO_BINARIA(inteiro, inteiro, >=)
+        case OP_MENOR_INTEIRO: OPERACAO_BINARIA(inteiro, inteiro, <)
+        case OP_MENOR_IGUAL_INTEIRO: OPERACAO_BINARIA(inteiro, inteiro, <=)
+        case OP_IGUAL_INTEIRO: OPERACAO_BINARIA(inteiro, inteiro, ==)
+        case OP_DIFERENTE_INTEIRO: OPERACAO_BINARIA(inteiro, inteiro, !=)
+        case OP_MAIOR_REAL: OPERACAO_BINARIA(inteiro, real, >)
+        case OP_MAIOR_IGUAL_REAL: OPERACAO_BINARIA(inteiro, real, >=)
+        case OP_MENOR_REAL: OPERACAO_BINARIA(inteiro, real, <)
+        case OP_MENOR_IGUAL_REAL: OPERACAO_BINARIA(inteiro, real, <=)
+        case OP_IGUAL_REAL: OPERACAO_BINARIA(inteiro, real, ==)
+        case OP_DIFERENTE_REAL: OPERACAO_BINARIA(inteiro, real, !=)
+
+        case OP_E: {
+            Numero b = *topo--;
+            topo->inteiro = topo->inteiro != 0 && b.inteiro != 0;
+            break;
+        }
+        case OP_OU: {
+            Numero b = *topo--;
+            topo->inteiro = topo->inteiro != 0 || b.inteiro != 0;
+            break;
+        }
+
+        case OP_NEGACAO_INTEIRO:
+            topo->inteiro = negacaoComVolta(topo->inteiro);
+            break;
+        case OP_NEGACAO_REAL:
+            topo->real = -topo->real;
+            break;
+        case OP_INTEIRO_PARA_REAL:
+            topo->real = (double)topo->inteiro;
+            break;
+        case OP_REAL_PARA_INTEIRO:
+            topo->inteiro = (int64_t)topo->real;
+            break;
+        case OP_REAL_PARA_LOGICO:
+            topo->inteiro = topo->real != 0;
+            break;
+
+        case OP_SALTO:
+            pc = in.operando;
+            break;
+        case OP_SALTO_SE_FALSO:
+            if ((topo--)->inteiro == 0) pc = in.operando;
+            break;
+
+        case OP_MOSTRAR_INTEIRO:
+            escreverInteiro(saida, (topo--)->inteiro);
+            if (saida.size() >= (1 << 16)) descarregar();
+            break;
+        case OP_MOSTRAR_REAL:
+            escreverReal(saida, (topo--)->real);
+            if (saida.size() >= (1 << 16)) descarregar();
+            break;
+        case OP_LER_INTEIRO: case OP_LER_REAL: {
+            descarregar();
+            console.flush();
+            bool lido;
+            {
+                // A entrada padrão é compartilhada pelas compilações em paralelo
+                unique_lock<mutex> trava(travaEntrada, defer_lock);
+                if (&entrada == &cin) trava.lock();
+                lido = in.op == OP_LER_INTEIRO ? (bool)(entrada >> inteiros[in.operando]) : (bool)(entrada >> reais[in.operando]);
+            }
+            if (!lido) {
+                console << "Erro de execução: valor inválido em 'ler()'" << endl;
+                return -1;
+            }
+            break;
+        }
+
+        case OP_FIM:
+            descarregar();
+            return executadas;
+        }
+    }
+
+#undef OPERACAO_BINARIA
+}
+
+
+// ---------------------------------------------------------------------------
+// Otimização: dobramento e propagação de constantes
+// ---------------------------------------------------------------------------
+//
+// Roda depois da análise semântica. Expressões com operandos constantes viram
+// um único literal, variáveis com valor conhecido no ponto de uso são trocadas
+// pelo valor e 'se' com condição constante é substituído pelo ramo escolhido.
+// Os cálculos seguem as mesmas regras da máquina virtual, então o programa
+// otimizado imprime exatamente o mesmo que o original.
+
+// Valor com o tipo junto, usado pelo dobramento de constantes, que só conhece
+// o tipo de um resultado ao calculá-lo
+struct Valor {
+    TipoDado tipo;
+    union {
+        int64_t inteiro;
+        double real;
+    };
+};
+
+Valor valorInteiro(int64_t v) { Valor valor; valor.tipo = TIPO_INTEIRO; valor.inteiro = v; return valor; }
+Valor valorReal(double v) { Valor valor; valor.tipo = TIPO_REAL; valor.real = v; return valor; }
+
+double comoReal(const Valor& v) { return v.tipo == TIPO_INTEIRO ? (double)v.inteiro : v.real; }
+
+size_t contarNos(ArvoreNode* raiz) {
+    size_t total = 0;
+    vector<ArvoreNode*> pilha{ raiz };
+    while (!pilha.empty()) {
+        ArvoreNode* node = pilha.back();
+        pilha.pop_back();
+        total++;
+        for (ArvoreNode* child : node->children) {
+            pilha.push_back(child);
+        }
+    }
+    return total;
+}
+
+// Valor conhecido de cada variável no ponto atual, indexado pelo símbolo
+struct Constante {
+    bool conhecida = false;
+    Valor valor;
+};
+
+struct EstadoOtimizacao {
+    vector<Constante> constantes;
+    size_t eliminados = 0;
+};
+
+bool valorLiteral(const ArvoreNode* node, Valor& v) {
+    if (node->kind == N_INTEIRO) { v = valorInteiro(node->numero.inteiro); return true; }
+    if (node->kind == N_REAL) { v = valorReal(node->numero.real); return true; }
+    return false;
+}
+
+Valor converterPara(TipoDado tipo, const Valor& v) {
+    if (tipo == TIPO_INTEIRO && v.tipo == TIPO_REAL) return valorInteiro((int64_t)v.real);
+    if (tipo == TIPO_REAL && v.tipo == TIPO_INTEIRO) return valorReal((double)v.inteiro);
+    return v;
+}
+
+// Transforma o nó em literal. O texto fica na arena, junto com a árvore.
+void Compilador::tornarLiteral(ArvoreNode* node, const Valor& v) {
+    char texto[32];
+    int n = v.tipo == TIPO_INTEIRO ? snprintf(texto, sizeof(texto), "%lld", (long long)v.inteiro)
+                                   : snprintf(texto, sizeof(texto), "%.15g", v.real);
+    char* copia = (char*)arenaArvore.alocar((size_t)n, 1);
+    memcpy(copia, texto, (size_t)n);
+
+    node->kind = v.tipo == TIPO_INTEIRO ? N_INTEIRO : N_REAL;
+    if (v.tipo == TIPO_INTEIRO) node->numero.inteiro = v.inteiro;
+    else node->numero.real = v.real;
+    node->value = string_view(copia, (size_t)n);
+    node->simbolo = SEM_SIMBOLO;
+    node->semantico = v.tipo;
+    node->children = {};
+}
+
+// Calcula 'a operador b' como a máquina virtual faria. Retorna false quando o
+// resultado só pode ser decidido na execução: a divisão inteira por zero e a de
+// INT64_MIN por -1, que são erros de execução.
+bool calcularConstante(NodeKind operador, const Valor& a, const Valor& b, Valor& r) {
+    bool inteiros = a.tipo == TIPO_INTEIRO && b.tipo == TIPO_INTEIRO;
+    double x = comoReal(a), y = comoReal(b);
+    switch (operador) {
+    case N_MAIS: r = inteiros ? valorInteiro(somaComVolta(a.inteiro, b.inteiro)) : valorReal(x + y); return true;
+    case N_MENOS: r = inteiros ? valorInteiro(subtracaoComVolta(a.inteiro, b.inteiro)) : valorReal(x - y); return true;
+    case N_MULT: r = inteiros ? valorInteiro(multiplicacaoComVolta(a.inteiro, b.inteiro)) : valorReal(x * y); return true;
+    case N_DIV:
+        if (inteiros && (b.inteiro == 0 || divisaoEstoura(a.inteiro, b.inteiro))) return false;
+        r = inteiros ? valorInteiro(a.inteiro / b.inteiro) : valorReal(x / y);
+        return true;
+    case N_MAIOR: r = valorInteiro(inteiros ? a.inteiro > b.inteiro : x > y); return true;
+    case N_MAIOR_IGUAL: r = valorInteiro(inteiros ? a.inteiro >= b.inteiro : x >= y); return true;
+    case N_MENOR: r = valorInteiro(inteiros ? a.inteiro < b.inteiro : x < y); return true;
+    case N_MENOR_IGUAL: r = valorInteiro(inteiros ? a.inteiro <= b.inteiro : x <= y); return true;
+    case N_IGUAL_IGUAL: r = valorInteiro(inteiros ? a.inteiro == b.inteiro : x == y); return true;
+    case N_DIFERENTE: r = valorInteiro(inteiros ? a.inteiro != b.inteiro : x != y); return true;
+    case N_E: r = valorInteiro(x != 0 && y != 0); return true;
+    case N_OU: r = valorInteiro(x != 0 || y != 0); return true;
+    default: return false;
+    }
+}
+
+// Propaga e dobra as constantes da expressão. Retorna true se ela ficou
+// reduzida a um único literal, devolvido em 'v'. O percurso é em pós-ordem com
+// pilha explícita: cada nó deixa em 'resultados' se virou constante e o valor.
+bool Compilador::dobrarExpressao(EstadoOtimizacao& estado, ArvoreNode* raiz, Valor& v) {
+    struct Pendente {
+        ArvoreNode* node;
+        bool filhosDobrados;
+    };
+    struct Dobrado {
+        bool constante;
+        Valor valor;
+    };
+    vector<Pendente> pilha{ { raiz, false } };
+    vector<Dobrado> resultados;
+
+    while (!pilha.empty()) {
+        Pendente& topo = pilha.back();
+        ArvoreNode* node = topo.node;
+
+        if (!topo.filhosDobrados) {
+            topo.filhosDobrados = true;
+            if (node->kind == N_EXPRESSAO || node->kind == N_NEGACAO) {
+                pilha.push_back({ node->children[0], false });
+                continue;
+            }
+            // Os dois lados são dobrados mesmo que um deles não seja constante
+            if (node->kind != N_ID && node->kind != N_INTEIRO && node->kind != N_REAL && node->children.size() == 2) {
+                pilha.push_back({ node->children[1], false });
+                pilha.push_back({ node->children[0], false });
+                continue;
+            }
+        }
+        pilha.pop_back();
+
+        Dobrado r{ false, Valor() };
+        switch (node->kind) {
+        case N_ID: {
+            const Constante& c = estado.constantes[node->simbolo];
+            if (!c.conhecida) break;
+            tornarLiteral(node, c.valor);
+            r = { true, c.valor };
+            break;
+        }
+        case N_INTEIRO: case N_REAL:
+            r.constante = valorLiteral(node, r.valor);
+            break;
+        case N_EXPRESSAO:
+            r = resultados.back();
+            resultados.pop_back();
+            break;
+        case N_NEGACAO:
+            r = resultados.back();
+            resultados.pop_back();
+            if (!r.constante) break;
+            r.valor = r.valor.tipo == TIPO_INTEIRO ? valorInteiro(negacaoComVolta(r.valor.inteiro)) : valorReal(-r.valor.real);
+            estado.eliminados += contarNos(node) - 1;
+            tornarLiteral(node, r.valor);
+            break;
+        default: {
+            if (node->children.size() != 2) break;
+            Dobrado direita = resultados.back();
+            resultados.pop_back();
+            Dobrado esquerda = resultados.back();
+            resultados.pop_back();
+            if (!esquerda.constante || !direita.constante ||
+                !calcularConstante(node->kind, esquerda.valor, direita.valor, r.valor)) {
+                break;
+            }
+            r.constante = true;
+            // Os operandos já foram dobrados, mas podem estar entre parênteses
+            estado.eliminados += contarNos(node) - 1;
+            tornarLiteral(node, r.valor);
+            break;
+        }
+        }
+        resultados.push_back(r);
+    }
+
+    v = resultados.back().valor;
+    return resultados.back().constante;
+}
+
+// Variáveis atribuídas ou lidas no corpo de cada 'enquanto' e 'repita',
+// incluindo as dos laços de dentro, calculadas numa passada só: ao fim de cada
+// laço o conjunto dele, sem repetições, sobe para o laço de fora. Assim laços
+// aninhados não percorrem o mesmo corpo uma vez por nível. Só desce por
+// comandos e blocos: expressões não atribuem nada.
+using AtribuidasNosLacos = unordered_map<const ArvoreNode*, vector<uint32_t>>;
+
+AtribuidasNosLacos atribuidasNosLacos(ArvoreNode* raiz, size_t quantidadeSimbolos) {
+    AtribuidasNosLacos lacos;
+    vector<pair<ArvoreNode*, bool>> pilha{ { raiz, false } };
+    vector<vector<uint32_t>> abertos(1);  // o primeiro junta o que está fora de qualquer laço
+    vector<uint32_t> marca(quantidadeSimbolos, UINT32_MAX);
+    uint32_t proximaMarca = 0;
+
+    while (!pilha.empty()) {
+        auto [node, concluido] = pilha.back();
+        pilha.pop_back();
+        if (concluido) {
+            vector<uint32_t> atribuidas = move(abertos.back());
+            abertos.pop_back();
+            uint32_t m = proximaMarca++;
+            size_t n = 0;
+            for (uint32_t simbolo : atribuidas) {
+                if (marca[simbolo] != m) {
+                    marca[simbolo] = m;
+                    atribuidas[n++] = simbolo;
+                }
+            }
+            atribuidas.resize(n);
+            abertos.back().insert(abertos.back().end(), atribuidas.begin(), atribuidas.end());
+            lacos[node] = move(atribuidas);
+            continue;
+        }
+        if (node->kind == N_ATRIBUICAO || node->kind == N_LER) {
+            abertos.back().push_back(node->children[0]->simbolo);
+            continue;
+        }
+        if (node->kind == N_ENQUANTO || node->kind == N_REPETICAO) {
+            pilha.push_back({ node, true });
+            abertos.emplace_back();
+        }
+        for (ArvoreNode* child : node->children) {
+            if (child->kind != N_EXPRESSAO) pilha.push_back({ child, false });
+        }
+    }
+    return lacos;
+}
+
+// Esquece o valor das variáveis atribuídas ou lidas dentro de um laço
+void invalidarAtribuidas(EstadoOtimizacao& estado, const vector<uint32_t>& atribuidas) {
+    for (uint32_t simbolo : atribuidas) {
+        estado.constantes[simbolo].conhecida = false;
+    }
+}
+
+// Depois de um 'se', só continua conhecido o que vale nos dois ramos
+void juntarRamos(EstadoOtimizacao& estado, const EstadoOtimizacao& outroRamo) {
+    for (size_t i = 0; i < estado.constantes.size(); i++) {
+        Constante& c = estado.constantes[i];
+        const Constante& o = outroRamo.constantes[i];
+        if (c.conhecida && (!o.conhecida || c.valor.tipo != o.valor.tipo ||
+                            (c.valor.tipo == TIPO_INTEIRO ? c.valor.inteiro != o.valor.inteiro : c.valor.real != o.valor.real))) {
+            c.conhecida = false;
+        }
+    }
+    estado.eliminados = outroRamo.eliminados;
+}
+
+
+// Otimiza a árvore com uma pilha explícita de comandos, como gerarComando().
+// Cada comando roda sobre um dos estados em 'estados': o 'senao' de um 'se'
+// trabalha numa cópia do estado de antes do 'entao', e os dois se juntam no fim.
+//
+// Um 'se' com condição constante sai da lista em que está, e os comandos do
+// ramo escolhido entram no lugar dele. A nova lista de cada bloco é montada em
+// 'pilhaFilhos', como em NoEmConstrucao, e o ramo escolhido é percorrido como
+// continuação do bloco, escrevendo na mesma lista. No fim do bloco a lista volta
+// para o mesmo array ou, se cresceu, para um novo na arena.
+// Retorna quantos nós foram eliminados da árvore
+size_t Compilador::otimizar(ArvoreNode* ast) {
+    struct ComandoPendente {
+        ArvoreNode* node;
+        uint32_t estado;  // índice em 'estados'
+        uint32_t etapa;   // blocos: próximo filho; comandos compostos: onde retomar
+        uint32_t base;    // blocos: início da lista nova em 'pilhaFilhos'; 'se': estado do 'senao'
+        bool embutido;    // ramo escolhido de um 'se' constante, que escreve na lista do bloco de fora
+    };
+    vector<EstadoOtimizacao> estados(1);
+    estados[0].constantes.resize(simbolos.quantidade());
+    AtribuidasNosLacos lacos = atribuidasNosLacos(ast, simbolos.quantidade());
+    vector<ComandoPendente> pilha = { { ast, 0, 0, 0, false } };
+    pilhaFilhos.clear();
+    Valor v;
+
+    while (!pilha.empty()) {
+        ComandoPendente& topo = pilha.back();
+        ArvoreNode* node = topo.node;
+        uint32_t indiceEstado = topo.estado;
+        EstadoOtimizacao& estado = estados[indiceEstado];
+
+        switch (node->kind) {
+        case N_PROGRAMA:
+            topo = { node->children[1], indiceEstado, 0, 0, false };
+            break;
+
+        case N_CORPO: case N_COMANDO: {
+            ListaFilhos& filhos = node->children;
+            if (topo.etapa == 0 && !topo.embutido) {
+                topo.base = (uint32_t)pilhaFilhos.size();
+            }
+            if (topo.etapa == filhos.tamanho) {
+                if (!topo.embutido) {
+                    size_t n = pilhaFilhos.size() - topo.base;
+                    if (n > filhos.tamanho) {
+                        filhos.dados = arenaArvore.alocarArray<ArvoreNode*>(n);
+                    }
+                    if (n > 0) {
+                        memcpy(filhos.dados, pilhaFilhos.data() + topo.base, n * sizeof(ArvoreNode*));
+                    }
+                    filhos.tamanho = (uint32_t)n;
+                    pilhaFilhos.resize(topo.base);
+                }
+                pilha.pop_back();
+                break;
+            }
+
+            ArvoreNode* child = filhos[topo.etapa++];
+            if (child->kind != N_CONDICAO) {
+                pilhaFilhos.push_back(child);
+                pilha.push_back({ child, indiceEstado, 0, 0, false });
+                break;
+            }
+
+            // Se a condição for constante, o 'se' sai da árvore com a condição
+            // inteira, então o que a dobra dela contar é descartado
+            size_t antes = estado.eliminados;
+            size_t nosCondicao = contarNos(child->children[0]);
+            Valor condicao;
+            if (!dobrarExpressao(estado, child->children[0], condicao)) {
+                pilhaFilhos.push_back(child);
+                pilha.push_back({ child, indiceEstado, 0, 0, false });
+                break;
+            }
+
+            bool entao = comoReal(condicao) != 0;
+            ArvoreNode* escolhido = entao ? child->children[1] : child->children.size() > 2 ? child->children[2] : nullptr;
+            ArvoreNode* descartado = entao && child->children.size() > 2 ? child->children[2] : entao ? nullptr : child->children[1];
+            // O 'se', a condição, o ramo descartado e o Comando do escolhido, cujos filhos sobem para o bloco
+            estado.eliminados = antes + 1 + nosCondicao + (descartado ? contarNos(descartado) : 0) + (escolhido ? 1 : 0);
+            if (escolhido) {
+                pilha.push_back({ escolhido, indiceEstado, 0, 0, true });
+            }
+            break;
+        }
+
+        case N_ATRIBUICAO: {
+            pilha.pop_back();
+            Constante& destino = estado.constantes[node->children[0]->simbolo];
+            destino.conhecida = dobrarExpressao(estado, node->children[1], v);
+            if (destino.conhecida) {
+                destino.valor = converterPara(tabelaDeSimbolos.tipo(node->children[0]->simbolo), v);
+            }
+            break;
+        }
+
+        case N_LER:
+            pilha.pop_back();
+            estado.constantes[node->children[0]->simbolo].conhecida = false;
+            break;
+
+        case N_MOSTRAR:
+            pilha.pop_back();
+            dobrarExpressao(estado, node->children[0], v);
+            break;
+
+        case N_CONDICAO:
+            // Só chegam aqui os 'se' de condição não constante, já dobrada pelo bloco
+            if (topo.etapa == 0) {
+                topo.etapa = 1;
+                topo.base = (uint32_t)estados.size();
+                estados.push_back(estado);
+                pilha.push_back({ node->children[1], indiceEstado, 0, 0, false });
+            }
+            else if (topo.etapa == 1 && node->children.size() > 2) {
+                topo.etapa = 2;
+                estados[topo.base].eliminados = estado.eliminados;
+                pilha.push_back({ node->children[2], topo.base, 0, 0, false });
+            }
+            else {
+                EstadoOtimizacao& senao = estados[topo.base];
+                if (topo.etapa == 1) senao.eliminados = estado.eliminados;
+                juntarRamos(estado, senao);
+                estados.pop_back();
+                pilha.pop_back();
+            }
+            break;
+
+        case N_ENQUANTO:
+            // O que o corpo atribui não é conhecido no teste nem na saída do laço
+            invalidarAtribuidas(estado, lacos[node]);
+            if (topo.etapa == 0) {
+                topo.etapa = 1;
+                dobrarExpressao(estado, node->children[0], v);
+                pilha.push_back({ node->children[1], indiceEstado, 0, 0, false });
+            }
+            else {
+                pilha.pop_back();
+            }
+            break;
+
+        case N_REPETICAO:
+            // O corpo roda antes do teste, e a saída acontece logo depois dele
+            if (topo.etapa == 0) {
+                topo.etapa = 1;
+                invalidarAtribuidas(estado, lacos[node]);
+                pilha.push_back({ node->children[0], indiceEstado, 0, 0, false });
+            }
+            else {
+                dobrarExpressao(estado, node->children[1], v);
+                pilha.pop_back();
+            }
+            break;
+
+        default:
+            pilha.pop_back();
+            break;
+        }
+    }
+    return estados[0].eliminados;
+}
+
+
+// ---------------------------------------------------------------------------
+// Tradução para C
+// ---------------------------------------------------------------------------
+//
+// Gera uma unidade de tradução C independente a partir da árvore: cada
+// declaração vira uma variável local tipada (inteiro -> long long, real ->
+// double), 'enquanto'/'repita' viram laços nativos e 'ler'/'mostrar' usam
+// stdio com buffer. O programa gerado imprime o mesmo que a máquina virtual,
+// inclusive as mensagens de erro de execução. A aritmética inteira passa por
+// somar/subtrair/multiplicar/negar, que calculam em unsigned long long e dão
+// a mesma volta em complemento de dois da máquina, sem o estouro com sinal
+// que em C é comportamento indefinido.
+
+const char* const prologoC =
+    "#include <stdio.h>\n"
+    "#include <stdlib.h>\n"
+    "#include <limits.h>\n"
+    "#include <math.h>\n"
+    "\n"
+    "static inline long long somar(long long a, long long b) {\n"
+    "    return (long long)((unsigned long long)a + (unsigned long long)b);\n"
+    "}\n"
+    "\n"
+    "static inline long long subtrair(long long a, long long b) {\n"
+    "    return (long long)((unsigned long long)a - (unsigned long long)b);\n"
+    "}\n"
+    "\n"
+    "static inline long long multiplicar(long long a, long long b) {\n"
+    "    return (long long)((unsigned long long)a * (unsigned long long)b);\n"
+    "}\n"
+    "\n"
+    "static inline long long negar(long long a) {\n"
+    "    return (long long)(0ULL - (unsigned long long)a);\n"
+    "}\n"
+    "\n"
+    "static inline long long dividir(long long a, long long b) {\n"
+    "    if (b == 0) {\n"
+    "        printf(\"Erro de execução: divisão por zero\\n\");\n"
+    "        exit(1);\n"
+    "    }\n"
+    "    if (a == LLONG_MIN && b == -1) {\n"
+    "        printf(\"Erro de execução: estouro na divisão inteira\\n\");\n"
+    "        exit(1);\n"
+    "    }\n"
+    "    return a / b;\n"
+    "}\n"
+    "\n"
+    "static inline void lerInteiro(long long* v) {\n"
+    "    fflush(stdout);\n"
+    "    if (scanf(\"%lld\", v) != 1) {\n"
+    "        printf(\"Erro de execução: valor inválido em 'ler()'\\n\");\n"
+    "        exit(1);\n"
+    "    }\n"
+    "}\n"
+    "\n"
+    "static inline void lerReal(double* v) {\n"
+    "    fflush(stdout);\n"
+    "    if (scanf(\"%lf\", v) != 1) {\n"
+    "        printf(\"Erro de execução: valor inválido em 'ler()'\\n\");\n"
+    "        exit(1);\n"
+    "    }\n"
+    "}\n"
+    "\n"
+    "int main(void) {\n"
+    "    static char buffer[1 << 16];\n"
+    "    setvbuf(stdout, buffer, _IOFBF, sizeof(buffer));\n";
+
+// Tipo C do valor da expressão, a partir do tipo anotado na análise.
+// Relacionais e lógicas dão inteiro (0 ou 1), como na máquina virtual.
+TipoDado Compilador::tipoExpressaoC(ArvoreNode* node) {
+    return node->semantico == TIPO_REAL ? TIPO_REAL : TIPO_INTEIRO;
+}
+
+// Traduz a expressão com uma pilha explícita de termos, como em
+// printExpressaoSemantica(): cada operador empilha, do fim para o começo, o
+// texto que fecha, o operando da direita, o texto do meio, o da esquerda e o
+// texto que abre.
+void Compilador::gerarExpressaoC(string& c, ArvoreNode* raiz) {
+    vector<TermoExpressao>& pilha = pilhaTraducao;
+    pilha.clear();
+    pilha.push_back({ raiz, nullptr, false });
+    char texto[40];
+
+    auto empilharTexto = [&pilha](const char* t) { pilha.push_back({ nullptr, t, true }); };
+    auto empilharNo = [&pilha](ArvoreNode* node) { pilha.push_back({ node, nullptr, false }); };
+
+    while (!pilha.empty()) {
+        TermoExpressao termo = pilha.back();
+        pilha.pop_back();
+        if (termo.texto) {
+            c += termo.parentese;
+            continue;
+        }
+
+        ArvoreNode* node = termo.node;
+        switch (node->kind) {
+        case N_ID:
+            c += "v_";
+            c += simbolos.nome(node->simbolo);
+            break;
+        case N_INTEIRO:
+            // Em C, "-9223372036854775808LL" é o '-' aplicado a um literal que não cabe em long long
+            if (node->numero.inteiro == INT64_MIN) {
+                c += "(-9223372036854775807LL - 1)";
+                break;
+            }
+            snprintf(texto, sizeof(texto), "%lldLL", (long long)node->numero.inteiro);
+            c += texto;
+            break;
+        case N_REAL:
+            // Infinito e NaN só aparecem dobrando constantes e não têm literal em C
+            if (isnan(node->numero.real)) {
+                c += signbit(node->numero.real) ? "(-NAN)" : "NAN";
+                break;
+            }
+            if (isinf(node->numero.real)) {
+                c += node->numero.real > 0 ? "INFINITY" : "(-INFINITY)";
+                break;
+            }
+            // %.17g preserva o valor exato; o ".0" garante um literal double
+            snprintf(texto, sizeof(texto), "%.17g", node->numero.real);
+            c += texto;
+            if (!strpbrk(texto, ".e")) c += ".0";
+            break;
+        case N_EXPRESSAO:
+            empilharNo(node->children[0]);
+            break;
+        case N_NEGACAO:
+            if (tipoExpressaoC(node->children[0]) == TIPO_INTEIRO) {
+                empilharTexto(")");
+                empilharNo(node->children[0]);
+                c += "negar(";
+                break;
+            }
+            // "-(" evita que '-' e um literal negativo formem '--'
+            empilharTexto("))");
+            empilharNo(node->children[0]);
+            c += "(-(";
+            break;
+        default: {
+            if (node->children.size() != 2 || opcodeDoOperador(node->kind) == OP_FIM) {
+                error("Expressão não pode ser traduzida para C");
+            }
+
+            ArvoreNode* esquerda = node->children[0];
+            ArvoreNode* direita = node->children[1];
+            NodeKind operador = node->kind;
+            bool inteiros = tipoExpressaoC(esquerda) == TIPO_INTEIRO && tipoExpressaoC(direita) == TIPO_INTEIRO;
+
+            const char* funcaoInteira = nullptr;
+            if (inteiros) {
+                switch (operador) {
+                case N_MAIS: funcaoInteira = "somar("; break;
+                case N_MENOS: funcaoInteira = "subtrair("; break;
+                case N_MULT: funcaoInteira = "multiplicar("; break;
+                case N_DIV: funcaoInteira = "dividir("; break;
+                default: break;
+                }
+            }
+
+            if (funcaoInteira) {
+                c += funcaoInteira;
+                empilharTexto(")");
+                empilharNo(direita);
+                empilharTexto(", ");
+            }
+            else if (operador == N_E || operador == N_OU) {
+                // A máquina avalia os dois lados, então não há curto-circuito
+                c += "(long long)((";
+                empilharTexto(") != 0)");
+                empilharNo(direita);
+                empilharTexto(operador == N_E ? ") != 0 & (" : ") != 0 | (");
+            }
+            else {
+                // Relacionais em C dão int; o cast mantém tudo em long long
+                bool aritmetico = operador == N_MAIS || operador == N_MENOS || operador == N_MULT || operador == N_DIV;
+                c += aritmetico ? "(" : "(long long)(";
+                empilharTexto(")");
+                empilharNo(direita);
+                empilharTexto(" ");
+                empilharTexto(textoNodeKind[operador]);
+                empilharTexto(" ");
+            }
+            empilharNo(esquerda);
+            break;
+        }
+        }
+    }
+}
+
+// Traduz os comandos com uma pilha explícita, como gerarComando(). O recuo é
+// de quatro espaços por nível até PROFUNDIDADE_MAXIMA_RECUO, para o arquivo
+// não crescer com o quadrado da profundidade.
+void Compilador::gerarComandoC(string& c, ArvoreNode* raiz, int nivelRaiz) {
+    struct ComandoPendente {
+        ArvoreNode* node;
+        int nivel;
+        uint32_t etapa;
+    };
+    vector<ComandoPendente> pilha = { { raiz, nivelRaiz, 0 } };
+    auto recuar = [&c](int nivel) { c.append((size_t)min(nivel, PROFUNDIDADE_MAXIMA_RECUO) * 4, ' '); };
+
+    while (!pilha.empty()) {
+        ComandoPendente& topo = pilha.back();
+        ArvoreNode* node = topo.node;
+        int nivel = topo.nivel;
+        uint32_t etapa = topo.etapa++;
+
+        switch (node->kind) {
+        case N_PROGRAMA:
+            topo = { node->children[1], nivel, 0 };
+            break;
+
+        case N_CORPO: case N_COMANDO:
+            pilha.pop_back();
+            for (size_t i = node->children.size(); i-- > 0;) {
+                pilha.push_back({ node->children[i], nivel, 0 });
+            }
+            break;
+
+        case N_ATRIBUICAO:
+            pilha.pop_back();
+            recuar(nivel);
+            c += "v_";
+            c += simbolos.nome(node->children[0]->simbolo);
+            c += " = ";
+            gerarExpressaoC(c, node->children[1]);
+            c += ";\n";
+            break;
+
+        case N_MOSTRAR:
+            pilha.pop_back();
+            recuar(nivel);
+            c += tipoExpressaoC(node->children[0]) == TIPO_INTEIRO ? "printf(\"%lld\\n\", " : "printf(\"%.15g\\n\", ";
+            gerarExpressaoC(c, node->children[0]);
+            c += ");\n";
+            break;
+
+        case N_LER:
+            pilha.pop_back();
+            recuar(nivel);
+            c += tabelaDeSimbolos.tipo(node->children[0]->simbolo) == TIPO_INTEIRO ? "lerInteiro(&v_" : "lerReal(&v_";
+            c += simbolos.nome(node->children[0]->simbolo);
+            c += ");\n";
+            break;
+
+        case N_CONDICAO:
+            if (etapa == 0) {
+                recuar(nivel);
+                c += "if (";
+                gerarExpressaoC(c, node->children[0]);
+                c += ") {\n";
+                pilha.push_back({ node->children[1], nivel + 1, 0 });
+            }
+            else if (etapa == 1 && node->children.size() > 2) {
+                recuar(nivel);
+                c += "} else {\n";
+                pilha.push_back({ node->children[2], nivel + 1, 0 });
+            }
+            else {
+                recuar(nivel);
+                c += "}\n";
+                pilha.pop_back();
+            }
+            break;
+
+        case N_ENQUANTO:
+            if (etapa == 0) {
+                recuar(nivel);
+                c += "while (";
+                gerarExpressaoC(c, node->children[0]);
+                c += ") {\n";
+                pilha.push_back({ node->children[1], nivel + 1, 0 });
+            }
+            else {
+                recuar(nivel);
+                c += "}\n";
+                pilha.pop_back();
+            }
+            break;
+
+        case N_REPETICAO:
+            if (etapa == 0) {
+                recuar(nivel);
+                c += "do {\n";
+                pilha.push_back({ node->children[0], nivel + 1, 0 });
+            }
+            else {
+                recuar(nivel);
+                c += "} while (!(";
+                gerarExpressaoC(c, node->children[1]);
+                c += "));\n";
+                pilha.pop_back();
+            }
+            break;
+
+        default:
+            pilha.pop_back();
+            break;
+        }
+    }
+}
+
+string Compilador::gerarC(ArvoreNode* ast) {
+    string c = prologoC;
+    for (uint32_t simbolo : tabelaDeSimbolos.emOrdemDeDeclaracao()) {
+        c += tabelaDeSimbolos.tipo(simbolo) == TIPO_REAL ? "    double v_" : "    long long v_";
+        c += simbolos.nome(simbolo);
+        c += " = 0;\n";
+    }
+    c += "\n";
+    gerarComandoC(c, ast, 1);
+    c += "\n    fflush(stdout);\n    return 0;\n}\n";
+    return c;
+}
+
+
+// Programa que gerou 'teste 1.txt'; o corpo é repetido para montar entradas grandes
+const char* const teste1Declaracoes =
+    "inteiro a, b, c;\n"
+    "real comprimento, altura;\n";
+
+const char* const teste1Corpo =
+    "a = -5;\n"
+    "b = 10;\n"
+    "se a < b entao {\n    mostrar(a);\n} senao {\n    mostrar(b);\n}\n"
+    "se a < b entao {\n    mostrar(a);\n}\n"
+    "enquanto (a < 10) {\n    a = a + 1;\n    mostrar(a);\n}\n"
+    "repita {\n    a = a - 1;\n    mostrar(a);\n} ate a == 5;\n";
+
+// Os benchmarks de cada fase e a suíte abaixo só existem no executável
+// compiladores_bench, que os escolhe pelo primeiro argumento (veja main())
+#ifdef COMPILADORES_BENCH
+// 'teste 1' com o corpo repetido 'repeticoes' vezes
+string programaTeste1(int repeticoes) {
+    string fonte = teste1Declaracoes;
+    fonte.reserve(fonte.size() + strlen(teste1Corpo) * max(repeticoes, 0));
+    for (int i = 0; i < repeticoes; i++) {
+        fonte += teste1Corpo;
+    }
+    return fonte;
+}
+
+// 'teste 1' com o corpo repetido até a fonte ter pelo menos 'tamanho' bytes
+string programaTeste1DeTamanho(size_t tamanho) {
+    string fonte;
+    fonte.reserve(tamanho + strlen(teste1Corpo));
+    fonte = teste1Declaracoes;
+    while (fonte.size() < tamanho) {
+        fonte += teste1Corpo;
+    }
+    return fonte;
+}
+
+// Menor tempo, em segundos, de 'passadas' execuções de 'fase'. 'preparar' roda
+// antes de cada uma, fora da medida.
+template <typename Preparar, typename Fase>
+double melhorDe(int passadas, Preparar&& preparar, Fase&& fase) {
+    double melhor = 1e30;
+    for (int passada = 0; passada < passadas; passada++) {
+        preparar();
+        auto inicio = chrono::steady_clock::now();
+        fase();
+        melhor = min(melhor, chrono::duration<double>(chrono::steady_clock::now() - inicio).count());
+    }
+    return melhor;
+}
+
+template <typename Fase>
+double melhorDe(int passadas, Fase&& fase) {
+    return melhorDe(passadas, []() {}, fase);
+}
+
+// Mede quantas alocações a análise léxica e a sintática fazem sobre 'teste 1' repetido
+int benchAlocacoes(int repeticoes) {
+    string fonte = programaTeste1(repeticoes);
+    Compilador c;
+    c.opcoes.rastro = RASTRO_NENHUM;
+
+    // Análise léxica isolada
+    c.input = fonte;
+    c.posicao = 0;
+    size_t tokens = 0;
+    size_t antes = totalAlocacoes;
+    auto inicio = chrono::steady_clock::now();
+    while (c.proximoToken().token != T_EOF) tokens++;
+    double tempoLexico = chrono::duration<double>(chrono::steady_clock::now() - inicio).count();
+    size_t alocacoesLexico = totalAlocacoes - antes;
+
+    // Análise léxica + sintática
+    antes = totalAlocacoes;
+    inicio = chrono::steady_clock::now();
+    ArvoreNode* ast = c.analisar(fonte);
+    double tempoSintatico = chrono::duration<double>(chrono::steady_clock::now() - inicio).count();
+    size_t alocacoesSintatico = totalAlocacoes - antes;
+    size_t nos = contarNos(ast);
+
+    cout << "Entrada: 'teste 1' x " << repeticoes << " (" << fonte.size() << " bytes, " << tokens << " tokens)" << endl;
+    cout << "Lexico:    " << alocacoesLexico << " alocacoes (" << (double)alocacoesLexico / tokens << " por token), "
+         << tempoLexico * 1000 << " ms" << endl;
+    cout << "Sintatico: " << alocacoesSintatico << " alocacoes (" << (double)alocacoesSintatico / tokens << " por token, "
+         << (double)alocacoesSintatico / nos << " por no, " << nos << " nos), " << tempoSintatico * 1000 << " ms" << endl;
+    cout << "Arvore:    " << c.arenaArvore.pico() << " bytes na arena (" << (double)c.arenaArvore.pico() / nos << " por no)" << endl;
+
+    return 0;
+}
+
+
+// Custo do rastro por token em cada nível. 'direto' chama proximoToken() sem
+// passar por getNextToken(), então 'nenhum' deve custar o mesmo que ele.
+int benchRastro(int repeticoes) {
+    string fonte = programaTeste1(repeticoes);
+
+    ostringstream descarte;
+    Compilador c(OpcoesCompilacao(), descarte);
+    c.input = fonte;
+
+    auto medir = [&](const char* nome, NivelRastro nivel, bool direto) {
+        c.opcoes.rastro = nivel;
+        size_t tokens = 0;
+        auto preparar = [&]() {
+            c.posicao = 0;
+            c.simbolos.limpar();
+            descarte.str("");
+            tokens = 0;
+        };
+        double melhor = melhorDe(5, preparar, [&]() {
+            if (direto) {
+                while (c.proximoToken().token != T_EOF) tokens++;
+            }
+            else {
+                while (c.getNextToken().token != T_EOF) tokens++;
+            }
+        });
+        cout << "  " << nome << ": " << melhor * 1e9 / tokens << " ns/token" << endl;
+    };
+
+    cout << "Entrada: 'teste 1' x " << repeticoes << " (" << fonte.size() << " bytes), RASTRO_MAXIMO = " << (int)RASTRO_MAXIMO << endl;
+    medir("direto ", RASTRO_NENHUM, true);
+    medir("nenhum ", RASTRO_NENHUM, false);
+    medir("erros  ", RASTRO_ERROS, false);
+    medir("tokens ", RASTRO_TOKENS, false);
+    return 0;
+}
+
+// Custo da coleta do relatório de fases: Programa() com e sem a coleta
+int benchRelatorio(int repeticoes) {
+    string fonte = programaTeste1(repeticoes);
+
+    Compilador c;
+    c.opcoes.rastro = RASTRO_NENHUM;
+    auto medir = [&](FormatoRelatorio relatorio) {
+        c.opcoes.relatorio = relatorio;
+        c.arenaArvore.liberar();
+        Relogio::time_point inicio = Relogio::now();
+        c.analisar(fonte);
+        return chrono::duration<double>(Relogio::now() - inicio).count();
+    };
+
+    // Passadas intercaladas, para que ruído da máquina afete as duas igualmente
+    double sem = 1e30, com = 1e30;
+    for (int passada = 0; passada < 15; passada++) {
+        sem = min(sem, medir(RELATORIO_NENHUM));
+        com = min(com, medir(RELATORIO_TABELA));
+    }
+    cout << "Entrada: 'teste 1' x " << repeticoes << " (" << fonte.size() << " bytes)" << endl;
+    cout << "Programa() sem coleta: " << sem * 1000 << " ms" << endl;
+    cout << "Programa() com coleta: " << com * 1000 << " ms (" << (com / sem - 1) * 100 << "% a mais)" << endl;
+    return 0;
+}
+
+// Uma atribuição com 'termos' operandos, alternando precedências e parênteses,
+// para conferir que o tempo de Expressao() cresce linearmente
+int benchExpressoes(int termos) {
+    ostringstream descarte;
+    OpcoesCompilacao opcoes;
+    opcoes.rastro = RASTRO_NENHUM;
+    const char* const operadores[] = { " + ", " * ", " - ", " / " };
+
+    for (int n = max(1, termos / 100); n <= termos; n *= 10) {
+        string fonte = "inteiro a, b;\nb = 1;\na = a";
+        for (int i = 1; i < n; i++) {
+            fonte += operadores[i % 4];
+            fonte += i % 7 == 0 ? "(b - a)" : i % 5 == 0 ? "-b" : "b";
+        }
+        fonte += ";\n";
+
+        Compilador c(opcoes, descarte);
+        double melhor = melhorDe(5, [&]() { c.arenaArvore.liberar(); }, [&]() { c.analisar(fonte); });
+        cout << "  " << n << " termos (" << fonte.size() << " bytes): " << melhor * 1000 << " ms, "
+             << melhor * 1e9 / n << " ns/termo" << endl;
+    }
+
+    // Compilação completa, com os artefatos padrão, de uma cadeia com um nível
+    // da árvore por termo: os arquivos têm que crescer linearmente
+    string fonte = "inteiro a;\na = 1";
+    for (int i = 1; i < termos; i++) {
+        fonte += " + 1";
+    }
+    fonte += ";\nmostrar(a);\n";
+
+    vector<pair<string, string>> arquivos;
+    Compilador c(opcoes, descarte);
+    c.arquivosEmMemoria = &arquivos;
+    auto inicio = chrono::steady_clock::now();
+    bool sucesso = c.compilar(fonte, "").sucesso;
+    double tempo = chrono::duration<double>(chrono::steady_clock::now() - inicio).count();
+
+    size_t total = 0;
+    for (const auto& arquivo : arquivos) {
+        total += arquivo.second.size();
+    }
+    // Cada termo dá dois nós, e cada linha tem no máximo o recuo limitado,
+    // o nível e o nome do nó
+    bool linear = total <= (size_t)termos * 4 * (2 * PROFUNDIDADE_MAXIMA_RECUO + 48);
+    cout << "  Artefatos padrão com " << termos << " termos: " << total << " bytes em " << tempo * 1000 << " ms "
+         << (sucesso && linear ? "ok" : "FALHOU") << endl;
+    return sucesso && linear ? 0 : 1;
+}
+
+// Verificação semântica de 'teste 1' repetido com uma thread e com uma por
+// núcleo, e o erro relatado nos dois modos quando a última repetição usa uma
+// variável não declarada
+int benchSemantica(int repeticoes) {
+    ostringstream descarte;
+    OpcoesCompilacao opcoes;
+    opcoes.rastro = RASTRO_NENHUM;
+    // Ao menos 4, para a divisão em faixas ser exercitada mesmo com um núcleo
+    unsigned nucleos = max(4u, thread::hardware_concurrency());
+
+    string fonte = programaTeste1(repeticoes);
+
+    Compilador c(opcoes, descarte);
+    ArvoreNode* ast = c.analisar(fonte);
+    size_t comandos = ast->children[1]->children[0]->children.size();
+    auto melhorCom = [&](unsigned threads) {
+        c.opcoes.threadsAnalise = threads;
+        return melhorDe(5, [&]() { c.verificarSemantica(ast); });
+    };
+    double sequencial = melhorCom(1);
+    double paralela = melhorCom(nucleos);
+    cout << "  " << comandos << " comandos: 1 thread " << sequencial * 1000 << " ms, " << nucleos << " threads "
+         << paralela * 1000 << " ms (" << sequencial / paralela << "x)" << endl;
+
+    fonte += "a = naodeclarada + 1;\n";
+    string erros[2];
+    for (int modo = 0; modo < 2; modo++) {
+        Compilador comErro(opcoes, descarte);
+        comErro.opcoes.threadsAnalise = modo == 0 ? 1 : nucleos;
+        try {
+            comErro.analisar(fonte);
+        }
+        catch (const ErroCompilacao& e) {
+            erros[modo] = e.mensagem + " na posição " + to_string(e.posicao);
+        }
+    }
+    bool iguais = !erros[0].empty() && erros[0] == erros[1];
+    cout << "  erro: " << erros[0] << (iguais ? "" : "  DIFERENTE COM " + to_string(nucleos) + " THREADS: " + erros[1]) << endl;
+    return iguais ? 0 : 1;
+}
+
+string lerArquivo(const string& caminho) {
+    ifstream arquivo(caminho, ios::binary);
+    stringstream conteudo;
+    conteudo << arquivo.rdbuf();
+    return conteudo.str();
+}
+
+// Compilação de 'teste 1' repetido sem cache, com uma falta (analisa e grava a
+// entrada) e com um acerto, e se os artefatos e o código C do acerto são os
+// mesmos da compilação sem cache
+int benchCache(int repeticoes) {
+    string fonte = programaTeste1(repeticoes);
+
+    filesystem::path base = filesystem::temp_directory_path() / ("bench-cache-" + to_string(Relogio::now().time_since_epoch().count()));
+    string diretorioCache = (base / "cache").string();
+    string saidas[2] = { (base / "sem-cache").string(), (base / "acerto").string() };
+    filesystem::create_directories(saidas[0]);
+    filesystem::create_directories(saidas[1]);
+
+    ostringstream descarte;
+    OpcoesCompilacao opcoes;
+    opcoes.rastro = RASTRO_NENHUM;
+    opcoes.gerarC = true;
+    auto compilarEm = [&](int passadas, bool limparCache, const string& diretorio) {
+        optional<Compilador> c;
+        auto preparar = [&]() {
+            error_code erro;
+            if (limparCache) filesystem::remove_all(diretorioCache, erro);
+            c.emplace(opcoes, descarte);
+        };
+        return melhorDe(passadas, preparar, [&]() { c->compilar(fonte, diretorio); });
+    };
+
+    double semCache = compilarEm(3, false, saidas[0]);
+    opcoes.diretorioCache = diretorioCache;
+    double falta = compilarEm(3, true, saidas[1]);
+    double acerto = compilarEm(5, false, saidas[1]);
+
+    uint64_t tamanhoEntrada = 0;
+    error_code erro;
+    for (const auto& entrada : filesystem::directory_iterator(diretorioCache, erro)) {
+        if (entrada.path().extension() == ".cmp") tamanhoEntrada += entrada.file_size(erro);
+    }
+
+    bool iguais = true;
+    for (const char* nome : { "arvore_sintatica.txt", "arvore_semantica.txt", "arvore_de_simbolos.txt", "programa.c" }) {
+        iguais = iguais && lerArquivo(saidas[0] + "/" + nome) == lerArquivo(saidas[1] + "/" + nome);
+    }
+    filesystem::remove_all(base, erro);
+
+    char linha[200];
+    snprintf(linha, sizeof(linha), "  %zu bytes: sem cache %.2f ms, falta %.2f ms, acerto %.2f ms (%.1fx); entrada de %llu bytes%s",
+             fonte.size(), semCache * 1000, falta * 1000, acerto * 1000, semCache / acerto,
+             (unsigned long long)tamanhoEntrada, iguais ? "" : "  SAÍDAS DIFERENTES");
+    cout << linha << endl;
+    return iguais ? 0 : 1;
+}
+
+// Análise léxica isolada com cada núcleo de varredura, em fontes de 'tamanho'
+// bytes com muito espaço em branco, com identificadores longos e no formato de
+// 'teste 1'. Os tokens de cada núcleo são conferidos com os do escalar.
+int benchVarredura(size_t tamanho) {
+    string espacos, identificadores, misto = programaTeste1DeTamanho(tamanho);
+    for (int i = 0; espacos.size() < tamanho; i++) {
+        string indentacao((size_t)(i % 32) * 4, ' ');
+        espacos += indentacao + "a = a + 1;\n" + indentacao + "\n\t\t\n";
+    }
+    const char* const partes[] = { "comprimento", "altura", "largura", "profundidade", "volume", "total" };
+    for (int i = 0; identificadores.size() < tamanho; i++) {
+        string nome = string(partes[i % 6]) + partes[(i / 6) % 6] + partes[(i / 36) % 6];
+        identificadores += nome + " = " + nome + " * alturaMaximaPermitida + " + to_string(i) + ";\n";
+    }
+
+    int falhas = 0;
+    for (const auto& [nome, fonte] : { pair<const char*, const string&>{ "espaços", espacos }, { "identificadores", identificadores }, { "teste 1", misto } }) {
+        cout << "  " << nome << " (" << fonte.size() << " bytes)" << endl;
+        uint64_t esperado = 0;
+        double tempoEscalar = 0;
+        for (const NucleoVarredura& n : nucleosVarredura) {
+            if (nucleoVarredura(n.nome) != &n) continue;
+            varredura = &n;
+            Compilador c;
+            c.opcoes.rastro = RASTRO_NENHUM;
+            uint64_t assinatura = 0;
+            auto preparar = [&]() {
+                c.input = fonte;
+                c.posicao = 0;
+                c.simbolos.limpar();
+                assinatura = 0;
+            };
+            double melhor = melhorDe(5, preparar, [&]() {
+                for (TokenValue tok = c.proximoToken(); tok.token != T_EOF; tok = c.proximoToken()) {
+                    assinatura = (assinatura ^ (uint64_t)tok.token ^ ((uint64_t)(tok.lexema.data() - fonte.data()) << 8) ^ ((uint64_t)tok.lexema.size() << 40)) * 0x100000001B3ull;
+                }
+            });
+            if (&n == &nucleosVarredura[0]) {
+                esperado = assinatura;
+                tempoEscalar = melhor;
+            }
+            bool igual = assinatura == esperado;
+            if (!igual) falhas++;
+            char linha[160];
+            snprintf(linha, sizeof(linha), "    %-8s %8.2f ms %8.1f MB/s  (%.2fx)%s", n.nome, melhor * 1000,
+                     fonte.size() / melhor / 1e6, tempoEscalar / melhor, igual ? "" : "  TOKENS DIFERENTES");
+            cout << linha << endl;
+        }
+    }
+    varredura = nucleoVarredura("escalar");
+    return falhas > 0 ? 1 : 0;
+}
+
+// Análise léxica isolada de 'teste 1' repetido até 'tamanho' bytes, lida em
+// sequência e por LexicoParalelo com 2, 4 e 8 threads. Os tokens, posições e
+// números de identificador são conferidos com os da leitura sequencial.
+int benchLexica(size_t tamanho) {
+    string fonte = programaTeste1DeTamanho(tamanho);
+    cout << "  'teste 1' (" << fonte.size() << " bytes), " << thread::hardware_concurrency() << " núcleos" << endl;
+
+    int falhas = 0;
+    uint64_t esperado = 0;
+    double tempoSequencial = 0;
+    for (unsigned threads : { 1u, 2u, 4u, 8u }) {
+        uint64_t assinatura = 0;
+        optional<Compilador> c;
+        auto preparar = [&]() {
+            c.emplace();
+            c->opcoes.rastro = RASTRO_NENHUM;
+            c->input = fonte;
+            assinatura = 0;
+        };
+        double melhor = melhorDe(3, preparar, [&]() {
+            optional<LexicoParalelo> paralelo;
+            if (threads > 1) paralelo.emplace(*c, threads);
+            for (TokenValue tok = c->getNextToken(); tok.token != T_EOF; tok = c->getNextToken()) {
+                assinatura = (assinatura ^ (uint64_t)tok.token ^ ((uint64_t)(tok.lexema.data() - fonte.data()) << 8) ^ ((uint64_t)tok.simbolo << 40)) * 0x100000001B3ull;
+            }
+        });
+        if (threads == 1) {
+            esperado = assinatura;
+            tempoSequencial = melhor;
+        }
+        bool igual = assinatura == esperado;
+        if (!igual) falhas++;
+        char linha[160];
+        snprintf(linha, sizeof(linha), "    %u thread%s %8.2f ms %8.1f MB/s  (%.2fx)%s", threads, threads > 1 ? "s" : " ", melhor * 1000,
+                 fonte.size() / melhor / 1e6, tempoSequencial / melhor, igual ? "" : "  TOKENS DIFERENTES");
+        cout << linha << endl;
+    }
+    return falhas > 0 ? 1 : 0;
+}
+
+// Versão recursiva de printArvoreSintatica: uma chamada por nível da árvore
+void Compilador::printArvoreSintaticaRecursiva(ArvoreNode* node, int depth, BufferSaida& saida) {
+    escreverRecuo(saida, depth);
+    saida << node->type();
+
+    if (node->kind == N_INTEIRO || node->kind == N_REAL) {
+        saida << " (";
+        escreverLiteral(saida, node->kind, node->numero);
+        saida << ")";
+    }
+    else if (!node->value.empty()) {
+        saida << " (" << node->value << ")";
+    }
+
+    saida << '\n';
+
+    for (ArvoreNode* child : node->children) {
+        printArvoreSintaticaRecursiva(child, depth + 1, saida);
+    }
+}
+
+// Versão recursiva de printArvoreSemantica
+void Compilador::printArvoreSemanticaRecursiva(ArvoreNode* node, int depth, string_view atrib) {
+    // Exibe a árvore com informações de tipo e valor
+
+    switch (node->kind) {
+    case N_COMANDO:
+        if (firstComando == false) {
+            firstComando = true;
+            for (ArvoreNode* child : node->children) {
+                printArvoreSemanticaRecursiva(child, depth + 1);
+            }
+        }
+        else {
+            for (size_t i = 0; i < node->children.size(); i++)
+            {
+                printArvoreSemanticaRecursiva(node->children[i], depth + 1 + i);
+            }
+        }
+        break;
+
+    case N_EXPRESSAO:
+        printExpressaoSemantica(node, depth, atrib == "ate");
+        break;
+
+    case N_TIPO:
+        saidaSemantica << '\n';
+        escreverRecuo(saidaSemantica, depth);
+        saidaSemantica << node->value << " ";
+        for (ArvoreNode* child : node->children) {
+            printArvoreSemanticaRecursiva(child, depth + 1);
+        }
+        break;
+
+    case N_IDLISTA:
+        for (ArvoreNode* child : node->children) {
+            printArvoreSemanticaRecursiva(child, depth + 1);
+        }
+        break;
+
+    // Operandos e operadores aritméticos/relacionais
+    case N_ID: case N_INTEIRO: case N_REAL:
+    case N_MAIOR: case N_MAIOR_IGUAL: case N_MENOR: case N_MENOR_IGUAL: case N_IGUAL_IGUAL: case N_DIFERENTE:
+    case N_MAIS: case N_MENOS: case N_MULT: case N_DIV:
+        if (atrib == "ate") {
+            saidaSemantica << '\n';
+            escreverRecuo(saidaSemantica, depth);
+            saidaSemantica << node->value;
+        }
+        else if (atrib == "=") {
+            escreverRecuo(saidaSemantica, depth);
+            saidaSemantica << node->value << " =";
+        }
+        else if (node->kind == N_INTEIRO) {
+            saidaSemantica << " " << node->numero.inteiro;
+        }
+        else if (node->kind == N_REAL) {
+            saidaSemantica << " " << nextafter(node->numero.real, 0.00);
+        }
+        else {
+            saidaSemantica << " " << node->value;
+        }
+        break;
+
+    case N_ATRIBUICAO:
+        saidaSemantica << '\n';
+        for (ArvoreNode* child : node->children) {
+            printArvoreSemanticaRecursiva(child, depth + 1, "=");
+        }
+        break;
+
+    default:
+        saidaSemantica << '\n';
+
+        escreverRecuo(saidaSemantica, depth);
+        saidaSemantica << node->type();
+        if (!node->value.empty()) {
+            saidaSemantica << " (" << node->value << ")";
+        }
+
+        if (node->kind == N_REPETICAO || node->kind == N_ENQUANTO) {
+            // A condição do laço é impressa na forma "a < b"
+            ArvoreNode* condicao = node->kind == N_REPETICAO ? node->children[1] : node->children[0];
+            for (ArvoreNode* child : node->children) {
+                printArvoreSemanticaRecursiva(child, depth + 1, child == condicao ? "ate" : "");
+            }
+        }
+        else {
+            for (ArvoreNode* child : node->children) {
+                printArvoreSemanticaRecursiva(child, depth + 1);
+            }
+        }
+        break;
+    }
+}
+
+
+// Versão recursiva de printArvoreJson
+void Compilador::printArvoreJsonRecursiva(ArvoreNode* node, BufferSaida& saida) {
+    saida << "{\"no\":";
+    escreverStringJson(saida, node->type());
+
+    if (node->kind == N_INTEIRO) {
+        saida << ",\"valor\":" << node->numero.inteiro;
+    }
+    else if (node->kind == N_REAL) {
+        saida << ",\"valor\":";
+        escreverRealJson(saida, node->numero.real);
+    }
+    else if (!node->value.empty()) {
+        saida << ",\"valor\":";
+        escreverStringJson(saida, node->value);
+    }
+
+    if (!node->children.empty()) {
+        saida << ",\"filhos\":[";
+        for (uint32_t i = 0; i < node->children.size(); i++) {
+            if (i > 0) saida << ',';
+            printArvoreJsonRecursiva(node->children[i], saida);
+        }
+        saida << ']';
+    }
+    saida << '}';
+}
+
+// Blocos aninhados ('enquanto', se não vier outra abertura) sem indentação,
+// para o tamanho crescer só linearmente com a profundidade
+string programaAninhado(int profundidade, const char* abertura = "enquanto (a < 10) {\n") {
+    string fonte = "inteiro a;\n";
+    fonte.reserve(fonte.size() + (size_t)profundidade * (strlen(abertura) + 2) + 16);
+    for (int i = 0; i < profundidade; i++) {
+        fonte += abertura;
+    }
+    fonte += "a = a + 1;\n";
+    for (int i = 0; i < profundidade; i++) {
+        fonte += "}\n";
+    }
+    return fonte;
+}
+
+// Parser e impressões recursivos contra as versões com pilha explícita, em
+// programas que a versão recursiva ainda suporta, e só a versão iterativa num
+// aninhamento de 'profundidade' níveis
+int benchProfundidade(int profundidade) {
+    ostringstream descarte;
+    OpcoesCompilacao opcoes;
+    opcoes.rastro = RASTRO_NENHUM;
+    auto linha = [](const char* fase, double recursivo, double iterativo, bool iguais) {
+        char texto[160];
+        snprintf(texto, sizeof(texto), "  %-10s recursivo %9.2f ms  iterativo %9.2f ms  (%+.1f%%)%s", fase,
+                 recursivo * 1000, iterativo * 1000, (iterativo / recursivo - 1) * 100, iguais ? "" : "  SAÍDAS DIFERENTES");
+        cout << texto << endl;
+    };
+
+    const pair<const char*, string> programas[] = {
+        { "'teste 1' x 10000", programaTeste1(10000) },
+        { "aninhado, 2000 níveis", programaAninhado(2000) },
+    };
+
+    bool diferentes = false;
+    for (const auto& [nome, fonte] : programas) {
+        cout << nome << " (" << fonte.size() << " bytes)" << endl;
+        Compilador recursivo(opcoes, descarte);
+        Compilador iterativo(opcoes, descarte);
+        iterativo.opcoes.parserIterativo = true;
+
+        ArvoreNode* astRecursiva = nullptr;
+        ArvoreNode* astIterativa = nullptr;
+        double tempoRecursivo = melhorDe(5, [&]() { recursivo.arenaArvore.liberar(); astRecursiva = recursivo.analisar(fonte); });
+        double tempoIterativo = melhorDe(5, [&]() { iterativo.arenaArvore.liberar(); astIterativa = iterativo.analisar(fonte); });
+        BufferSaida a, b;
+        recursivo.printArvoreJsonRecursiva(astRecursiva, a);
+        iterativo.printArvoreJsonRecursiva(astIterativa, b);
+        linha("Programa", tempoRecursivo, tempoIterativo, a.str() == b.str());
+        diferentes |= a.str() != b.str();
+
+        tempoRecursivo = melhorDe(5, [&]() { a.limpar(); recursivo.printArvoreSintaticaRecursiva(astRecursiva, 0, a); });
+        tempoIterativo = melhorDe(5, [&]() { b.limpar(); recursivo.printArvoreSintatica(astRecursiva, 0, b); });
+        linha("sintatica", tempoRecursivo, tempoIterativo, a.str() == b.str());
+        diferentes |= a.str() != b.str();
+
+        tempoRecursivo = melhorDe(5, [&]() {
+            recursivo.saidaSemantica.limpar();
+            recursivo.firstComando = false;
+            recursivo.printArvoreSemanticaRecursiva(astRecursiva);
+        });
+        string semanticaRecursiva = recursivo.saidaSemantica.str();
+        tempoIterativo = melhorDe(5, [&]() {
+            recursivo.saidaSemantica.limpar();
+            recursivo.firstComando = false;
+            recursivo.printArvoreSemantica(astRecursiva);
+        });
+        linha("semantica", tempoRecursivo, tempoIterativo, semanticaRecursiva == recursivo.saidaSemantica.str());
+        diferentes |= semanticaRecursiva != recursivo.saidaSemantica.str();
+
+        tempoRecursivo = melhorDe(5, [&]() { a.limpar(); recursivo.printArvoreJsonRecursiva(astRecursiva, a); });
+        tempoIterativo = melhorDe(5, [&]() { b.limpar(); recursivo.printArvoreJson(astRecursiva, b); });
+        linha("json", tempoRecursivo, tempoIterativo, a.str() == b.str());
+        diferentes |= a.str() != b.str();
+    }
+
+    // Só a versão iterativa: a recursiva estouraria a pilha nativa muito antes.
+    // Cada fase que percorre a árvore roda sobre o aninhamento todo, com os
+    // artefatos padrão (sint, sem, sym), a otimização, o bytecode e o C.
+    const pair<const char*, const char*> aninhados[] = {
+        { "enquanto", "enquanto (a < 10) {\n" },
+        { "se", "se a < 1 entao {\n" },
+    };
+    for (const auto& [nome, abertura] : aninhados) {
+        string fonte = programaAninhado(profundidade, abertura);
+        Compilador iterativo(opcoes, descarte);
+        iterativo.opcoes.parserIterativo = true;
+        cout << "'" << nome << "' aninhado, " << profundidade << " níveis (" << fonte.size() << " bytes), só iterativo" << endl;
+        try {
+            auto medir = [](const char* fase, auto&& executar) {
+                auto inicio = chrono::steady_clock::now();
+                size_t tamanho = executar();
+                double tempo = chrono::duration<double>(chrono::steady_clock::now() - inicio).count();
+                cout << "  " << fase << " " << tempo * 1000 << " ms, " << tamanho << endl;
+            };
+            ArvoreNode* ast = nullptr;
+            medir("Programa (nós)", [&]() { ast = iterativo.analisar(fonte); return iterativo.estatisticas.nos; });
+            medir("sint (bytes)", [&]() { iterativo.printArvoreSintatica(ast, 0, iterativo.saidaSintatica); return iterativo.saidaSintatica.str().size(); });
+            medir("sem (bytes)", [&]() { iterativo.printArvoreSemantica(ast); return iterativo.saidaSemantica.str().size(); });
+            medir("sym (bytes)", [&]() { iterativo.printTabelaDeSimbolos(); return iterativo.saidaSimbolos.str().size(); });
+            medir("otimizar (nós eliminados)", [&]() { return iterativo.otimizar(ast); });
+            medir("bytecode (instruções)", [&]() { return iterativo.gerarBytecode(ast).codigo.size(); });
+            medir("C (bytes)", [&]() { return iterativo.gerarC(ast).size(); });
+        }
+        catch (const ErroCompilacao& e) {
+            cout << "  Erro na posição " << e.posicao << ": " << e.mensagem << endl;
+            return 1;
+        }
+    }
+    return diferentes ? 1 : 0;
+}
+
+// Descida recursiva contra o parser por tabela LL(1), só a análise sintática
+// (com a léxica, que ela puxa), em programas de formas diferentes. As árvores
+// são comparadas pelo JSON, e os erros de uma lista de programas inválidos pela
+// mensagem e pela posição.
+int benchParser(int repeticoes) {
+    ostringstream descarte;
+    OpcoesCompilacao opcoes;
+    opcoes.rastro = RASTRO_NENHUM;
+
+    string misto = programaTeste1(repeticoes);
+    // Identificadores só têm letras: o número da declaração vai em base 26
+    auto nome = [](int i) {
+        string texto = "v";
+        for (; i > 0; i /= 26) texto += (char)('a' + i % 26);
+        return texto;
+    };
+    string declaracoes;
+    for (int i = 0; i < repeticoes; i++) {
+        declaracoes += (i % 2 ? "real " : "inteiro ") + nome(i) + "x, " + nome(i) + "y, " + nome(i) + "z;\n";
+    }
+    declaracoes += "vx = 1;\n";
+    string curtos = "inteiro a, b;\n";
+    const char* const formas[] = { "a = b;\n", "mostrar(a);\n", "ler(b);\n", "se a entao b = 1;\n" };
+    for (int i = 0; i < repeticoes * 8; i++) curtos += formas[i % 4];
+    const pair<const char*, string> programas[] = {
+        { "'teste 1'", misto },
+        { "declarações", declaracoes },
+        { "comandos curtos", curtos },
+        { "aninhado, 2000 níveis", programaAninhado(2000) },
+    };
+
+    bool diferentes = false;
+    Compilador recursivo(opcoes, descarte);
+    Compilador tabela(opcoes, descarte);
+    tabela.opcoes.parserTabela = true;
+    auto analisar = [](Compilador& c, const string& fonte) {
+        c.arenaArvore.liberar();
+        c.reiniciar(fonte);
+        c.nextStep();
+        return c.opcoes.parserTabela ? c.ProgramaTabela() : c.Programa();
+    };
+    for (const auto& [nome, fonte] : programas) {
+        double tempo[2] = { 1e30, 1e30 };
+        ArvoreNode* ast[2] = {};
+        Compilador* compiladores[2] = { &recursivo, &tabela };
+        for (int passada = 0; passada < 5; passada++) {
+            for (int i = 0; i < 2; i++) {
+                auto inicio = chrono::steady_clock::now();
+                ast[i] = analisar(*compiladores[i], fonte);
+                tempo[i] = min(tempo[i], chrono::duration<double>(chrono::steady_clock::now() - inicio).count());
+            }
+        }
+        BufferSaida a, b;
+        recursivo.printArvoreJson(ast[0], a);
+        tabela.printArvoreJson(ast[1], b);
+        bool iguais = a.str() == b.str();
+        diferentes |= !iguais;
+
+        char linha[200];
+        snprintf(linha, sizeof(linha), "  %-22s %9zu bytes  recursivo %8.2f ms  tabela %8.2f ms  (%+.1f%%)%s", nome, fonte.size(),
+                 tempo[0] * 1000, tempo[1] * 1000, (tempo[1] / tempo[0] - 1) * 100, iguais ? "" : "  ÁRVORES DIFERENTES");
+        cout << linha << endl;
+    }
+
+    const char* const invalidos[] = {
+        "", "a = 1;", "inteiro a;", "inteiro a; a = 1; }", "inteiro a,; a = 1;", "inteiro a, a; a = 1;",
+        "inteiro a; a 1;", "inteiro a; se a entao { a = 1;", "inteiro a; ler(1);", "inteiro a; mostrar a;",
+        "inteiro a; enquanto a < 1 { a = 1; }", "inteiro a; repita { a = 1; }", "inteiro a; a = (1 + ;",
+        "inteiro a; senao a = 1;", "inteiro a; a = 1; real b;", "inteiro a; a = 1 ! 2;", "real ;",
+    };
+    int errosDiferentes = 0;
+    for (const char* fonte : invalidos) {
+        string erros[2];
+        Compilador* compiladores[2] = { &recursivo, &tabela };
+        for (int i = 0; i < 2; i++) {
+            try {
+                analisar(*compiladores[i], fonte);
+            }
+            catch (const ErroCompilacao& e) {
+                erros[i] = e.mensagem + " @" + to_string(e.posicao);
+            }
+        }
+        if (erros[0] != erros[1]) {
+            cout << "  \"" << fonte << "\": recursivo '" << erros[0] << "', tabela '" << erros[1] << "'" << endl;
+            errosDiferentes++;
+        }
+    }
+    cout << "  " << size(invalidos) - errosDiferentes << " de " << size(invalidos) << " programas inválidos com o mesmo erro" << endl;
+    return diferentes || errosDiferentes ? 1 : 0;
+}
+
+// Percorre a árvore inteira acumulando um resumo, para comparar as duas representações
+struct ResumoArvore {
+    size_t nos = 0;
+    size_t somaProfundidades = 0;
+    double somaNumeros = 0;
+    size_t porKind[NUM_NODE_KINDS] = {};
+};
+
+void resumirArvore(ArvoreNode* node, size_t depth, ResumoArvore& resumo) {
+    resumo.nos++;
+    resumo.somaProfundidades += depth;
+    resumo.porKind[node->kind]++;
+    if (node->kind == N_INTEIRO || node->kind == N_REAL) resumo.somaNumeros += comoReal(node->kind, node->numero);
+
+    for (ArvoreNode* child : node->children) {
+        resumirArvore(child, depth + 1, resumo);
+    }
+}
+
+void resumirArvorePlana(const ArvorePlana& arvore, ResumoArvore& resumo) {
+    for (uint32_t no = 0; no < arvore.size(); no++) {
+        NodeKind kind = arvore.kind[no];
+        resumo.nos++;
+        resumo.somaProfundidades += arvore.profundidade[no];
+        resumo.porKind[kind]++;
+        if (kind == N_INTEIRO || kind == N_REAL) resumo.somaNumeros += comoReal(kind, arvore.numeros[arvore.payload[no]]);
+    }
+}
+
+// Compara tempo de travessia e memória da árvore de nós (arena) com a árvore plana
+int benchArvorePlana(int comandos) {
+    const char* const formas[] = {
+        "a = b + 1;\n",
+        "mostrar(a);\n",
+        "se a < b entao { b = b - 1; }\n",
+        "enquanto (a < 10) { a = a + 1; }\n",
+    };
+
+    string fonte = "inteiro a, b;\n";
+    for (int i = 0; i < comandos; i++) {
+        fonte += formas[i % 4];
+    }
+    Compilador c;
+    c.opcoes.rastro = RASTRO_NENHUM;
+    c.opcoes.arvorePlana = true;
+    ArvoreNode* ast = c.analisar(fonte);
+    const ArvorePlana& arvorePlana = c.arvorePlana;
+
+    const int passadas = 10;
+    ResumoArvore resumoNos, resumoPlana;
+
+    auto inicio = chrono::steady_clock::now();
+    for (int i = 0; i < passadas; i++) {
+        resumoNos = ResumoArvore();
+        resumirArvore(ast, 0, resumoNos);
+    }
+    double tempoNos = chrono::duration<double>(chrono::steady_clock::now() - inicio).count() / passadas;
+
+    inicio = chrono::steady_clock::now();
+    for (int i = 0; i < passadas; i++) {
+        resumoPlana = ResumoArvore();
+        resumirArvorePlana(arvorePlana, resumoPlana);
+    }
+    double tempoPlana = chrono::duration<double>(chrono::steady_clock::now() - inicio).count() / passadas;
+
+    bool mesmoResumo = resumoNos.nos == resumoPlana.nos && resumoNos.somaProfundidades == resumoPlana.somaProfundidades &&
+        resumoNos.somaNumeros == resumoPlana.somaNumeros;
+
+    // As duas impressões da árvore sintática precisam ser idênticas
+    BufferSaida impressaoNos, impressaoPlana;
+    c.printArvoreSintatica(ast, 0, impressaoNos);
+    c.printArvoreSintaticaPlana(arvorePlana, impressaoPlana);
+    bool mesmaImpressao = impressaoNos.str() == impressaoPlana.str();
+
+    cout << "Entrada: " << comandos << " comandos, " << resumoNos.nos << " nos" << endl;
+    cout << "Arvore de nos: " << tempoNos * 1000 << " ms por travessia, " << c.arenaArvore.pico() << " bytes ("
+         << (double)c.arenaArvore.pico() / resumoNos.nos << " por no)" << endl;
+    cout << "Arvore plana:  " << tempoPlana * 1000 << " ms por travessia, " << arvorePlana.bytes() << " bytes ("
+         << (double)arvorePlana.bytes() / resumoPlana.nos << " por no)" << endl;
+    cout << "Resumos iguais: " << (mesmoResumo ? "sim" : "NAO") << ", impressoes iguais: " << (mesmaImpressao ? "sim" : "NAO") << endl;
+
+    return mesmoResumo && mesmaImpressao ? 0 : 1;
+}
+
+// Laço 'enquanto' típico, usado para medir a máquina virtual
+string programaLaco(long long iteracoes) {
+    return "inteiro i, s;\n"
+           "real x;\n"
+           "i = 0;\n"
+           "enquanto (i < " + to_string(iteracoes) + ") {\n"
+           "    s = s + i;\n"
+           "    x = x + 0.5;\n"
+           "    i = i + 1;\n"
+           "}\n"
+           "mostrar(s);\n"
+           "mostrar(x);\n";
+}
+
+// Mede instruções por segundo da máquina virtual no laço de programaLaco()
+int benchMaquinaVirtual(long long iteracoes) {
+    string fonte = programaLaco(iteracoes);
+    Compilador c;
+    c.opcoes.rastro = RASTRO_NENHUM;
+    Bytecode bc = c.gerarBytecode(c.analisar(fonte));
+
+    string saida;
+    auto inicio = chrono::steady_clock::now();
+    int64_t executadas = executar(bc, saida, cout);
+    double tempo = chrono::duration<double>(chrono::steady_clock::now() - inicio).count();
+
+    cout << "Laco de " << iteracoes << " iteracoes: " << executadas << " instrucoes em " << tempo * 1000 << " ms ("
+         << executadas / tempo / 1e6 << " milhoes de instrucoes/s)" << endl;
+
+    return executadas < 0 ? 1 : 0;
+}
+
+// Compara a máquina virtual com o C gerado e compilado por 'cc -O2' no laço de
+// programaLaco(). Os dois imprimem o resultado do laço, que deve ser igual. O
+// executável nativo roda como processo separado, então o tempo dele inclui a
+// criação do processo.
+int benchCodigoC(long long iteracoes) {
+    string fonte = programaLaco(iteracoes);
+    Compilador c;
+    c.opcoes.rastro = RASTRO_NENHUM;
+    ArvoreNode* ast = c.analisar(fonte);
+
+    // Diretório novo, só do usuário: create_directory() falha se o caminho já
+    // existe, então ninguém consegue deixar ali antes um link para outro arquivo
+    filesystem::path dir = filesystem::temp_directory_path() /
+                           ("bench-codigo-c-" + to_string(Relogio::now().time_since_epoch().count()));
+    error_code erro;
+    if (!filesystem::create_directory(dir, erro)) {
+        cout << "Falha ao criar o diretório " << dir.string() << endl;
+        return 1;
+    }
+    filesystem::permissions(dir, filesystem::perms::owner_all, erro);
+    string arquivoC = (dir / "programa.c").string();
+    string executavel = (dir / "programa").string();
+    {
+        ofstream outputCFile(arquivoC, ios::binary);
+        outputCFile << c.gerarC(ast);
+    }
+
+    auto inicio = chrono::steady_clock::now();
+    if (system(("cc -O2 -o \"" + executavel + "\" \"" + arquivoC + "\"").c_str()) != 0) {
+        cout << "Falha ao compilar o C gerado com 'cc'" << endl;
+        filesystem::remove_all(dir, erro);
+        return 1;
+    }
+    double tempoCc = chrono::duration<double>(chrono::steady_clock::now() - inicio).count();
+
+    inicio = chrono::steady_clock::now();
+    int status = system(("\"" + executavel + "\"").c_str());
+    double tempoNativo = chrono::duration<double>(chrono::steady_clock::now() - inicio).count();
+
+    Bytecode bc = c.gerarBytecode(ast);
+    string saidaVm;
+    inicio = chrono::steady_clock::now();
+    int64_t executadas = executar(bc, saidaVm, cout);
+    double tempoVm = chrono::duration<double>(chrono::steady_clock::now() - inicio).count();
+
+    cout << "Laco de " << iteracoes << " iteracoes:" << endl;
+    cout << "  maquina virtual: " << tempoVm * 1000 << " ms" << endl;
+    cout << "  C nativo (cc -O2): " << tempoNativo * 1000 << " ms (compilacao " << tempoCc * 1000 << " ms)" << endl;
+    cout << "  aceleracao: " << tempoVm / tempoNativo << "x" << endl;
+
+    filesystem::remove_all(dir, erro);
+    return status != 0 || executadas < 0 ? 1 : 0;
+}
+
+// ---------------------------------------------------------------------------
+// Suíte de benchmarks (executável compiladores_bench)
+// ---------------------------------------------------------------------------
+//
+// Gera programas sintéticos de vários tamanhos e formatos e mede cada fase:
+// análise léxica (getNextToken), Programa() (análise sintática), a
+// verificação semântica de verificarSemantica() e cada impressão. Antes de
+// medir, confere a saída contra as árvores de referência do repositório.
+
+// Programa que gerou arvore_sintatica.txt, arvore_semantica.txt e arvore_de_simbolos.txt
+const char* const programaArvoresExemplo =
+    "inteiro a, b, c;\n"
+    "real comprimento, altura;\n"
+    "a = 5;\n"
+    "b = 10;\n"
+    "se a < b entao {\n    mostrar(a);\n} senao {\n    mostrar(b);\n}\n"
+    "se a < b entao {\n    mostrar(a);\n}\n"
+    "enquanto (comprimento < 10.5) {\n    a = 1 + 1;\n    mostrar(a);\n}\n"
+    "repita {\n    a = a - 1;\n    mostrar(a);\n} ate a == 5;\n";
+
+// Programa que gerou otimizado_sintatica.txt e otimizado_semantica.txt com
+// --otimizar: os comandos do ramo escolhido de um 'se' constante entram na
+// lista do bloco de fora, sem um Comando a mais
+const char* const programaSeConstante =
+    "inteiro a;\n"
+    "se 1 < 2 entao {\n    a = 1;\n    mostrar(a);\n} senao {\n    a = 2;\n}\n"
+    "mostrar(a);\n";
+
+enum FormaPrograma {
+    FORMA_MISTO,        // corpo de 'teste 1' repetido
+    FORMA_ANINHADO,     // 'enquanto' aninhados até a profundidade pedida
+    FORMA_DECLARACOES,  // IdLista longas, cada uma com mil variáveis novas
+    FORMA_EXPRESSOES,   // corpo só de atribuições, condições e mostrar com expressões, algumas com parênteses
+};
+
+const char* const nomeFormaPrograma[] = { "misto", "aninhado", "declaracoes", "expressoes" };
+
+// Nome de variável só com letras (a linguagem não aceita dígitos em identificadores)
+string nomeVariavel(size_t n) {
+    string nome = "v";
+    do {
+        nome += (char)('a' + n % 26);
+        n /= 26;
+    } while (n > 0);
+    return nome;
+}
+
+// Gera um programa válido da forma pedida com pelo menos 'tamanho' bytes
+string gerarPrograma(FormaPrograma forma, size_t tamanho, int profundidade) {
+    string fonte;
+    fonte.reserve(tamanho + 4096);
+
+    switch (forma) {
+    case FORMA_MISTO:
+        fonte = programaTeste1DeTamanho(tamanho);
+        break;
+
+    case FORMA_ANINHADO:
+        fonte = teste1Declaracoes;
+        while (fonte.size() < tamanho) {
+            for (int i = 0; i < profundidade; i++) {
+                fonte += string(i * 2, ' ') + "enquanto (a < 10) {\n";
+            }
+            fonte += string(profundidade * 2, ' ') + "a = a + 1;\n";
+            for (int i = profundidade - 1; i >= 0; i--) {
+                fonte += string(i * 2, ' ') + "}\n";
+            }
+        }
+        break;
+
+    case FORMA_DECLARACOES:
+        for (size_t v = 0; fonte.size() < tamanho;) {
+            fonte += (v / 1000) % 2 == 0 ? "inteiro " : "real ";
+            for (int i = 0; i < 1000; i++, v++) {
+                if (i > 0) fonte += ", ";
+                fonte += nomeVariavel(v);
+            }
+            fonte += ";\n";
+        }
+        fonte += nomeVariavel(0) + " = 1;\n";
+        break;
+
+    case FORMA_EXPRESSOES: {
+        const char* const comandos[] = {
+            "a = b * 3;\n",
+            "b = a + c;\n",
+            "c = a - 2;\n",
+            "comprimento = altura / 2.5;\n",
+            "altura = comprimento * 1.5;\n",
+            "se a >= b entao {\n    c = a * b;\n} senao {\n    c = b / 3;\n}\n",
+            "mostrar(a);\n",
+            "enquanto (a <= 100) {\n    a = a + 7;\n}\n",
+            "altura = (comprimento + a * 2) / -(b - 3.5) + c;\n",
+            "se a > b && (c < 3 || a == b) entao {\n    b = -(a - c) * (b + 1);\n}\n",
+        };
+        fonte = teste1Declaracoes;
+        for (size_t i = 0; fonte.size() < tamanho; i++) {
+            fonte += comandos[i % size(comandos)];
+        }
+        break;
+    }
+    }
+    return fonte;
+}
+
+// Imprime a árvore como printArvoreSintatica, mas com cada expressão binária na
+// forma antiga: 'operando operador operando', tudo no nível logo abaixo de Expressao
+void printArvoreLegada(ArvoreNode* node, int depth, BufferSaida& saida, bool emExpressao = false) {
+    auto escreverNo = [&saida](ArvoreNode* no, int profundidade) {
+        saida << string(profundidade * 2, ' ') << no->type();
+        if (no->kind == N_INTEIRO || no->kind == N_REAL) {
+            saida << " (";
+            escreverLiteral(saida, no->kind, no->numero);
+            saida << ")";
+        }
+        else if (!no->value.empty()) {
+            saida << " (" << no->value << ")";
+        }
+        saida << '\n';
+    };
+
+    if (emExpressao && node->children.size() == 2) {
+        printArvoreLegada(node->children[0], depth, saida, true);
+        escreverNo(node, depth);
+        printArvoreLegada(node->children[1], depth, saida, true);
+        return;
+    }
+    escreverNo(node, depth);
+    for (ArvoreNode* child : node->children) {
+        printArvoreLegada(child, depth + 1, saida, node->kind == N_EXPRESSAO);
+    }
+}
+
+// Converte a árvore sintática atual para o formato antigo de 'teste 1.txt' e
+// 'repita.txt' ("Tipo: inteiro", literais como "NUM (...)")
+string paraFormatoLegado(const string& arvore) {
+    string saida;
+    istringstream linhas(arvore);
+    for (string linha; getline(linhas, linha);) {
+        size_t recuo = linha.find_first_not_of(' ');
+        string_view texto = string_view(linha).substr(recuo == string::npos ? linha.size() : recuo);
+        saida.append(linha, 0, recuo == string::npos ? linha.size() : recuo);
+        if (texto.substr(0, 6) == "Tipo (") {
+            saida += "Tipo: ";
+            saida += texto.substr(6, texto.size() - 7);
+        }
+        else if (texto.substr(0, 9) == "INTEIRO (" || texto.substr(0, 6) == "REAL (") {
+            saida += "NUM ";
+            saida += texto.substr(texto.find('('));
+        }
+        else {
+            saida += texto;
+        }
+        saida += '\n';
+    }
+    return saida;
+}
+
+// Retira os 'Decl' aninhados que a versão antiga do parser gerava para cada
+// declaração depois da primeira, trazendo os filhos para o Decl de cima
+string achatarDeclLegado(const string& arvore) {
+    string saida;
+    istringstream linhas(arvore);
+    size_t recuoAninhado = string::npos;
+    for (string linha; getline(linhas, linha);) {
+        size_t recuo = linha.find_first_not_of(' ');
+        if (recuoAninhado != string::npos && recuo <= recuoAninhado) {
+            recuoAninhado = string::npos;
+        }
+        if (recuoAninhado == string::npos && recuo > 2 && linha.compare(recuo, string::npos, "Decl") == 0) {
+            recuoAninhado = recuo;
+            continue;
+        }
+        saida += recuoAninhado == string::npos ? linha : linha.substr(2);
+        saida += '\n';
+    }
+    return saida;
+}
+
+// Compara a saída com as árvores do repositório. Retorna o número de diferenças.
+int verificarReferencias(const string& diretorio) {
+    int falhas = 0;
+    auto conferir = [&](const char* nome, const string& obtido, const string& esperado) {
+        bool igual = obtido == esperado;
+        cout << "  " << nome << ": " << (igual ? "ok" : "DIFERENTE") << endl;
+        if (!igual) falhas++;
+    };
+
+    OpcoesCompilacao opcoes;
+    opcoes.rastro = RASTRO_NENHUM;
+    ostringstream descarte;
+
+    cout << "Referencias em " << diretorio << endl;
+    {
+        Compilador c(opcoes, descarte);
+        ArvoreNode* ast = c.analisar(programaArvoresExemplo);
+        c.printArvoreSintatica(ast, 0, c.saidaSintatica);
+        c.printArvoreSemantica(ast);
+        c.printTabelaDeSimbolos();
+        conferir("arvore_sintatica.txt", c.saidaSintatica.str(), lerArquivo(diretorio + "/arvore_sintatica.txt"));
+        conferir("arvore_semantica.txt", c.saidaSemantica.str(), lerArquivo(diretorio + "/arvore_semantica.txt"));
+        conferir("arvore_de_simbolos.txt", c.saidaSimbolos.str(), lerArquivo(diretorio + "/arvore_de_simbolos.txt"));
+    }
+    {
+        string fonte = programaTeste1(1);
+        Compilador c(opcoes, descarte);
+        ArvoreNode* ast = c.analisar(fonte);
+        printArvoreLegada(ast, 0, c.saidaSintatica);
+        string legado = paraFormatoLegado(c.saidaSintatica.str());
+        conferir("teste 1.txt", legado, achatarDeclLegado(lerArquivo(diretorio + "/teste 1.txt")));
+        conferir("repita.txt", legado, lerArquivo(diretorio + "/repita.txt"));
+    }
+    {
+        Compilador c(opcoes, descarte);
+        ArvoreNode* ast = c.analisar(programaSeConstante);
+        c.otimizar(ast);
+        c.printArvoreSintatica(ast, 0, c.saidaSintatica);
+        c.printArvoreSemantica(ast);
+        conferir("otimizado_sintatica.txt", c.saidaSintatica.str(), lerArquivo(diretorio + "/otimizado_sintatica.txt"));
+        conferir("otimizado_semantica.txt", c.saidaSemantica.str(), lerArquivo(diretorio + "/otimizado_semantica.txt"));
+    }
+    return falhas;
+}
+
+size_t lerTamanho(string_view texto) {
+    size_t valor = (size_t)atoll(string(texto).c_str());
+    switch (texto.empty() ? ' ' : texto.back()) {
+    case 'K': case 'k': return valor << 10;
+    case 'M': case 'm': return valor << 20;
+    case 'G': case 'g': return valor << 30;
+    default: return valor;
+    }
+}
+
+vector<string_view> separarVirgulas(string_view lista) {
+    vector<string_view> partes;
+    while (!lista.empty()) {
+        size_t virgula = lista.find(',');
+        partes.push_back(lista.substr(0, virgula));
+        lista = virgula == string_view::npos ? string_view() : lista.substr(virgula + 1);
+    }
+    return partes;
+}
+
+// Mede cada fase sobre o programa e imprime uma linha por fase
+void medirFases(const string& fonte, const char* forma, int repeticoes) {
+    OpcoesCompilacao opcoes;
+    opcoes.rastro = RASTRO_NENHUM;
+    ostringstream descarte;
+    Compilador c(opcoes, descarte);
+
+    double mb = fonte.size() / 1e6;
+    size_t tokens = 0;
+    auto linha = [&](const char* fase, double tempo) {
+        char texto[160];
+        snprintf(texto, sizeof(texto), "  %-12s %-14s %10.2f ms %10.1f MB/s %12.0f tokens/s", forma, fase,
+                 tempo * 1000, mb / tempo, tokens / tempo);
+        cout << texto << endl;
+    };
+
+    auto prepararLexico = [&]() {
+        c.input = fonte;
+        c.posicao = 0;
+        c.simbolos.limpar();
+        tokens = 0;
+    };
+    double tempoLexico = melhorDe(repeticoes, prepararLexico, [&]() {
+        while (c.getNextToken().token != T_EOF) tokens++;
+    });
+    linha("getNextToken", tempoLexico);
+
+    // analisar() faz as duas fases; a semântica sai do cronômetro da própria
+    // compilação e o resto é a análise sintática
+    ArvoreNode* ast = nullptr;
+    double tempoPrograma = 1e30;
+    double tempoSemantica = 1e30;
+    for (int i = 0; i < repeticoes; i++) {
+        c.arenaArvore.liberar();
+        auto inicio = chrono::steady_clock::now();
+        ast = c.analisar(fonte);
+        double total = chrono::duration<double>(chrono::steady_clock::now() - inicio).count();
+        double semantica = c.estatisticas.tempo[FASE_SEMANTICA];
+        tempoPrograma = min(tempoPrograma, total - semantica);
+        tempoSemantica = min(tempoSemantica, semantica);
+    }
+    linha("Programa", tempoPrograma);
+    linha("semantica", tempoSemantica);
+
+    linha("imprime-sem", melhorDe(repeticoes, [&]() {
+        c.saidaSemantica.limpar();
+        c.firstComando = false;
+        c.printArvoreSemantica(ast);
+    }));
+    linha("imprime-sint", melhorDe(repeticoes, [&]() {
+        c.saidaSintatica.limpar();
+        c.printArvoreSintatica(ast, 0, c.saidaSintatica);
+    }));
+    linha("imprime-sym", melhorDe(repeticoes, [&]() {
+        c.saidaSimbolos.limpar();
+        c.printTabelaDeSimbolos();
+    }));
+    linha("imprime-json", melhorDe(repeticoes, [&]() {
+        BufferSaida json;
+        c.printJson(ast, json);
+    }));
+}
+
+// compiladores_bench [--tamanhos=64K,1M,16M] [--formas=misto,aninhado,declaracoes,expressoes]
+//                    [--profundidade=64] [--repeticoes=3] [--referencias=DIR] [--so-referencias]
+// compiladores_bench --bench-alocacoes|--bench-vm|--bench-c|... [N]
+int suiteBenchmark(int argc, char* argv[]) {
+#ifdef DIRETORIO_REFERENCIAS
+    string referencias = DIRETORIO_REFERENCIAS;
+#else
+    string referencias = "Compiladores";
+#endif
+    vector<size_t> tamanhos = { 64 << 10, 1 << 20, 16 << 20 };
+    vector<FormaPrograma> formas = { FORMA_MISTO, FORMA_ANINHADO, FORMA_DECLARACOES, FORMA_EXPRESSOES };
+    int profundidade = 64;
+    int repeticoes = 3;
+    bool soReferencias = false;
+
+    for (int i = 1; i < argc; i++) {
+        string_view arg = argv[i];
+        if (arg.substr(0, 11) == "--tamanhos=") {
+            tamanhos.clear();
+            for (string_view t : separarVirgulas(arg.substr(11))) tamanhos.push_back(lerTamanho(t));
+        }
+        else if (arg.substr(0, 9) == "--formas=") {
+            formas.clear();
+            for (string_view f : separarVirgulas(arg.substr(9))) {
+                auto it = find(begin(nomeFormaPrograma), end(nomeFormaPrograma), f);
+                if (it == end(nomeFormaPrograma)) {
+                    cout << "Forma desconhecida: " << f << endl;
+                    return 1;
+                }
+                formas.push_back((FormaPrograma)(it - begin(nomeFormaPrograma)));
+            }
+        }
+        else if (arg.substr(0, 15) == "--profundidade=") {
+            profundidade = max(1, atoi(argv[i] + 15));
+        }
+        else if (arg.substr(0, 13) == "--repeticoes=") {
+            repeticoes = max(1, atoi(argv[i] + 13));
+        }
+        else if (arg.substr(0, 14) == "--referencias=") {
+            referencias = string(arg.substr(14));
+        }
+        else if (arg == "--so-referencias") {
+            soReferencias = true;
+        }
+        else {
+            cout << "Opção desconhecida: " << arg << endl;
+            return 1;
+        }
+    }
+
+    int falhas = verificarReferencias(referencias);
+    if (falhas > 0 || soReferencias) {
+        return falhas > 0 ? 1 : 0;
+    }
+
+    for (size_t tamanho : tamanhos) {
+        cout << endl << "Tamanho alvo: " << tamanho << " bytes" << endl;
+        for (FormaPrograma forma : formas) {
+            string fonte = gerarPrograma(forma, tamanho, profundidade);
+            try {
+                medirFases(fonte, nomeFormaPrograma[forma], repeticoes);
+            }
+            catch (const ErroCompilacao& e) {
+                cout << "  " << nomeFormaPrograma[forma] << ": erro na posição " << e.posicao << ": " << e.mensagem << endl;
+                falhas++;
+            }
+        }
+    }
+    return falhas > 0 ? 1 : 0;
+}
+#endif
+
+// Código-fonte de um arquivo. Arquivos regulares são mapeados somente leitura; pipes,
+// terminais e a entrada padrão ('-') são lidos para um buffer.
+struct ArquivoFonte {
+    string_view conteudo;
+    string buffer;
+    void* mapa = nullptr;
+    size_t tamanhoMapa = 0;
+
+    ArquivoFonte() = default;
+    ArquivoFonte(const ArquivoFonte&) = delete;
+    ArquivoFonte& operator=(const ArquivoFonte&) = delete;
+
+    ~ArquivoFonte() {
+#ifndef _WIN32
+        if (mapa) munmap(mapa, tamanhoMapa);
+#endif
+    }
+};
+
+bool abrirFonte(const string& caminho, ArquivoFonte& fonte) {
+#ifndef _WIN32
+    int fd = caminho == "-" ? STDIN_FILENO : open(caminho.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat info;
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+        void* mapa = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapa != MAP_FAILED) {
+            madvise(mapa, (size_t)info.st_size, MADV_SEQUENTIAL);
+            fonte.mapa = mapa;
+            fonte.tamanhoMapa = (size_t)info.st_size;
+            fonte.conteudo = string_view((const char*)mapa, fonte.tamanhoMapa);
+            if (fd != STDIN_FILENO) close(fd);
+            return true;
+        }
+    }
+
+    // Leitura com buffer para o que não pode ser mapeado
+    char bloco[1 << 16];
+    ssize_t lidos;
+    while ((lidos = read(fd, bloco, sizeof(bloco))) > 0) {
+        fonte.buffer.append(bloco, (size_t)lidos);
+    }
+    if (fd != STDIN_FILENO) close(fd);
+    if (lidos < 0) return false;
+#else
+    if (caminho == "-") {
+        fonte.buffer.assign(istreambuf_iterator<char>(cin), istreambuf_iterator<char>());
+    }
+    else {
+        ifstream arquivo(caminho, ios::binary);
+        if (!arquivo.is_open()) return false;
+        fonte.buffer.assign(istreambuf_iterator<char>(arquivo), istreambuf_iterator<char>());
+    }
+#endif
+    fonte.conteudo = fonte.buffer;
+    return true;
+}
+
+// Fonte lida em blocos de TAMANHO_BLOCO (--fluxo). Um bloco fica na memória
+// enquanto algum nó, o token atual ou o anel de rastro ainda aponta para ele.
+// Um token que chega ao fim do último bloco é copiado para o começo do bloco
+// seguinte, então cada token está inteiro num bloco e os blocos anteriores
+// nunca mudam de lugar.
+class FonteEmFluxo {
+    struct Bloco {
+        string dados;
+        size_t inicio;  // posição do primeiro byte no arquivo
+    };
+
+    FILE* arquivo = nullptr;
+    deque<Bloco> blocos;
+    bool terminou = false;
+    size_t maximo = 0;
+
+public:
+    static const size_t TAMANHO_BLOCO = 1 << 20;
+
+    FonteEmFluxo() = default;
+    FonteEmFluxo(const FonteEmFluxo&) = delete;
+    FonteEmFluxo& operator=(const FonteEmFluxo&) = delete;
+
+    ~FonteEmFluxo() {
+        if (arquivo && arquivo != stdin) fclose(arquivo);
+    }
+
+    bool abrir(const string& caminho) {
+        arquivo = caminho == "-" ? stdin : fopen(caminho.c_str(), "rb");
+        return arquivo != nullptr;
+    }
+
+    // Abre um bloco com o que o último tem a partir de 'desde' e o próximo
+    // trecho do arquivo. Falso quando o arquivo acabou.
+    bool carregar(size_t desde) {
+        if (terminou) return false;
+
+        Bloco novo;
+        novo.inicio = desde;
+        size_t copiados = 0;
+        if (!blocos.empty()) {
+            const Bloco& ultimo = blocos.back();
+            copiados = ultimo.inicio + ultimo.dados.size() - desde;
+            novo.dados.resize(copiados + TAMANHO_BLOCO);
+            memcpy(&novo.dados[0], ultimo.dados.data() + (desde - ultimo.inicio), copiados);
+        }
+        else {
+            novo.dados.resize(TAMANHO_BLOCO);
+        }
+
+        size_t lidos = fread(&novo.dados[copiados], 1, TAMANHO_BLOCO, arquivo);
+        if (lidos == 0) {
+            terminou = true;
+            return false;
+        }
+        novo.dados.resize(copiados + lidos);
+        blocos.push_back(move(novo));
+        maximo = max(maximo, bytesNaMemoria());
+        return true;
+    }
+
+    // Libera os blocos que terminam antes da posição 'ate'. O último fica.
+    void descartar(size_t ate) {
+        while (blocos.size() > 1 && blocos.front().inicio + blocos.front().dados.size() <= ate) {
+            blocos.pop_front();
+        }
+    }
+
+    string_view atual() const { return blocos.empty() ? string_view() : string_view(blocos.back().dados); }
+    size_t inicioAtual() const { return blocos.empty() ? 0 : blocos.back().inicio; }
+
+    // Posição no arquivo do byte apontado por 'p', ou SIZE_MAX se ele não está em nenhum bloco
+    size_t posicaoDe(const char* p) const {
+        for (const Bloco& bloco : blocos) {
+            uintptr_t inicio = (uintptr_t)bloco.dados.data();
+            if ((uintptr_t)p >= inicio && (uintptr_t)p < inicio + bloco.dados.size()) {
+                return bloco.inicio + (size_t)((uintptr_t)p - inicio);
+            }
+        }
+        return SIZE_MAX;
+    }
+
+    size_t bytesNaMemoria() const {
+        size_t total = 0;
+        for (const Bloco& bloco : blocos) total += bloco.dados.capacity();
+        return total;
+    }
+
+    // Maior quantidade de bytes da fonte mantida na memória ao mesmo tempo
+    size_t pico() const { return maximo; }
+};
+
+// Troca 'input' pelo bloco seguinte da fonte, começando em 'desde' do bloco atual
+bool Compilador::recarregarEntrada(size_t desde) {
+    if (!fluxo->carregar(deslocamento + desde)) return false;
+    input = fluxo->atual();
+    deslocamento = fluxo->inicioAtual();
+    posicao = 0;
+    return true;
+}
+
+// Posição na fonte do byte apontado por 'p', ou SIZE_MAX se ele não está na entrada
+size_t Compilador::posicaoNaFonte(const char* p) const {
+    uintptr_t inicio = (uintptr_t)input.data();
+    if ((uintptr_t)p >= inicio && (uintptr_t)p < inicio + input.size()) {
+        return deslocamento + (size_t)((uintptr_t)p - inicio);
+    }
+    return fluxo ? fluxo->posicaoDe(p) : SIZE_MAX;
+}
+
+// Primeira posição da fonte que ainda precisa estar na memória: a do token
+// atual ou a do token mais antigo do anel de rastro
+size_t Compilador::inicioRetido() const {
+    size_t ate = deslocamento + posicao;
+    auto reter = [&](const TokenValue& tok) { ate = min(ate, posicaoNaFonte(tok.lexema.data())); };
+    reter(currentToken);
+    ultimosTokens.paraCada(reter);
+    return ate;
+}
+
+// Cache de compilações em disco, endereçado pelo conteúdo. A chave é um hash
+// de 128 bits da versão dos artefatos, das opções que mudam os artefatos e do
+// código-fonte; a entrada guarda a própria fonte, conferida byte a byte na
+// leitura, os artefatos, a tabela de símbolos e a árvore já verificada, para
+// --executar e --gerar-c não precisarem analisar de novo.
+//
+// Cada entrada é um arquivo '<chave>.cmp' que nunca muda depois de criado: ele
+// é gravado com um nome temporário e renomeado, então um processo lendo ao
+// mesmo tempo vê a entrada inteira ou nenhuma. A data de modificação marca o
+// último uso, e quando o diretório passa do limite as entradas usadas há mais
+// tempo são apagadas.
+constexpr uint64_t VERSAO_ARTEFATOS = 1;                  // muda quando a mesma fonte passa a dar outros artefatos
+constexpr uint64_t MAGICO_CACHE = 0x3330434D50434343ull;  // "CCCPMC03": muda com o formato da entrada
+
+// Hash de 64 bits, 8 bytes por passo. As duas sementes dão os 128 bits da chave
+// e do teste de integridade.
+void hashConteudo(string_view dados, uint64_t& h0, uint64_t& h1) {
+    const uint64_t primo0 = 0x9E3779B97F4A7C15ull;
+    const uint64_t primo1 = 0xC2B2AE3D27D4EB4Full;
+    size_t i = 0;
+    for (; i + 8 <= dados.size(); i += 8) {
+        uint64_t bloco;
+        memcpy(&bloco, dados.data() + i, 8);
+        h0 = (h0 ^ bloco) * primo0;
+        h0 ^= h0 >> 32;
+        h1 = (h1 ^ bloco) * primo1;
+        h1 ^= h1 >> 29;
+    }
+    uint64_t resto = 0;
+    memcpy(&resto, dados.data() + i, dados.size() - i);
+    h0 = (h0 ^ resto ^ dados.size()) * primo0;
+    h0 ^= h0 >> 32;
+    h1 = (h1 ^ resto ^ dados.size()) * primo1;
+    h1 ^= h1 >> 29;
+}
+
+struct ChaveCache {
+    uint64_t h[2] = { 0x243F6A8885A308D3ull, 0x13198A2E03707344ull };
+
+    string hex() const {
+        char texto[33];
+        snprintf(texto, sizeof(texto), "%016llx%016llx", (unsigned long long)h[0], (unsigned long long)h[1]);
+        return texto;
+    }
+};
+
+ChaveCache chaveCache(string_view fonte, const OpcoesCompilacao& opcoes) {
+    ChaveCache chave;
+    uint64_t opcoesArtefatos[] = { MAGICO_CACHE, VERSAO_ARTEFATOS, opcoes.otimizar, opcoes.artefatos };
+    hashConteudo(string_view((const char*)opcoesArtefatos, sizeof(opcoesArtefatos)), chave.h[0], chave.h[1]);
+    hashConteudo(fonte, chave.h[0], chave.h[1]);
+    return chave;
+}
+
+// Leitura de dados binários gravados com escreverBinario() (entradas do cache,
+// mensagens do servidor). Dados truncados ou de outro formato só desligam 'ok'.
+struct LeituraBinaria {
+    string_view dados;
+    size_t posicao = 0;
+    bool ok = true;
+
+    template <typename T>
+    T valor() {
+        T v{};
+        if (dados.size() - posicao < sizeof(T)) {
+            ok = false;
+            return v;
+        }
+        memcpy(&v, dados.data() + posicao, sizeof(T));
+        posicao += sizeof(T);
+        return v;
+    }
+
+    string_view bytes(uint64_t n) {
+        if (dados.size() - posicao < n) {
+            ok = false;
+            return {};
+        }
+        string_view v = dados.substr(posicao, (size_t)n);
+        posicao += (size_t)n;
+        return v;
+    }
+
+    string_view texto() { return bytes(valor<uint64_t>()); }
+};
+
+template <typename T>
+void escreverBinario(string& saida, T valor) {
+    saida.append((const char*)&valor, sizeof(T));
+}
+
+void escreverTexto(string& saida, string_view texto) {
+    escreverBinario(saida, (uint64_t)texto.size());
+    saida.append(texto);
+}
 
-ArvoreNode* Expressao(string tipo, string tipoParent = "") {
-    ArvoreNode* node = new ArvoreNode("Expressao");
+class CacheCompilacao {
+    string diretorio;
+    uint64_t limite;
 
-    if (currentToken.token == T_ID || currentToken.token == T_NUM_INTEIRO || currentToken.token == T_NUM_REAL ||
-        currentToken.token == T_MAIS || currentToken.token == T_MENOS ||
-        currentToken.token == T_MULT || currentToken.token == T_DIV ||
-        currentToken.token == T_OU || currentToken.token == T_E ||
-        currentToken.token == T_MAIOR || currentToken.token == T_MAIOR_IGUAL ||
-        currentToken.token == T_MENOR || currentToken.token == T_MENOR_IGUAL ||
-        currentToken.token == T_IGUAL_IGUAL || currentToken.token == T_DIFERENTE) {
-        
-        if (currentToken.token == T_ID) {
-            string tipoVar = tabelaDeSimbolos[currentToken.lexema];
-            if (tipoVar.empty()) {
-                error("Variável não declarada: " + currentToken.lexema);
-            }
+    // Arquivos temporários mais antigos que isso são de gravações interrompidas
+    static constexpr auto IDADE_TEMPORARIO = chrono::minutes(10);
 
-            node->children.push_back(new ArvoreNode("ID", currentToken.lexema));
-            /*node->children[0]->type*/
-            match(T_ID);
-        }
-        else if (currentToken.token == T_NUM_INTEIRO ) {
-            node->children.push_back(new ArvoreNode("INTEIRO", to_string(currentToken.value)));
-            match(T_NUM_INTEIRO);
-        }
-        else if (currentToken.token == T_NUM_REAL) {
-            node->children.push_back(new ArvoreNode("REAL", to_string(currentToken.value)));
-            match(T_NUM_REAL);
-        }
+    string caminho(const ChaveCache& chave) const { return diretorio + "/" + chave.hex() + ".cmp"; }
+
+public:
+    CacheCompilacao(string d, uint64_t l) : diretorio(move(d)), limite(l) {}
 
+    // Cabeçalho de uma entrada nova: o corpo é acrescentado por quem grava
+    static string iniciarEntrada(const ChaveCache& chave) {
+        string entrada;
+        escreverBinario(entrada, MAGICO_CACHE);
+        escreverBinario(entrada, chave.h[0]);
+        escreverBinario(entrada, chave.h[1]);
+        return entrada;
+    }
 
-        if (currentToken.token == T_MAIS || currentToken.token == T_MENOS ||
-            currentToken.token == T_MULT || currentToken.token == T_DIV) {
-            node->children.push_back(ExpressaoAritimetica());
+    // Mapeia a entrada da chave e devolve o corpo em 'corpo'. Entradas de outra
+    // chave ou que não passam no teste de integridade são apagadas.
+    bool ler(const ChaveCache& chave, ArquivoFonte& arquivo, string_view& corpo) {
+        string nome = caminho(chave);
+        error_code erro;
+        if (!filesystem::exists(nome, erro) || !abrirFonte(nome, arquivo)) return false;
+
+        const size_t cabecalho = 3 * sizeof(uint64_t);
+        string_view dados = arquivo.conteudo;
+        bool valida = false;
+        if (dados.size() >= cabecalho + 2 * sizeof(uint64_t)) {
+            uint64_t lido[5];
+            memcpy(lido, dados.data(), cabecalho);
+            memcpy(lido + 3, dados.data() + dados.size() - 2 * sizeof(uint64_t), 2 * sizeof(uint64_t));
+            uint64_t h0 = 0, h1 = 0;
+            hashConteudo(dados.substr(0, dados.size() - 2 * sizeof(uint64_t)), h0, h1);
+            valida = lido[0] == MAGICO_CACHE && lido[1] == chave.h[0] && lido[2] == chave.h[1] && lido[3] == h0 && lido[4] == h1;
         }
-        else if (currentToken.token == T_OU || currentToken.token == T_E) {
-            node->children.push_back(ExpressaoLogica());
+        if (!valida) {
+            filesystem::remove(nome, erro);
+            return false;
         }
-        else if (currentToken.token == T_MAIOR || currentToken.token == T_MAIOR_IGUAL ||
-            currentToken.token == T_MENOR || currentToken.token == T_MENOR_IGUAL ||
-            currentToken.token == T_IGUAL_IGUAL || currentToken.token == T_DIFERENTE) {
 
-            verificarBooleano(currentToken.lexema);
+        // Marca o uso para o despejo
+        filesystem::last_write_time(nome, filesystem::file_time_type::clock::now(), erro);
+        corpo = dados.substr(cabecalho, dados.size() - cabecalho - 2 * sizeof(uint64_t));
+        return true;
+    }
 
-            node->children.push_back(ExpressaoRelacional());
+    // Fecha a entrada com o teste de integridade e a publica com uma renomeação
+    bool gravar(const ChaveCache& chave, string& entrada) {
+        uint64_t h0 = 0, h1 = 0;
+        hashConteudo(entrada, h0, h1);
+        escreverBinario(entrada, h0);
+        escreverBinario(entrada, h1);
+        if (entrada.size() > limite) return false;
+
+        static atomic<uint64_t> contador{ 0 };
+#ifndef _WIN32
+        uint64_t processo = (uint64_t)getpid();
+#else
+        uint64_t processo = (uint64_t)Relogio::now().time_since_epoch().count();
+#endif
+        error_code erro;
+        filesystem::create_directories(diretorio, erro);
+        string temporario = caminho(chave) + "." + to_string(processo) + "." + to_string(contador++) + ".tmp";
+        if (!gravarArquivo(temporario, entrada)) {
+            filesystem::remove(temporario, erro);
+            return false;
+        }
+        filesystem::rename(temporario, caminho(chave), erro);
+        if (erro) {
+            filesystem::remove(temporario, erro);
+            return false;
         }
 
+        despejar();
+        return true;
+    }
 
-
-        if (currentToken.token == T_ID) {
-            string tipoVar = tabelaDeSimbolos[currentToken.lexema];
-            if (tipoVar.empty()) {
-                error("Variável não declarada: " + currentToken.lexema);
-            }
-
-            node->children.push_back(new ArvoreNode("ID", currentToken.lexema));
-            match(T_ID);
+    // Apaga as entradas usadas há mais tempo até o diretório ficar em 90% do
+    // limite. Só um processo despeja por vez; os outros seguem sem esperar.
+    void despejar() {
+#ifndef _WIN32
+        int trava = open((diretorio + "/.trava").c_str(), O_RDWR | O_CREAT, 0644);
+        if (trava < 0) return;
+        if (flock(trava, LOCK_EX | LOCK_NB) != 0) {
+            close(trava);
+            return;
         }
-        else if (currentToken.token == T_NUM_INTEIRO) {
-            node->children.push_back(new ArvoreNode("INTEIRO", to_string(currentToken.value)));
-            match(T_NUM_INTEIRO);
+#endif
+        struct Entrada {
+            filesystem::file_time_type uso;
+            uint64_t tamanho;
+            filesystem::path caminho;
+        };
+        vector<Entrada> entradas;
+        uint64_t total = 0;
+        auto agora = filesystem::file_time_type::clock::now();
+        error_code erro;
+        for (filesystem::directory_iterator it(diretorio, erro), fim; !erro && it != fim; it.increment(erro)) {
+            string extensao = it->path().extension().string();
+            auto uso = it->last_write_time(erro);
+            if (erro) {
+                erro.clear();
+                continue;
+            }
+            if (extensao == ".tmp" && agora - uso > IDADE_TEMPORARIO) {
+                filesystem::remove(it->path(), erro);
+                erro.clear();
+            }
+            else if (extensao == ".cmp") {
+                uint64_t tamanho = it->file_size(erro);
+                if (erro) {
+                    erro.clear();
+                    continue;
+                }
+                entradas.push_back({ uso, tamanho, it->path() });
+                total += tamanho;
+            }
         }
-        else if (currentToken.token == T_NUM_REAL) {
-            node->children.push_back(new ArvoreNode("REAL", to_string(currentToken.value)));
-            match(T_NUM_REAL);
+
+        if (total > limite) {
+            sort(entradas.begin(), entradas.end(), [](const Entrada& a, const Entrada& b) { return a.uso < b.uso; });
+            for (const Entrada& e : entradas) {
+                if (total <= limite / 10 * 9) break;
+                filesystem::remove(e.caminho, erro);
+                total -= e.tamanho;
+            }
         }
+#ifndef _WIN32
+        close(trava);
+#endif
+    }
+};
 
+// Diretório de --cache sem valor: o cache do usuário, como nas outras ferramentas
+string diretorioCachePadrao() {
+    if (const char* xdg = getenv("XDG_CACHE_HOME"); xdg && *xdg) return string(xdg) + "/compiladores";
+    if (const char* home = getenv("HOME"); home && *home) return string(home) + "/.cache/compiladores";
+    return ".cache-compiladores";
+}
 
-        if (node->children.size() == 3 && tipo != "booleano") {
-            Token verificaTipo = verificarExpressaoEritimetica(node->children[0], node->children[1]->value, node->children[2]);
-            
-            //cout << endl << tipoParent << " || " << verificaTipo << endl << endl;
+// Texto de um nó na entrada: a posição dele em 'input' ou, para textos que não
+// vêm da entrada (literais dobrados pelo otimizador), os próprios bytes
+const uint64_t TEXTO_PROPRIO = UINT64_MAX;
+
+// Corpo da entrada: nós eliminados pelo otimizador, artefatos, nomes, tabela de
+// símbolos e a árvore em pré-ordem
+void Compilador::serializarParaCache(string& entrada, ArvoreNode* ast, uint64_t eliminados, const string_view* artefatos) {
+    escreverBinario(entrada, (uint64_t)input.size());
+    entrada.append(input);
+    escreverBinario(entrada, eliminados);
+    for (unsigned a = 0; a < NUM_ARTEFATOS; a++) {
+        escreverBinario(entrada, (uint64_t)artefatos[a].size());
+        entrada.append(artefatos[a]);
+    }
 
-            if (tipo == "Atribuicao" && 
-                ((verificaTipo == T_INTEIRO && (tipoParent == "REAL" || tipoParent == "real")) || (verificaTipo == T_REAL && (tipoParent == "INTEIRO" || tipoParent == "inteiro")))) {
-                error("Atribuição de tipos incompativeis");
-            }
-            //if (tipo == "Atribuicao" && (node->children[1]->type == "MENOS" || node->children[1]->type == "MAIS" 
-            //    || node->children[1]->type == "MULT" || node->children[1]->type == "DIV")) {
-            //    cout << endl << tabelaDeSimbolos[node->children[1]->value] << endl << endl;
-            //    
-            //}
+    auto escreverTexto = [&](string_view texto) {
+        escreverBinario(entrada, (uint32_t)texto.size());
+        if (texto.empty()) return;
+        uintptr_t inicio = (uintptr_t)input.data();
+        uintptr_t lexema = (uintptr_t)texto.data();
+        if (lexema >= inicio && lexema + texto.size() <= inicio + input.size()) {
+            escreverBinario(entrada, (uint64_t)(lexema - inicio));
         }
+        else {
+            escreverBinario(entrada, TEXTO_PROPRIO);
+            entrada.append(texto);
+        }
+    };
 
-        //if (tipo == "booleano") {
-            /*if (!verificarBooleano((LPCWSTR) _T(input[posicao]))) {
-                error("Expressões contidas em funções de repetição e condição devem ser booleanas.");
-            }*/
-        //}
+    escreverBinario(entrada, (uint32_t)simbolos.quantidade());
+    for (uint32_t simbolo = 0; simbolo < simbolos.quantidade(); simbolo++) {
+        escreverTexto(simbolos.nome(simbolo));
     }
-    else {
-        error("Expressão inválida");
+    const vector<uint32_t>& declarados = tabelaDeSimbolos.emOrdemDeDeclaracao();
+    escreverBinario(entrada, (uint32_t)declarados.size());
+    for (uint32_t simbolo : declarados) {
+        escreverBinario(entrada, simbolo);
+        escreverBinario(entrada, (uint8_t)tabelaDeSimbolos.tipoSemContar(simbolo));
     }
 
-    return node;
+    // Identificadores levam só o número; o texto é o nome internado
+    uint64_t nos = 0;
+    size_t posicaoNos = entrada.size();
+    escreverBinario(entrada, nos);
+    vector<ArvoreNode*> pilha = { ast };
+    while (!pilha.empty()) {
+        ArvoreNode* node = pilha.back();
+        pilha.pop_back();
+        nos++;
+        escreverBinario(entrada, (uint8_t)node->kind);
+        escreverBinario(entrada, node->semantico);
+        escreverBinario(entrada, node->children.tamanho);
+        if (node->kind == N_ID) {
+            escreverBinario(entrada, node->simbolo);
+        }
+        else {
+            if (node->kind == N_INTEIRO || node->kind == N_REAL) escreverBinario(entrada, node->numero);
+            escreverTexto(node->value);
+        }
+        for (size_t i = node->children.size(); i-- > 0;) {
+            pilha.push_back(node->children[i]);
+        }
+    }
+    memcpy(&entrada[posicaoNos], &nos, sizeof(nos));
 }
 
-ArvoreNode* ExpressaoRelacional() {
-    if (currentToken.token == T_MAIOR) {
-        ArvoreNode* node = new ArvoreNode("MAIOR", currentToken.lexema);
-        match(T_MAIOR);
-        return node;
-    }
-    else if (currentToken.token == T_MAIOR_IGUAL) {
-        ArvoreNode* node = new ArvoreNode("MAIOR IGUAL", currentToken.lexema);
-        match(T_MAIOR);
-        return node;
+// Lê o corpo de uma entrada: os artefatos apontam para o arquivo mapeado e, se
+// 'ast' não for nulo, a tabela de símbolos e a árvore são reconstruídas na
+// arena. Retorna false se a entrada não corresponder a 'fonte': uma colisão do
+// hash da chave não devolve os artefatos de outro programa.
+bool Compilador::restaurarDoCache(string_view corpo, string_view fonte, string_view* artefatos, uint64_t& eliminados, ArvoreNode** ast) {
+    LeituraBinaria leitura{ corpo };
+    if (leitura.texto() != fonte || !leitura.ok) return false;
+    eliminados = leitura.valor<uint64_t>();
+    for (unsigned a = 0; a < NUM_ARTEFATOS; a++) {
+        artefatos[a] = leitura.bytes(leitura.valor<uint64_t>());
     }
-    else if (currentToken.token == T_MENOR) {
-        ArvoreNode* node = new ArvoreNode("MENOR", currentToken.lexema);
-        match(T_MENOR);
-        return node;
-    }
-    else if (currentToken.token == T_MENOR_IGUAL) {
-        ArvoreNode* node = new ArvoreNode("MENOR IGUAL", currentToken.lexema);
-        match(T_MENOR_IGUAL);
-        return node;
+    if (!leitura.ok) return false;
+    if (!ast) return true;
+
+    reiniciar(fonte);
+    auto lerTexto = [&]() -> string_view {
+        uint32_t tamanho = leitura.valor<uint32_t>();
+        if (tamanho == 0) return {};
+        uint64_t origem = leitura.valor<uint64_t>();
+        if (origem != TEXTO_PROPRIO) {
+            if (origem > fonte.size() || fonte.size() - origem < tamanho) leitura.ok = false;
+            return leitura.ok ? fonte.substr((size_t)origem, tamanho) : string_view();
+        }
+        string_view texto = leitura.bytes(tamanho);
+        char* copia = (char*)arenaArvore.alocar(texto.size(), 1);
+        memcpy(copia, texto.data(), texto.size());
+        return string_view(copia, texto.size());
+    };
+
+    uint32_t nomes = leitura.valor<uint32_t>();
+    for (uint32_t simbolo = 0; simbolo < nomes && leitura.ok; simbolo++) {
+        if (simbolos.internar(lerTexto()) != simbolo) return false;
     }
-    else if (currentToken.token == T_IGUAL_IGUAL) {
-        ArvoreNode* node = new ArvoreNode("IGUAL IGUAL", currentToken.lexema);
-        match(T_IGUAL_IGUAL);
-        return node;
+    uint32_t declarados = leitura.valor<uint32_t>();
+    for (uint32_t i = 0; i < declarados && leitura.ok; i++) {
+        uint32_t simbolo = leitura.valor<uint32_t>();
+        TipoDado tipo = (TipoDado)leitura.valor<uint8_t>();
+        if (simbolo >= nomes) return false;
+        tabelaDeSimbolos.declarar(simbolo, tipo);
     }
-    else if (currentToken.token == T_DIFERENTE) {
-        ArvoreNode* node = new ArvoreNode("DIFERENTE", currentToken.lexema);
-        match(T_DIFERENTE);
-        return node;
+
+    // Cada nó entra no próximo espaço livre dos filhos do nó no topo da pilha
+    struct Pendente {
+        ArvoreNode* node;
+        uint32_t preenchidos;
+    };
+    vector<Pendente> pilha;
+    uint64_t nos = leitura.valor<uint64_t>();
+    *ast = nullptr;
+    for (uint64_t n = 0; n < nos && leitura.ok; n++) {
+        NodeKind kind = (NodeKind)leitura.valor<uint8_t>();
+        unsigned char semantico = leitura.valor<uint8_t>();
+        uint32_t filhos = leitura.valor<uint32_t>();
+        if (kind >= NUM_NODE_KINDS || (n > 0 && pilha.empty())) return false;
+
+        ArvoreNode* node;
+        if (kind == N_ID) {
+            uint32_t simbolo = leitura.valor<uint32_t>();
+            if (simbolo >= nomes) return false;
+            node = alocarNo(N_ID, simbolos.nome(simbolo), {}, simbolo);
+        }
+        else {
+            Numero numero = kind == N_INTEIRO || kind == N_REAL ? leitura.valor<Numero>() : Numero{};
+            node = alocarNo(kind, lerTexto(), numero);
+        }
+        node->semantico = semantico;
+
+        if (pilha.empty()) {
+            *ast = node;
+        }
+        else {
+            Pendente& pai = pilha.back();
+            pai.node->children.dados[pai.preenchidos++] = node;
+            while (!pilha.empty() && pilha.back().preenchidos == pilha.back().node->children.tamanho) {
+                pilha.pop_back();
+            }
+        }
+        if (filhos > 0) {
+            node->children = { arenaArvore.alocarArray<ArvoreNode*>(filhos), filhos };
+            pilha.push_back({ node, 0 });
+        }
     }
+    return leitura.ok && *ast && pilha.empty() && leitura.posicao == corpo.size();
 }
 
-ArvoreNode* ExpressaoLogica() {
-    if (currentToken.token == T_OU) {
-        ArvoreNode* node = new ArvoreNode("OU", currentToken.lexema);
-        match(T_OU);
-        return node;
-    }
-    else if (currentToken.token == T_E) {
-        ArvoreNode* node = new ArvoreNode("E", currentToken.lexema);
-        match(T_E);
-        return node;
-    }
+// Descarta o estado da compilação anterior
+void Compilador::reiniciar(string_view fonte) {
+    input = fonte;
+    posicao = 0;
+    deslocamento = 0;
+    ultimosTokens.limpar();
+    estatisticas = Estatisticas();
+    firstComando = false;
+    tabelaDeSimbolos.limpar();
+    simbolos.limpar();
+    pilhaFilhos.clear();
+    arvorePlana.limpar();
+    arenaArvore.reiniciarPico();
 }
 
-ArvoreNode* ExpressaoAritimetica() {
+// Reinicia o estado e analisa 'fonte', devolvendo a árvore do programa
+ArvoreNode* Compilador::analisar(string_view fonte) {
+    reiniciar(fonte);
+    unsigned threads = threadsLexica(opcoes.threadsAnalise ? opcoes.threadsAnalise : max(1u, thread::hardware_concurrency()), fonte.size());
+    optional<LexicoParalelo> paralelo;
+    if (threads > 1) paralelo.emplace(*this, threads);
 
-    if (currentToken.token == T_MAIS) {
-        ArvoreNode* node = new ArvoreNode("MAIS", currentToken.lexema);
-        match(T_MAIS);
-        return node;
-    }
-    else if (currentToken.token == T_MENOS) {
-        ArvoreNode* node = new ArvoreNode("MENOS", currentToken.lexema);
-        match(T_MENOS);
-        return node;
-    }
-    else if (currentToken.token == T_MULT) {
-        ArvoreNode* node = new ArvoreNode("MULT", currentToken.lexema);
-        match(T_MULT);
-        return node;
-    }
-    else if (currentToken.token == T_DIV) {
-        ArvoreNode* node = new ArvoreNode("DIV", currentToken.lexema);
-        match(T_DIV);
-        return node;
+    nextStep();
+    ArvoreNode* ast = opcoes.parserTabela ? ProgramaTabela() : Programa();
+    if (paralelo) {
+        estatisticas.tempo[FASE_LEXICA] = paralelo->tempoTrabalho();
+        estatisticas.lexicaParalela = true;
     }
-}
 
-TokenValue getNextToken() {
-    TokenValue tok;
+    CronometroFase cronometro(estatisticas.tempo[FASE_SEMANTICA]);
+    verificarSemantica(ast);
+    return ast;
+}
 
-    // ignora espaços em branco
-    while (isspace(input[posicao])) posicao++;
+// Compila 'fonte' e grava em 'diretorio' os artefatos escolhidos em
+// opcoes.artefatos. Erros de compilação e de execução são impressos no console
+// e devolvidos no resultado.
+ResultadoCompilacao Compilador::compilar(string_view fonte, const string& diretorio) {
+    Relogio::time_point inicio = Relogio::now();
+    double* tempo = estatisticas.tempo;
+    ResultadoCompilacao resultado;
+    BufferSaida saidaJson;
+    saidaSintatica.limpar();
+    saidaSemantica.limpar();
+    saidaSimbolos.limpar();
+
+    auto falha = [this](const string& mensagem) {
+        console << mensagem << endl;
+        return ResultadoCompilacao{ false, mensagem };
+    };
+
+    // Num acerto do cache os artefatos vêm da entrada mapeada; a árvore só é
+    // reconstruída se ainda for executada ou traduzida para C. O rastro de
+    // todos os tokens precisa da análise, então desliga o cache.
+    CacheCompilacao cache(opcoes.diretorioCache, opcoes.limiteCache);
+    bool usarCache = !opcoes.diretorioCache.empty() && !(RASTRO_MAXIMO >= RASTRO_TOKENS && opcoes.rastro == RASTRO_TOKENS);
+    ChaveCache chave;
+    ArquivoFonte entradaCache;
+    string_view artefatos[NUM_ARTEFATOS];
+    uint64_t eliminados = 0;
+    bool acerto = false;
+    double tempoCache = 0;
+
+    try {
+        ArvoreNode* ast = nullptr;
+        if (usarCache) {
+            CronometroFase cronometro(tempoCache);
+            chave = chaveCache(fonte, opcoes);
+            string_view corpo;
+            acerto = cache.ler(chave, entradaCache, corpo) &&
+                     restaurarDoCache(corpo, fonte, artefatos, eliminados, opcoes.executar || opcoes.gerarC ? &ast : nullptr);
+            if (acerto && !ast) reiniciar(fonte);
+            estatisticas.cache = acerto ? CACHE_ACERTO : CACHE_FALTA;
+        }
 
-    if (posicao >= input.size()) {
-        tok.token = T_EOF;
-        printToken(tok);
-        return tok;
-    }
+        if (!acerto) {
+            // analisar() inclui a fase léxica e a semântica; imprimirRelatorio() desconta as duas
+            SituacaoCache situacao = estatisticas.cache;
+            Relogio::time_point inicioPrograma = Relogio::now();
+            ast = analisar(fonte);
+            tempo[FASE_SINTATICA] = chrono::duration<double>(Relogio::now() - inicioPrograma).count();
+            estatisticas.cache = situacao;
+        }
+        tempo[FASE_CACHE] += tempoCache;
 
-    if (isalpha(input[posicao])) {
-        tok.lexema = "";
-        while (isalpha(input[posicao])) {
-            tok.lexema += input[posicao];
-            posicao++;
+        if (opcoes.otimizar && acerto) {
+            console << "Otimização: " << eliminados << " nós eliminados" << endl;
         }
-        if (tok.lexema == "inteiro") {
-            tok.token = T_INTEIRO;
-            printToken(tok);
-            return { T_INTEIRO, tok.lexema };
+        else if (opcoes.otimizar) {
+            CronometroFase cronometro(tempo[FASE_OTIMIZACAO]);
+            eliminados = otimizar(ast);
+            console << "Otimização: " << eliminados << " nós eliminados" << endl;
+            if (opcoes.arvorePlana) {
+                arvorePlana.limpar();
+                reconstruirArvorePlana(ast);
+            }
         }
-        if (tok.lexema == "real") {
-            tok.token = T_REAL;
-            printToken(tok);
-            return { T_REAL, tok.lexema };
+
+        if (!acerto && (opcoes.artefatos & EMITIR_SEMANTICA)) {
+            CronometroFase cronometro(tempo[FASE_IMPRESSAO_SEMANTICA]);
+            printArvoreSemantica(ast);
         }
-        if (tok.lexema == "repita") {
-            tok.token = T_REPITA;
-            printToken(tok);
-            return { T_REPITA, tok.lexema };
+        if (!acerto && (opcoes.artefatos & EMITIR_SINTATICA)) {
+            CronometroFase cronometro(tempo[FASE_IMPRESSAO_SINTATICA]);
+            if (opcoes.arvorePlana) printArvoreSintaticaPlana(arvorePlana, saidaSintatica);
+            else printArvoreSintatica(ast, 0, saidaSintatica);
         }
-        if (tok.lexema == "enquanto") {
-            tok.token = T_ENQUANTO;
-            printToken(tok);
-            return { T_ENQUANTO, tok.lexema };
+        if (!acerto && (opcoes.artefatos & EMITIR_SIMBOLOS)) {
+            CronometroFase cronometro(tempo[FASE_IMPRESSAO_SIMBOLOS]);
+            printTabelaDeSimbolos();
         }
-        if (tok.lexema == "se") {
-            tok.token = T_SE;
-            printToken(tok);
-            return { T_SE, tok.lexema };
+        if (!acerto && (opcoes.artefatos & EMITIR_JSON)) {
+            CronometroFase cronometro(tempo[FASE_IMPRESSAO_JSON]);
+            printJson(ast, saidaJson);
         }
-        if (tok.lexema == "senao") {
-            tok.token = T_SENAO;
-            printToken(tok);
-            return { T_SENAO, tok.lexema };
+
+        if (!acerto) {
+            artefatos[0] = saidaSintatica.str();
+            artefatos[1] = saidaSemantica.str();
+            artefatos[2] = saidaSimbolos.str();
+            artefatos[3] = saidaJson.str();
         }
-        if (tok.lexema == "entao") {
-            tok.token = T_ENTAO;
-            printToken(tok);
-            return { T_ENTAO, tok.lexema };
+        if (usarCache && !acerto) {
+            CronometroFase cronometro(tempo[FASE_CACHE]);
+            string entrada = CacheCompilacao::iniciarEntrada(chave);
+            serializarParaCache(entrada, ast, eliminados, artefatos);
+            cache.gravar(chave, entrada);
         }
-        if (tok.lexema == "ate") {
-            tok.token = T_ATE;
-            printToken(tok);
-            return { T_ATE, tok.lexema };
+
+        if (opcoes.gerarC) {
+            CronometroFase cronometro(tempo[FASE_GERACAO_C]);
+            string c = gerarC(ast);
+            if (!gravarSaida(diretorio, "programa.c", c)) {
+                resultado = falha("Erro ao abrir o arquivo de saída do código C.");
+            }
         }
-        if (tok.lexema == "mostrar") {
-            tok.token = T_MOSTRAR;
-            printToken(tok);
-            return { T_MOSTRAR, tok.lexema };
+
+        if (resultado.sucesso && opcoes.executar) {
+            CronometroFase cronometro(tempo[FASE_EXECUCAO]);
+            Bytecode bc = gerarBytecode(ast);
+            string saida;
+            if (executar(bc, saida, console, *entrada) < 0) {
+                resultado = { false, "erro de execução" };
+            }
         }
-        if (tok.lexema == "ler") {
-            tok.token = T_LER;
-            printToken(tok);
-            return { T_LER, tok.lexema };
+
+        // A árvore inteira é descartada de uma vez
+        estatisticas.picoArvore = arenaArvore.pico();
+    }
+    catch (const ErroCompilacao& e) {
+        if (RASTRO_MAXIMO >= RASTRO_ERROS && opcoes.rastro == RASTRO_ERROS) {
+            console << "Últimos tokens lidos:" << '\n';
+            ultimosTokens.paraCada([this](const TokenValue& tok) { printToken(tok); });
         }
+        console << "Erro: " << e.mensagem << " na posição " << e.posicao << endl;
+        resultado = { false, e.mensagem };
+    }
 
-        tok.token = T_ID;
-        printToken(tok);
-        return { T_ID, tok.lexema };
+    // Mesmo com erro os arquivos são regravados, vazios, como antes
+    {
+        CronometroFase cronometro(tempo[FASE_GRAVACAO]);
+        auto gravar = [&](unsigned artefato, const char* nome, string_view dados, const char* mensagem) {
+            if ((opcoes.artefatos & artefato) && !gravarSaida(diretorio, nome, dados)) resultado = falha(mensagem);
+        };
+        gravar(EMITIR_SEMANTICA, "arvore_semantica.txt", artefatos[1], "Erro ao abrir o arquivo de saída da arvore semantica.");
+        gravar(EMITIR_SINTATICA, "arvore_sintatica.txt", artefatos[0], "Erro ao abrir o arquivo de saída da arvore sintatica.");
+        gravar(EMITIR_SIMBOLOS, "arvore_de_simbolos.txt", artefatos[2], "Erro ao abrir o arquivo de saída da tabela de simbolos.");
+        gravar(EMITIR_JSON, "arvore.json", artefatos[3], "Erro ao abrir o arquivo de saída arvore.json.");
     }
+    arenaArvore.liberar();
 
-    if (input[posicao] == '=') {
-        posicao++;
-        if (input[posicao] == '=') {
-            tok.token = T_IGUAL_IGUAL;
-            printToken(tok);
-            posicao++;
-            return { T_IGUAL_IGUAL, "==" };
-        }
-        tok.token = T_IGUAL;
-        printToken(tok);
-        return { T_IGUAL, "=" };
+    if (opcoes.relatorio != RELATORIO_NENHUM) {
+        imprimirRelatorio(chrono::duration<double>(Relogio::now() - inicio).count());
     }
+    return resultado;
+}
 
-    if (input[posicao] == '!') {
-        posicao++;
-        if (input[posicao] == '=') {
-            tok.token = T_DIFERENTE;
-            printToken(tok);
-            posicao++;
-            return { T_DIFERENTE, "!=" };
-        }
+// Compila sem nunca ter o programa inteiro na memória (--fluxo). A fonte é
+// lida em blocos, e cada comando do Corpo é analisado, verificado e impresso
+// antes do próximo ser lido; depois disso a sua subárvore e os blocos que só
+// ele usava são descartados. A memória fica limitada pelo maior comando, não
+// pelo programa. Os artefatos são os mesmos de compilar(), gravados aos poucos.
+ResultadoCompilacao Compilador::compilarEmFluxo(const string& caminho, const string& diretorio) {
+    Relogio::time_point inicio = Relogio::now();
+    double* tempo = estatisticas.tempo;
+    ResultadoCompilacao resultado;
+    BufferSaida saidaJson;
+    saidaSintatica.limpar();
+    saidaSemantica.limpar();
+    saidaSimbolos.limpar();
+
+    auto falha = [this](const string& mensagem) {
+        console << mensagem << endl;
+        return ResultadoCompilacao{ false, mensagem };
+    };
+
+    FonteEmFluxo fonte;
+    if (!fonte.abrir(caminho)) {
+        return falha("Erro ao ler o arquivo de entrada '" + caminho + "'.");
+    }
 
-        error("Token inesperado");
+    // Os buffers vão para os arquivos sempre que passam de LIMITE_BUFFER
+    const size_t LIMITE_BUFFER = 1 << 20;
+    struct ArquivoEmFluxo {
+        unsigned artefato;
+        const char* nome;
+        BufferSaida& buffer;
+        const char* mensagem;
+        FILE* arquivo;
+    };
+    ArquivoEmFluxo arquivos[] = {
+        { EMITIR_SEMANTICA, "arvore_semantica.txt", saidaSemantica, "Erro ao abrir o arquivo de saída da arvore semantica.", nullptr },
+        { EMITIR_SINTATICA, "arvore_sintatica.txt", saidaSintatica, "Erro ao abrir o arquivo de saída da arvore sintatica.", nullptr },
+        { EMITIR_SIMBOLOS, "arvore_de_simbolos.txt", saidaSimbolos, "Erro ao abrir o arquivo de saída da tabela de simbolos.", nullptr },
+        { EMITIR_JSON, "arvore.json", saidaJson, "Erro ao abrir o arquivo de saída arvore.json.", nullptr },
+    };
+    for (ArquivoEmFluxo& a : arquivos) {
+        if (!(opcoes.artefatos & a.artefato)) continue;
+        a.arquivo = fopen((diretorio + "/" + a.nome).c_str(), "wb");
+        if (!a.arquivo) resultado = falha(a.mensagem);
     }
+    auto despejar = [&](size_t minimo) {
+        CronometroFase cronometro(tempo[FASE_GRAVACAO]);
+        for (ArquivoEmFluxo& a : arquivos) {
+            if (!a.arquivo || a.buffer.str().size() < minimo) continue;
+            if (fwrite(a.buffer.str().data(), 1, a.buffer.str().size(), a.arquivo) != a.buffer.str().size()) {
+                resultado = falha(a.mensagem);
+            }
+            estatisticas.bytesGravados += a.buffer.str().size();
+            a.buffer.limpar();
+        }
+    };
+
+    reiniciar({});
+    fluxo = &fonte;
+    simbolos.copiarNomes(true);
+    ContextoSemantico contexto;
+
+    try {
+        if (!resultado.sucesso) throw ErroCompilacao{ resultado.erro, 0 };
+
+        ArvoreNode* decl;
+        {
+            CronometroFase cronometro(tempo[FASE_SINTATICA]);
+            nextStep();
+            decl = Declaracao();
+            if (!iniciaComando(currentToken.token)) {
+                error("Esperado corpo do programa");
+            }
+        }
 
+        // Cabeçalho das árvores: o Programa com a Decl e um Comando ainda sem filhos.
+        // Os comandos vêm depois, um a um, na profundidade que teriam nele.
+        auto comFilhos = [this](ArvoreNode* node, initializer_list<ArvoreNode*> filhos) {
+            node->children.dados = arenaArvore.alocarArray<ArvoreNode*>(filhos.size());
+            node->children.tamanho = (uint32_t)filhos.size();
+            copy(filhos.begin(), filhos.end(), node->children.dados);
+            return node;
+        };
+        ArvoreNode* corpo = comFilhos(alocarNo(N_CORPO), { alocarNo(N_COMANDO) });
+        ArvoreNode* programa = comFilhos(alocarNo(N_PROGRAMA), { decl, corpo });
+        const int PROFUNDIDADE_COMANDO = 3;
+
+        if (opcoes.artefatos & EMITIR_SEMANTICA) {
+            CronometroFase cronometro(tempo[FASE_IMPRESSAO_SEMANTICA]);
+            printArvoreSemantica(programa);
+        }
+        if (opcoes.artefatos & EMITIR_SINTATICA) {
+            CronometroFase cronometro(tempo[FASE_IMPRESSAO_SINTATICA]);
+            printArvoreSintatica(programa, 0, saidaSintatica);
+        }
+        if (opcoes.artefatos & EMITIR_JSON) {
+            CronometroFase cronometro(tempo[FASE_IMPRESSAO_JSON]);
+            saidaJson << "{\"arvore\":{\"no\":\"" << nomeNodeKind[N_PROGRAMA] << "\",\"filhos\":[";
+            printArvoreJson(decl, saidaJson);
+            saidaJson << ",{\"no\":\"" << nomeNodeKind[N_CORPO] << "\",\"filhos\":[{\"no\":\"" << nomeNodeKind[N_COMANDO] << "\",\"filhos\":[";
+        }
+        arenaArvore.reaproveitar();
 
-    if (isdigit(input[posicao]) || (input[posicao] == '-' && isdigit(input[posicao + 1]))) {
-        bool isNegative = false;
-        bool isReal = false;
-        tok.lexema = "";
+        for (bool primeiro = true; iniciaComando(currentToken.token); primeiro = false) {
+            ArvoreNode* comando;
+            {
+                // Como em compilar(), a sintática inclui a léxica e a semântica
+                CronometroFase cronometro(tempo[FASE_SINTATICA]);
+                comando = Instrucao();
+                CronometroFase cronometroSemantica(tempo[FASE_SEMANTICA]);
+                verificarComandos(contexto, &comando, &comando + 1);
+            }
 
+            if (opcoes.artefatos & EMITIR_SEMANTICA) {
+                CronometroFase cronometro(tempo[FASE_IMPRESSAO_SEMANTICA]);
+                printArvoreSemantica(comando, PROFUNDIDADE_COMANDO);
+            }
+            if (opcoes.artefatos & EMITIR_SINTATICA) {
+                CronometroFase cronometro(tempo[FASE_IMPRESSAO_SINTATICA]);
+                printArvoreSintatica(comando, PROFUNDIDADE_COMANDO, saidaSintatica);
+            }
+            if (opcoes.artefatos & EMITIR_JSON) {
+                CronometroFase cronometro(tempo[FASE_IMPRESSAO_JSON]);
+                if (!primeiro) saidaJson << ',';
+                printArvoreJson(comando, saidaJson);
+            }
+            despejar(LIMITE_BUFFER);
 
-        if (input[posicao] == '-') {
-            isNegative = true;
-            tok.lexema += "-";
-            posicao++;
+            arenaArvore.reaproveitar();
+            fonte.descartar(inicioRetido());
         }
 
-        tok.value = 0;
-        while (isdigit(input[posicao])) {
+        if (currentToken.token != T_EOF) {
+            error("Esperado EOF no final do programa");
+        }
 
-            tok.lexema += input[posicao];
-            tok.value = tok.value * 10 + (input[posicao] - '0');
-            posicao++;
+        if (opcoes.artefatos & EMITIR_SIMBOLOS) {
+            CronometroFase cronometro(tempo[FASE_IMPRESSAO_SIMBOLOS]);
+            printTabelaDeSimbolos();
         }
-        if (input[posicao] == '.') {
-            isReal = true;
-            tok.lexema += ".";
-            posicao++;
+        if (opcoes.artefatos & EMITIR_JSON) {
+            CronometroFase cronometro(tempo[FASE_IMPRESSAO_JSON]);
+            saidaJson << "]}]}]}";
+            printSimbolosJson(saidaJson);
         }
-        while (isdigit(input[posicao])) {
-            tok.lexema += input[posicao];
-            //tok.value = tok.value * 10 + ((input[posicao] - '0') / 10);
-            posicao++;
+        despejar(0);
+
+        estatisticas.picoArvore = arenaArvore.pico();
+        estatisticas.picoFonte = fonte.pico();
+    }
+    catch (const ErroCompilacao& e) {
+        if (resultado.sucesso) {
+            if (RASTRO_MAXIMO >= RASTRO_ERROS && opcoes.rastro == RASTRO_ERROS) {
+                console << "Últimos tokens lidos:" << '\n';
+                ultimosTokens.paraCada([this](const TokenValue& tok) { printToken(tok); });
+            }
+            console << "Erro: " << e.mensagem << " na posição " << e.posicao << endl;
+            resultado = { false, e.mensagem };
         }
-        tok.value = stod(tok.lexema);
-        tok.token = isReal ? T_NUM_REAL : T_NUM_INTEIRO;
+    }
+    tabelaDeSimbolos.somarConsultas(contexto.consultas);
 
-        printToken(tok);
+    // Com erro os arquivos ficam vazios, como em compilar()
+    for (ArquivoEmFluxo& a : arquivos) {
+        if (!a.arquivo) continue;
+        if (fclose(a.arquivo) != 0 && resultado.sucesso) resultado = falha(a.mensagem);
+        if (!resultado.sucesso) gravarArquivo(diretorio + "/" + a.nome, {});
+    }
+    fluxo = nullptr;
+    arenaArvore.liberar();
 
-        // inverte o valor do token
-        isNegative ? tok.value = -tok.value : NULL;
-        return tok;
+    if (opcoes.relatorio != RELATORIO_NENHUM) {
+        imprimirRelatorio(chrono::duration<double>(Relogio::now() - inicio).count());
     }
+    return resultado;
+}
 
-    if (input[posicao] == '+') { tok.token = T_MAIS; tok.lexema = "+"; printToken(tok); posicao++; return tok; }
-    if (input[posicao] == '-') { tok.token = T_MENOS; tok.lexema = "-"; printToken(tok); posicao++; return tok; }
-    if (input[posicao] == '*') { tok.token = T_MULT; tok.lexema = "*"; printToken(tok); posicao++; return tok; }
-    if (input[posicao] == '/') { tok.token = T_DIV; tok.lexema = "/"; printToken(tok); posicao++; return tok; }
-    if (input[posicao] == '>') { tok.token = T_MAIOR; tok.lexema = ">"; printToken(tok); posicao++; return tok; }
-    if (input[posicao] == '>=') { tok.token = T_MAIOR_IGUAL; tok.lexema = ">="; printToken(tok); posicao++; return tok; }
-    if (input[posicao] == '<') { tok.token = T_MENOR; tok.lexema = "<"; printToken(tok); posicao++; return tok; }
-    if (input[posicao] == '<=') { tok.token = T_MENOR_IGUAL; tok.lexema = "<="; printToken(tok); posicao++; return tok; }
-    if (input[posicao] == '&&') { tok.token = T_E; tok.lexema = "&&"; printToken(tok); posicao++; return tok; }
-    if (input[posicao] == '||') { tok.token = T_OU; tok.lexema = "||"; printToken(tok); posicao++; return tok; }
-    if (input[posicao] == ';') { tok.token = T_PONTO_VIRGULA; tok.lexema = ";"; printToken(tok); posicao++; return tok; }
-    if (input[posicao] == ',') { tok.token = T_VIRGULA; tok.lexema = ","; printToken(tok); posicao++; return tok; }
-    if (input[posicao] == '{') { tok.token = T_ABRE_CHAVES; tok.lexema = "{"; printToken(tok); posicao++; return tok; }
-    if (input[posicao] == '}') { tok.token = T_FECHA_CHAVES; tok.lexema = "}"; printToken(tok); posicao++; return tok; }
-    if (input[posicao] == '(') { tok.token = T_ABRE_PARENTESES; tok.lexema = "("; printToken(tok); posicao++; return tok; }
-    if (input[posicao] == ')') { tok.token = T_FECHA_PARENTESES; tok.lexema = ")"; printToken(tok); posicao++; return tok; }
+bool Compilador::gravarSaida(const string& diretorio, const char* nome, string_view dados) {
+    estatisticas.bytesGravados += dados.size();
+    if (arquivosEmMemoria) {
+        arquivosEmMemoria->emplace_back(nome, dados);
+        return true;
+    }
+    return gravarArquivo(diretorio + "/" + nome, dados);
+}
 
+// Imprime o tempo de cada fase e os contadores, em tabela ou JSON. A fase
+// léxica é estimada por amostragem e descontada da sintática, como a
+// semântica; lida por LexicoParalelo, ela é a soma do tempo das threads, que
+// corre ao lado da sintática.
+void Compilador::imprimirRelatorio(double total) {
+    double tempo[NUM_FASES];
+    copy(begin(estatisticas.tempo), end(estatisticas.tempo), tempo);
+    if (!estatisticas.lexicaParalela) {
+        tempo[FASE_LEXICA] = estatisticas.lexica.estimativa();
+        tempo[FASE_SINTATICA] -= tempo[FASE_LEXICA];
+    }
+    tempo[FASE_SINTATICA] = max(0.0, tempo[FASE_SINTATICA] - tempo[FASE_SEMANTICA]);
 
+    uint64_t tokens = estatisticas.lexica.chamadas;
+    char linha[160];
 
-    // Caractere desconhecido
-    tok.token = T_UNKNOWN;
-    tok.lexema = "desconhecido";
-    //printToken(tok);
-    posicao++;
-    return tok;
+    if (opcoes.relatorio == RELATORIO_JSON) {
+        console << "{\"fases_ms\":{";
+        for (int f = 0; f < NUM_FASES; f++) {
+            snprintf(linha, sizeof(linha), "%s\"%s\":%.3f", f > 0 ? "," : "", nomeFaseCompilacao[f], tempo[f] * 1000);
+            console << linha;
+        }
+        snprintf(linha, sizeof(linha), "},\"total_ms\":%.3f", total * 1000);
+        console << linha << ",\"tokens\":" << tokens << ",\"nos\":" << estatisticas.nos
+                << ",\"consultas_tabela\":" << tabelaDeSimbolos.totalConsultas()
+                << ",\"insercoes_tabela\":" << tabelaDeSimbolos.totalInsercoes()
+                << ",\"bytes_gravados\":" << estatisticas.bytesGravados
+                << ",\"pico_arvore_bytes\":" << estatisticas.picoArvore;
+        if (estatisticas.picoFonte) console << ",\"pico_fonte_bytes\":" << estatisticas.picoFonte;
+        console << ",\"cache\":\"" << nomeSituacaoCache[estatisticas.cache] << "\"}" << endl;
+        return;
+    }
+
+    console << "Relatório de fases" << '\n';
+    snprintf(linha, sizeof(linha), "  %-22s %12s %7s", "fase", "tempo (ms)", "%");
+    console << linha << '\n';
+    for (int f = 0; f < NUM_FASES; f++) {
+        if (tempo[f] == 0) continue;
+        const char* nota = f != FASE_LEXICA ? "" : estatisticas.lexicaParalela ? "  (soma das threads)" : "  (amostrada)";
+        snprintf(linha, sizeof(linha), "  %-22s %12.3f %6.1f%%%s", nomeFaseCompilacao[f], tempo[f] * 1000,
+                 total > 0 ? tempo[f] / total * 100 : 0, nota);
+        console << linha << '\n';
+    }
+    snprintf(linha, sizeof(linha), "  %-22s %12.3f", "total", total * 1000);
+    console << linha << '\n';
+    console << "  tokens: " << tokens << ", nós: " << estatisticas.nos
+            << ", consultas à tabela: " << tabelaDeSimbolos.totalConsultas()
+            << ", inserções na tabela: " << tabelaDeSimbolos.totalInsercoes()
+            << ", bytes gravados: " << estatisticas.bytesGravados;
+    if (estatisticas.cache != CACHE_DESLIGADO) console << ", cache: " << nomeSituacaoCache[estatisticas.cache];
+    console << '\n';
+    console << "  memória: pico de " << estatisticas.picoArvore << " bytes da árvore";
+    if (estatisticas.picoFonte) console << ", pico de " << estatisticas.picoFonte << " bytes da fonte";
+    console << endl;
 }
 
+// Compila os arquivos em paralelo, um Compilador por fonte, em 'threads'
+// trabalhadores que pegam a próxima fonte da fila. As árvores de cada fonte vão
+// para '<fonte>.saida' e o console de cada uma é impresso inteiro quando ela termina.
+int compilarEmLote(const vector<string>& fontes, const OpcoesCompilacao& opcoesLote, unsigned threads) {
+    // As threads já estão divididas entre os arquivos
+    OpcoesCompilacao opcoes = opcoesLote;
+    opcoes.threadsAnalise = 1;
+
+    atomic<size_t> proxima{ 0 };
+    atomic<size_t> falhas{ 0 };
+    mutex travaConsole;
+
+    auto trabalhador = [&]() {
+        for (size_t i = proxima++; i < fontes.size(); i = proxima++) {
+            const string& caminho = fontes[i];
+            ostringstream console;
+            ArquivoFonte fonte;
+            if (!abrirFonte(caminho, fonte)) {
+                console << "Erro ao ler o arquivo de entrada '" << caminho << "'." << endl;
+                falhas++;
+            }
+            else {
+                string diretorio = caminho + ".saida";
+                error_code erro;
+                filesystem::create_directories(diretorio, erro);
 
-// Função para exibir os tokens
-void printToken(TokenValue tok) {
-    switch (tok.token) {
-    case T_INTEIRO: cout << "Token: T_INTEIRO, " << tok.lexema << endl; break;
-    case T_REAL: cout << "Token: T_REAL, " << tok.lexema << endl; break;
-    case T_REPITA: cout << "Token: T_REPITA, " << tok.lexema << endl; break;
-    case T_ENQUANTO: cout << "Token: T_ENQUANTO, " << tok.lexema << endl; break;
-    case T_SE: cout << "Token: T_SE, " << tok.lexema << endl; break;
-    case T_SENAO: cout << "Token: T_SENAO, " << tok.lexema << endl; break;
-    case T_ENTAO: cout << "Token: T_ENTAO, " << tok.lexema << endl; break;
-    case T_ATE: cout << "Token: T_ATE, " << tok.lexema << endl; break;
-    case T_MOSTRAR: cout << "Token: T_MOSTRAR, " << tok.lexema << endl; break;
-    case T_LER: cout << "Token: T_LER, " << tok.lexema << endl; break;
-    case T_ID: cout << "Token: T_ID, " << tok.lexema << endl; break;
-    //case T_NUM: cout << "Token: T_NUM, " << tok.lexema << ", Valor: " << tok.value << endl; break;
-    case T_NUM_REAL: cout << "Token: T_NUM_REAL, " << tok.lexema << ", Valor: " << tok.value << endl; break;
-    case T_NUM_INTEIRO: cout << "Token: T_NUM_INTEIRO, " << tok.lexema << ", Valor: " << tok.value << endl; break;
-    case T_IGUAL: cout << "Token: T_IGUAL, " << tok.lexema << endl; break;
-    case T_IGUAL_IGUAL: cout << "Token: T_IGUAL_IGUAL, " << tok.lexema << endl; break;
-    case T_DIFERENTE: cout << "Token: T_DIFERENTE, " << tok.lexema << endl; break;
-    case T_MAIS: cout << "Token: T_MAIS, " << tok.lexema << endl; break;
-    case T_MENOS: cout << "Token: T_MENOS, " << tok.lexema << endl; break;
-    case T_MULT: cout << "Token: T_MULT, " << tok.lexema << endl; break;
-    case T_DIV: cout << "Token: T_DIV, " << tok.lexema << endl; break;
-    case T_MAIOR: cout << "Token: T_MAIOR, " << tok.lexema << endl; break;
-    case T_MAIOR_IGUAL: cout << "Token: T_MAIOR_IGUAL, " << tok.lexema << endl; break;
-    case T_MENOR: cout << "Token: T_MENOR, " << tok.lexema << endl; break;
-    case T_MENOR_IGUAL: cout << "Token: T_MENOR_IGUAL, " << tok.lexema << endl; break;
-    case T_OU: cout << "Token: T_OU, " << tok.lexema << endl; break;
-    case T_E: cout << "Token: T_E, " << tok.lexema << endl; break;
-    case T_ABRE_CHAVES: cout << "Token: T_ABRE_CHAVES, " << tok.lexema << endl; break;
-    case T_FECHA_CHAVES: cout << "Token: T_FECHA_CHAVES, " << tok.lexema << endl; break;
-    case T_ABRE_PARENTESES: cout << "Token: T_ABRE_PARENTESES, " << tok.lexema << endl; break;
-    case T_FECHA_PARENTESES: cout << "Token: T_FECHA_PARENTESES, " << tok.lexema << endl; break;
-    case T_PONTO_VIRGULA: cout << "Token: T_PONTO_VIRGULA, " << tok.lexema << endl; break;
-    case T_VIRGULA: cout << "Token: T_VIRGULA, " << tok.lexema << endl; break;
-    case T_EOF: cout << "Token: T_EOF" << endl; break;
-    case T_UNKNOWN: cout << "Token: T_UNKNOWN, " << tok.lexema << endl; break;
-    }
-}
-
-
-int main() {
-    cout << "Digite o código de entrada (insira 'FIM' para finalizar):" << endl;
+                Compilador compilador(opcoes, console);
+                if (!compilador.compilar(fonte.conteudo, diretorio).sucesso) falhas++;
+            }
 
-    string line;
-    input = "";
+            lock_guard<mutex> trava(travaConsole);
+            cout << "== " << caminho << " ==" << endl << console.str();
+        }
+    };
 
-    while (true) {
-        getline(cin, line);
-        if (line == "FIM") break;
-        input += line + "\n";
+    vector<thread> trabalhadores;
+    for (unsigned t = 1; t < threads; t++) {
+        trabalhadores.emplace_back(trabalhador);
+    }
+    trabalhador();
+    for (thread& t : trabalhadores) {
+        t.join();
     }
 
-    cout << endl << endl << endl << endl;
+    return falhas > 0 ? 1 : 0;
+}
+
+// Modo servidor (--servidor): o compilador fica residente e atende pedidos num
+// soquete Unix local, cada conexão na sua thread e com o seu Compilador, com um
+// número limitado de conexões ao mesmo tempo. Cada mensagem é um quadro, o
+// tamanho em 8 bytes (no máximo TAMANHO_MAXIMO_QUADRO) seguido do conteúdo, e
+// uma conexão pode mandar vários pedidos em sequência.
+//   pedido:   versão (u32), opções (u32, bits PEDIDO_*), artefatos (u32),
+//             rastro (u8), relatório (u8), fonte (texto) e os valores de 'ler()' (texto)
+//   resposta: sucesso (u8), console (texto), número de arquivos (u32) e, para
+//             cada um, nome (texto) e conteúdo (texto)
+// Um texto é o tamanho em 8 bytes seguido dos bytes. Os arquivos voltam na
+// resposta e quem grava é o cliente (compiladores_cliente).
+constexpr uint32_t VERSAO_PROTOCOLO = 1;
+constexpr uint64_t TAMANHO_MAXIMO_QUADRO = 256ull << 20;
+
+enum OpcaoPedido : uint32_t {
+    PEDIDO_EXECUTAR = 1 << 0,
+    PEDIDO_OTIMIZAR = 1 << 1,
+    PEDIDO_GERAR_C = 1 << 2,
+    PEDIDO_ARVORE_PLANA = 1 << 3,
+    PEDIDO_PARSER_ITERATIVO = 1 << 4,
+    PEDIDO_PARSER_TABELA = 1 << 5,
+};
+
+struct RespostaServidor {
+    bool sucesso = false;
+    string console;
+    vector<pair<string, string>> arquivos;
+};
+
+// Soquete de --servidor e do cliente quando --soquete não é dado
+string caminhoSoquetePadrao() {
+    if (const char* runtime = getenv("XDG_RUNTIME_DIR"); runtime && *runtime) return string(runtime) + "/compiladores.sock";
+#ifndef _WIN32
+    return "/tmp/compiladores-" + to_string(getuid()) + ".sock";
+#else
+    return "compiladores.sock";
+#endif
+}
+
+#ifndef _WIN32
+bool lerTudo(int fd, char* destino, size_t tamanho) {
+    while (tamanho > 0) {
+        ssize_t n = read(fd, destino, tamanho);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        destino += n;
+        tamanho -= (size_t)n;
+    }
+    return true;
+}
+
+bool escreverTudo(int fd, const char* dados, size_t tamanho) {
+    while (tamanho > 0) {
+        ssize_t n = write(fd, dados, tamanho);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        dados += n;
+        tamanho -= (size_t)n;
+    }
+    return true;
+}
+
+// Um quadro é montado com espaço para o tamanho no início, para sair numa escrita só
+void iniciarQuadro(string& quadro) {
+    quadro.assign(sizeof(uint64_t), '\0');
+}
+
+bool enviarQuadro(int fd, string& quadro) {
+    uint64_t tamanho = quadro.size() - sizeof(uint64_t);
+    memcpy(&quadro[0], &tamanho, sizeof(tamanho));
+    return escreverTudo(fd, quadro.data(), quadro.size());
+}
+
+// O conteúdo é lido em blocos e a memória cresce com o que chega, então um
+// tamanho falso no cabeçalho não reserva nada sozinho
+bool lerQuadro(int fd, string& quadro) {
+    uint64_t tamanho;
+    if (!lerTudo(fd, (char*)&tamanho, sizeof(tamanho)) || tamanho > TAMANHO_MAXIMO_QUADRO) return false;
+    quadro.clear();
+    while (quadro.size() < tamanho) {
+        size_t lidos = quadro.size();
+        size_t bloco = (size_t)min<uint64_t>(tamanho - lidos, 1 << 20);
+        quadro.resize(lidos + bloco);
+        if (!lerTudo(fd, &quadro[lidos], bloco)) return false;
+    }
+    return true;
+}
+
+int conectarSoquete(const string& caminho) {
+    sockaddr_un endereco{};
+    if (caminho.size() >= sizeof(endereco.sun_path)) return -1;
+    endereco.sun_family = AF_UNIX;
+    memcpy(endereco.sun_path, caminho.c_str(), caminho.size() + 1);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, (const sockaddr*)&endereco, sizeof(endereco)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Atende os pedidos de uma conexão até o cliente fechá-la
+void atenderConexao(int fd, OpcoesCompilacao base) {
+    ostringstream console;
+    Compilador compilador(base, console);
+    vector<pair<string, string>> arquivos;
+    compilador.arquivosEmMemoria = &arquivos;
+    string pedido, resposta;
+
+    while (lerQuadro(fd, pedido)) {
+        LeituraBinaria leitura{ pedido };
+        uint32_t versao = leitura.valor<uint32_t>();
+        uint32_t opcoesPedido = leitura.valor<uint32_t>();
+        OpcoesCompilacao& opcoes = compilador.opcoes;
+        opcoes = base;
+        opcoes.artefatos = leitura.valor<uint32_t>();
+        opcoes.rastro = (NivelRastro)min<uint8_t>(leitura.valor<uint8_t>(), RASTRO_TOKENS);
+        opcoes.relatorio = (FormatoRelatorio)min<uint8_t>(leitura.valor<uint8_t>(), RELATORIO_JSON);
+        string_view fonte = leitura.texto();
+        istringstream entrada(string(leitura.texto()));
+        if (!leitura.ok || versao != VERSAO_PROTOCOLO) break;
+
+        opcoes.executar = opcoesPedido & PEDIDO_EXECUTAR;
+        opcoes.otimizar = opcoesPedido & PEDIDO_OTIMIZAR;
+        opcoes.gerarC = opcoesPedido & PEDIDO_GERAR_C;
+        opcoes.arvorePlana = opcoesPedido & PEDIDO_ARVORE_PLANA;
+        opcoes.parserIterativo = opcoesPedido & PEDIDO_PARSER_ITERATIVO;
+        opcoes.parserTabela = opcoesPedido & PEDIDO_PARSER_TABELA;
+        compilador.entrada = &entrada;
+        console.str("");
+        console.clear();
+        arquivos.clear();
+
+        bool sucesso = compilador.compilar(fonte, "").sucesso;
+
+        iniciarQuadro(resposta);
+        escreverBinario(resposta, (uint8_t)sucesso);
+        escreverTexto(resposta, console.str());
+        escreverBinario(resposta, (uint32_t)arquivos.size());
+        for (const auto& [nome, conteudo] : arquivos) {
+            escreverTexto(resposta, nome);
+            escreverTexto(resposta, conteudo);
+        }
+        if (!enviarQuadro(fd, resposta)) break;
+    }
+    close(fd);
+}
+
+// Apaga o soquete quando o servidor é interrompido
+char soqueteServidor[sizeof(sockaddr_un::sun_path)];
+
+extern "C" void encerrarServidor(int sinal) {
+    unlink(soqueteServidor);
+    signal(sinal, SIG_DFL);
+    raise(sinal);
+}
+
+// Conexões atendidas ao mesmo tempo, cada uma na sua thread. As outras esperam
+// na fila do listen() até uma terminar.
+struct VagasConexao {
+    mutex trava;
+    condition_variable liberada;
+    unsigned ocupadas = 0;
+    unsigned limite = max(4u, 2 * thread::hardware_concurrency());
+
+    void ocupar() {
+        unique_lock<mutex> bloqueio(trava);
+        liberada.wait(bloqueio, [this] { return ocupadas < limite; });
+        ocupadas++;
+    }
+
+    void liberar() {
+        {
+            lock_guard<mutex> bloqueio(trava);
+            ocupadas--;
+        }
+        liberada.notify_one();
+    }
+};
 
-    outputSemFile.open("./arvore_semantica.txt");
-    outputSintFile.open("./arvore_sintatica.txt");
-    outputASFile.open("./arvore_de_simbolos.txt");
+VagasConexao vagasConexao;
+#endif
+
+// Manda um pedido pela conexão 'fd' e espera a resposta
+bool pedirCompilacao(int fd, const OpcoesCompilacao& opcoes, string_view fonte, string_view entrada, RespostaServidor& resposta) {
+#ifndef _WIN32
+    uint32_t opcoesPedido = (opcoes.executar ? (uint32_t)PEDIDO_EXECUTAR : 0u) |
+                            (opcoes.otimizar ? (uint32_t)PEDIDO_OTIMIZAR : 0u) |
+                            (opcoes.gerarC ? (uint32_t)PEDIDO_GERAR_C : 0u) |
+                            (opcoes.arvorePlana ? (uint32_t)PEDIDO_ARVORE_PLANA : 0u) |
+                            (opcoes.parserIterativo ? (uint32_t)PEDIDO_PARSER_ITERATIVO : 0u) |
+                            (opcoes.parserTabela ? (uint32_t)PEDIDO_PARSER_TABELA : 0u);
+    string quadro;
+    iniciarQuadro(quadro);
+    escreverBinario(quadro, VERSAO_PROTOCOLO);
+    escreverBinario(quadro, opcoesPedido);
+    escreverBinario(quadro, (uint32_t)opcoes.artefatos);
+    escreverBinario(quadro, (uint8_t)opcoes.rastro);
+    escreverBinario(quadro, (uint8_t)opcoes.relatorio);
+    escreverTexto(quadro, fonte);
+    escreverTexto(quadro, entrada);
+    if (!enviarQuadro(fd, quadro) || !lerQuadro(fd, quadro)) return false;
+
+    LeituraBinaria leitura{ quadro };
+    resposta.sucesso = leitura.valor<uint8_t>() != 0;
+    resposta.console = leitura.texto();
+    uint32_t arquivos = leitura.valor<uint32_t>();
+    if (!leitura.ok || arquivos > NUM_ARTEFATOS + 1) return false;
+    resposta.arquivos.resize(arquivos);
+    for (auto& [nome, conteudo] : resposta.arquivos) {
+        nome = leitura.texto();
+        conteudo = leitura.texto();
+    }
+    return leitura.ok;
+#else
+    return false;
+#endif
+}
 
-    if (!outputSemFile.is_open()) {
-        cout << "Erro ao abrir o arquivo de saída da arvore semantica." << endl;
+int executarServidor(const string& caminho, const OpcoesCompilacao& opcoes) {
+#ifndef _WIN32
+    signal(SIGPIPE, SIG_IGN);
+    sockaddr_un endereco{};
+    if (caminho.size() >= sizeof(endereco.sun_path)) {
+        cout << "Caminho do soquete longo demais: " << caminho << endl;
         return 1;
     }
+    endereco.sun_family = AF_UNIX;
+    memcpy(endereco.sun_path, caminho.c_str(), caminho.size() + 1);
+
+    // Um soquete que ninguém atende sobrou de um servidor que terminou sem apagá-lo
+    int outro = conectarSoquete(caminho);
+    if (outro >= 0) {
+        close(outro);
+        cout << "Já existe um servidor em " << caminho << endl;
+        return 1;
+    }
+    unlink(caminho.c_str());
 
-    if (!outputSintFile.is_open()) {
-        cout << "Erro ao abrir o arquivo de saída da arvore sintatica." << endl;
+    int servidor = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (servidor < 0 || bind(servidor, (const sockaddr*)&endereco, sizeof(endereco)) != 0 || listen(servidor, SOMAXCONN) != 0) {
+        cout << "Erro ao abrir o soquete " << caminho << ": " << strerror(errno) << endl;
         return 1;
     }
+    chmod(caminho.c_str(), 0600);
+    memcpy(soqueteServidor, endereco.sun_path, sizeof(soqueteServidor));
+    signal(SIGINT, encerrarServidor);
+    signal(SIGTERM, encerrarServidor);
+    cout << "Servidor ouvindo em " << caminho << endl;
+
+    for (;;) {
+        vagasConexao.ocupar();
+        int conexao = accept(servidor, nullptr, nullptr);
+        if (conexao < 0) {
+            vagasConexao.liberar();
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            cout << "Erro ao aceitar conexão: " << strerror(errno) << endl;
+            break;
+        }
+        thread([conexao, opcoes] {
+            atenderConexao(conexao, opcoes);
+            vagasConexao.liberar();
+        }).detach();
+    }
+    close(servidor);
+    unlink(caminho.c_str());
+    return 1;
+#else
+    cout << "O modo servidor usa soquetes Unix e não está disponível no Windows." << endl;
+    return 1;
+#endif
+}
+
+// Compila 'fonte' no servidor e grava os arquivos da resposta em 'diretorio'.
+// Retorna -1 sem nada impresso se não houver servidor, para quem chamou
+// compilar localmente; senão, o código de saída.
+int compilarNoServidor(const string& soquete, const OpcoesCompilacao& opcoes, string_view fonte, string_view entrada, const string& diretorio) {
+#ifndef _WIN32
+    signal(SIGPIPE, SIG_IGN);
+    int fd = conectarSoquete(soquete);
+    if (fd < 0) return -1;
+    RespostaServidor resposta;
+    bool ok = pedirCompilacao(fd, opcoes, fonte, entrada, resposta);
+    close(fd);
+    if (!ok) return -1;
+
+    cout << resposta.console << flush;
+    for (const auto& [nome, conteudo] : resposta.arquivos) {
+        if (nome.find('/') != string::npos || nome.find("..") != string::npos) continue;
+        if (!gravarArquivo(diretorio + "/" + nome, conteudo)) {
+            cout << "Erro ao gravar '" << nome << "'." << endl;
+            return 1;
+        }
+    }
+    return resposta.sucesso ? 0 : 1;
+#else
+    return -1;
+#endif
+}
+
+#ifdef COMPILADORES_BENCH
+// Memória máxima (RSS) da compilação normal e da --fluxo com fontes de 4 MB
+// até 'maximo', quadruplicando. Cada compilação roda num processo filho, que
+// tem o seu próprio pico; a fonte é 'teste 1' repetido, gravada aos poucos para
+// o benchmark não crescer junto. A compilação normal só vai até LIMITE_NORMAL.
+int benchFluxo(size_t maximo) {
+#ifndef _WIN32
+    const size_t LIMITE_NORMAL = 64 << 20;
+    filesystem::path base = filesystem::temp_directory_path() / ("bench-fluxo-" + to_string(getpid()));
+    filesystem::create_directories(base);
+    string caminho = (base / "fonte.txt").string();
+
+    string trecho;
+    while (trecho.size() < (1 << 20)) trecho += teste1Corpo;
+
+    // Pico em KB, tempo e hash das árvores gravadas; pico negativo se falhou
+    struct Medida {
+        long pico = -1;
+        double segundos = 0;
+        uint64_t hash[2] = { 0, 1 };
+    };
+    auto medir = [&](bool fluxo) {
+        Medida medida;
+        string diretorio = (base / (fluxo ? "fluxo" : "normal")).string();
+        filesystem::create_directories(diretorio);
+        Relogio::time_point inicio = Relogio::now();
+        pid_t filho = fork();
+        if (filho == 0) {
+            ostream nulo(nullptr);
+            OpcoesCompilacao opcoes;
+            opcoes.rastro = RASTRO_NENHUM;
+            Compilador c(opcoes, nulo);
+            bool ok;
+            if (fluxo) {
+                ok = c.compilarEmFluxo(caminho, diretorio).sucesso;
+            }
+            else {
+                ArquivoFonte fonte;
+                ok = abrirFonte(caminho, fonte) && c.compilar(fonte.conteudo, diretorio).sucesso;
+            }
+            _exit(ok ? 0 : 1);
+        }
+        int situacao = 0;
+        struct rusage uso = {};
+        if (filho < 0 || wait4(filho, &situacao, 0, &uso) != filho) return medida;
+        medida.segundos = chrono::duration<double>(Relogio::now() - inicio).count();
+        if (!WIFEXITED(situacao) || WEXITSTATUS(situacao) != 0) return medida;
+        medida.pico = uso.ru_maxrss;
+        for (const char* nome : { "arvore_sintatica.txt", "arvore_semantica.txt", "arvore_de_simbolos.txt" }) {
+            ArquivoFonte arvore;
+            if (abrirFonte(diretorio + "/" + nome, arvore)) hashConteudo(arvore.conteudo, medida.hash[0], medida.hash[1]);
+        }
+        filesystem::remove_all(diretorio);
+        return medida;
+    };
+
+    char linha[160];
+    snprintf(linha, sizeof(linha), "  %10s  %17s %10s  %17s %10s", "fonte", "normal: pico RSS", "tempo", "fluxo: pico RSS", "tempo");
+    cout << linha << endl;
+    int falhas = 0;
+    for (size_t tamanho = 4 << 20; tamanho <= maximo; tamanho *= 4) {
+        FILE* arquivo = fopen(caminho.c_str(), "wb");
+        if (!arquivo) break;
+        size_t gravados = fwrite(teste1Declaracoes, 1, strlen(teste1Declaracoes), arquivo);
+        while (gravados < tamanho) gravados += fwrite(trecho.data(), 1, trecho.size(), arquivo);
+        fclose(arquivo);
+
+        Medida fluxo = medir(true);
+        Medida normal;
+        if (tamanho <= LIMITE_NORMAL) normal = medir(false);
+
+        snprintf(linha, sizeof(linha), "  %7.0f MB", gravados / 1048576.0);
+        cout << linha;
+        if (normal.pico >= 0) {
+            snprintf(linha, sizeof(linha), "  %14.1f MB %8.2f s", normal.pico / 1024.0, normal.segundos);
+            cout << linha;
+        }
+        else {
+            snprintf(linha, sizeof(linha), "  %17s %10s", tamanho <= LIMITE_NORMAL ? "falhou" : "acima do limite", "");
+            cout << linha;
+        }
+        snprintf(linha, sizeof(linha), "  %14.1f MB %8.2f s", fluxo.pico / 1024.0, fluxo.segundos);
+        cout << linha;
+
+        bool iguais = normal.pico < 0 || (normal.hash[0] == fluxo.hash[0] && normal.hash[1] == fluxo.hash[1]);
+        if (fluxo.pico < 0 || !iguais) falhas++;
+        cout << (fluxo.pico < 0 ? "  FALHOU" : iguais ? "" : "  ÁRVORES DIFERENTES") << endl;
+    }
+    filesystem::remove_all(base);
+    return falhas > 0 ? 1 : 0;
+#else
+    cout << "--bench-fluxo precisa de fork()" << endl;
+    return 1;
+#endif
+}
 
-    if (!outputASFile.is_open()) {
-        cout << "Erro ao abrir o arquivo de saída da tabela de simbolos." << endl;
+// Latência de pedidos ao servidor com 'teste 1': uma conexão por pedido, como
+// o cliente faz, e uma conexão só para todos; a compilação local, gravando os
+// arquivos, fica como referência
+int benchServidor(int pedidos) {
+#ifndef _WIN32
+    filesystem::path base = filesystem::temp_directory_path() / ("bench-servidor-" + to_string(getpid()));
+    filesystem::create_directories(base);
+    string soquete = (base / "s.sock").string();
+    OpcoesCompilacao opcoes;
+    opcoes.rastro = RASTRO_NENHUM;
+    thread([soquete, opcoes] { executarServidor(soquete, opcoes); }).detach();
+
+    int fd = -1;
+    for (int tentativa = 0; tentativa < 1000 && fd < 0; tentativa++) {
+        this_thread::sleep_for(chrono::milliseconds(1));
+        fd = conectarSoquete(soquete);
+    }
+    if (fd < 0) {
+        cout << "Servidor não respondeu em " << soquete << endl;
         return 1;
     }
+    close(fd);
+
+    string fonte = programaTeste1(1);
+    ostringstream descarte;
+    vector<pair<string, string>> esperados;
+    {
+        Compilador c(opcoes, descarte);
+        c.arquivosEmMemoria = &esperados;
+        c.compilar(fonte, "");
+    }
 
-    nextStep();
-    ArvoreNode* ast = Programa();
+    bool iguais = true;
+    auto linha = [&](const char* nome, vector<double>& tempos) {
+        sort(tempos.begin(), tempos.end());
+        char texto[160];
+        snprintf(texto, sizeof(texto), "  %-22s p50 %7.1f us  p99 %7.1f us  máx %8.1f us", nome,
+                 tempos[tempos.size() / 2] * 1e6, tempos[tempos.size() * 99 / 100] * 1e6, tempos.back() * 1e6);
+        cout << texto << endl;
+    };
+    auto pedir = [&](int conexao) {
+        RespostaServidor resposta;
+        bool ok = pedirCompilacao(conexao, opcoes, fonte, {}, resposta);
+        iguais = iguais && ok && resposta.sucesso && resposta.arquivos == esperados;
+    };
+
+    vector<double> tempos;
+    for (int i = -pedidos / 10; i < pedidos; i++) {
+        auto inicio = Relogio::now();
+        int conexao = conectarSoquete(soquete);
+        pedir(conexao);
+        close(conexao);
+        if (i >= 0) tempos.push_back(chrono::duration<double>(Relogio::now() - inicio).count());
+    }
+    linha("conexão por pedido", tempos);
+
+    tempos.clear();
+    int conexao = conectarSoquete(soquete);
+    for (int i = 0; i < pedidos; i++) {
+        auto inicio = Relogio::now();
+        pedir(conexao);
+        tempos.push_back(chrono::duration<double>(Relogio::now() - inicio).count());
+    }
+    close(conexao);
+    linha("conexão persistente", tempos);
+
+    tempos.clear();
+    for (int i = 0; i < pedidos; i++) {
+        auto inicio = Relogio::now();
+        Compilador c(opcoes, descarte);
+        c.compilar(fonte, base.string());
+        tempos.push_back(chrono::duration<double>(Relogio::now() - inicio).count());
+    }
+    linha("local, gravando", tempos);
+
+    if (!iguais) cout << "  RESPOSTAS DIFERENTES DA COMPILAÇÃO LOCAL" << endl;
+    error_code erro;
+    filesystem::remove_all(base, erro);
+    return iguais ? 0 : 1;
+#else
+    cout << "O modo servidor usa soquetes Unix e não está disponível no Windows." << endl;
+    return 1;
+#endif
+}
+#endif
 
-    printArvoreSemantica(ast);
-    printArvoreSintatica(ast);
-    printTabelaDeSimbolos();
 
-    outputSemFile.close();
-    outputSintFile.close();
-    outputASFile.close();
+int main(int argc, char* argv[]) {
+#ifdef COMPILADORES_BENCH
+    if (argc > 1 && string_view(argv[1]) == "--bench-alocacoes") {
+        return benchAlocacoes(argc > 2 ? atoi(argv[2]) : 10000);
+    }
+    if (argc > 1 && string_view(argv[1]) == "--bench-arvore") {
+        return benchArvorePlana(argc > 2 ? atoi(argv[2]) : 1000000);
+    }
+    if (argc > 1 && string_view(argv[1]) == "--bench-vm") {
+        return benchMaquinaVirtual(argc > 2 ? atoll(argv[2]) : 10000000);
+    }
+    if (argc > 1 && string_view(argv[1]) == "--bench-rastro") {
+        return benchRastro(argc > 2 ? atoi(argv[2]) : 10000);
+    }
+    if (argc > 1 && string_view(argv[1]) == "--bench-relatorio") {
+        return benchRelatorio(argc > 2 ? atoi(argv[2]) : 20000);
+    }
+    if (argc > 1 && string_view(argv[1]) == "--bench-profundidade") {
+        return benchProfundidade(argc > 2 ? atoi(argv[2]) : 1000000);
+    }
+    if (argc > 1 && string_view(argv[1]) == "--bench-parser") {
+        return benchParser(argc > 2 ? atoi(argv[2]) : 20000);
+    }
+    if (argc > 1 && string_view(argv[1]) == "--bench-expressoes") {
+        return benchExpressoes(argc > 2 ? atoi(argv[2]) : 1000000);
+    }
+    if (argc > 1 && string_view(argv[1]) == "--bench-semantica") {
+        return benchSemantica(argc > 2 ? atoi(argv[2]) : 100000);
+    }
+    if (argc > 1 && string_view(argv[1]) == "--bench-cache") {
+        return benchCache(argc > 2 ? atoi(argv[2]) : 20000);
+    }
+    if (argc > 1 && string_view(argv[1]) == "--bench-servidor") {
+        return benchServidor(argc > 2 ? atoi(argv[2]) : 10000);
+    }
+    if (argc > 1 && string_view(argv[1]) == "--bench-fluxo") {
+        return benchFluxo(argc > 2 ? (size_t)atoll(argv[2]) << 20 : 256 << 20);
+    }
+    if (argc > 1 && string_view(argv[1]) == "--bench-varredura") {
+        return benchVarredura(argc > 2 ? (size_t)atoll(argv[2]) << 20 : 8 << 20);
+    }
+    if (argc > 1 && string_view(argv[1]) == "--bench-lexica") {
+        return benchLexica(argc > 2 ? (size_t)atoll(argv[2]) << 20 : 64 << 20);
+    }
+    if (argc > 1 && string_view(argv[1]) == "--bench-c") {
+        return benchCodigoC(argc > 2 ? atoll(argv[2]) : 10000000);
+    }
+    return suiteBenchmark(argc, argv);
+#endif
+
+    // Opções:
+    //   --arvore-plana   o parser também emite a árvore plana, usada para imprimir a árvore sintática
+    //   --executar       executa o programa na máquina virtual depois da análise
+    //   --otimizar       dobra e propaga constantes e informa quantos nós foram eliminados
+    //   --parser-iterativo analisa os blocos com uma pilha explícita, sem limite de aninhamento
+    //   --parser-tabela  analisa com o parser LL(1) gerado da gramática (veja ProgramaTabela())
+    //   --gerar-c        traduz o programa para C em 'programa.c', ao lado das árvores
+    //   --threads=N      trabalhadores do modo em lote ou, com um arquivo, das análises léxica e semântica
+    //                    (padrão: um por núcleo)
+    //   --relatorio[=json] imprime o tempo de cada fase e os contadores da compilação
+    //   --rastro=NIVEL   nenhum, erros (padrão: últimos tokens impressos no erro) ou tokens (todos)
+    //   --emit=LISTA     artefatos gravados, separados por vírgula: sint, sem, sym, json ou none
+    //                    (padrão: sint,sem,sym)
+    //   --cache[=DIR]    reaproveita compilações da mesma fonte com as mesmas opções, guardadas em DIR
+    //                    (padrão: $XDG_CACHE_HOME/compiladores ou ~/.cache/compiladores)
+    //   --cache-limite=MB tamanho do cache antes de apagar as entradas usadas há mais tempo (padrão: 512)
+    //   --varredura=NUCLEO escalar, sse2 ou avx2 na análise léxica (padrão: o melhor disponível)
+    //   --fluxo          lê a fonte em blocos e compila um comando por vez, com memória constante
+    //                    (veja compilarEmFluxo())
+    //   --servidor       fica residente e compila os pedidos recebidos no soquete (veja executarServidor())
+    //   --soquete=CAMINHO soquete do servidor e do cliente (padrão: $XDG_RUNTIME_DIR/compiladores.sock
+    //                    ou /tmp/compiladores-<uid>.sock)
+    OpcoesCompilacao opcoes;
+    unsigned threads = max(1u, thread::hardware_concurrency());
+    vector<string> fontes;
+    bool servidor = false;
+    bool fluxo = false;
+    string soquete = caminhoSoquetePadrao();
+    for (int i = 1; i < argc; i++) {
+        string_view arg = argv[i];
+        if (arg == "--arvore-plana") {
+            opcoes.arvorePlana = true;
+        }
+        else if (arg == "--executar") {
+            opcoes.executar = true;
+        }
+        else if (arg == "--otimizar") {
+            opcoes.otimizar = true;
+        }
+        else if (arg == "--parser-iterativo") {
+            opcoes.parserIterativo = true;
+        }
+        else if (arg == "--parser-tabela") {
+            opcoes.parserTabela = true;
+        }
+        else if (arg == "--gerar-c") {
+            opcoes.gerarC = true;
+        }
+        else if (arg == "--relatorio") {
+            opcoes.relatorio = RELATORIO_TABELA;
+        }
+        else if (arg == "--relatorio=json") {
+            opcoes.relatorio = RELATORIO_JSON;
+        }
+        else if (arg == "--rastro=nenhum") {
+            opcoes.rastro = RASTRO_NENHUM;
+        }
+        else if (arg == "--rastro=erros") {
+            opcoes.rastro = RASTRO_ERROS;
+        }
+        else if (arg == "--rastro=tokens") {
+            opcoes.rastro = RASTRO_TOKENS;
+        }
+        else if (arg.substr(0, 7) == "--emit=") {
+            opcoes.artefatos = 0;
+            for (string_view resto = arg.substr(7); !resto.empty();) {
+                size_t virgula = resto.find(',');
+                string_view nome = resto.substr(0, virgula);
+                resto = virgula == string_view::npos ? string_view() : resto.substr(virgula + 1);
+
+                if (nome == "sint") opcoes.artefatos |= EMITIR_SINTATICA;
+                else if (nome == "sem") opcoes.artefatos |= EMITIR_SEMANTICA;
+                else if (nome == "sym") opcoes.artefatos |= EMITIR_SIMBOLOS;
+                else if (nome == "json") opcoes.artefatos |= EMITIR_JSON;
+                else if (nome != "none") {
+                    cout << "Artefato desconhecido em --emit: " << nome << endl;
+                    return 1;
+                }
+            }
+        }
+        else if (arg == "--cache") {
+            opcoes.diretorioCache = diretorioCachePadrao();
+        }
+        else if (arg.substr(0, 8) == "--cache=") {
+            opcoes.diretorioCache = string(arg.substr(8));
+        }
+        else if (arg.substr(0, 15) == "--cache-limite=") {
+            opcoes.limiteCache = (uint64_t)max(1LL, atoll(argv[i] + 15)) << 20;
+        }
+        else if (arg.substr(0, 12) == "--varredura=") {
+            varredura = nucleoVarredura(arg.substr(12));
+            if (!varredura) {
+                cout << "Núcleo de varredura indisponível: " << arg.substr(12) << endl;
+                return 1;
+            }
+        }
+        else if (arg == "--fluxo") {
+            fluxo = true;
+        }
+        else if (arg == "--servidor") {
+            servidor = true;
+        }
+        else if (arg.substr(0, 10) == "--soquete=") {
+            soquete = string(arg.substr(10));
+        }
+        else if (arg.substr(0, 10) == "--threads=") {
+            threads = (unsigned)max(1, atoi(argv[i] + 10));
+            opcoes.threadsAnalise = threads;
+        }
+        else if (arg.size() > 2 && arg.substr(0, 2) == "--") {
+            cout << "Opção desconhecida: " << arg << endl;
+            return 1;
+        }
+        else {
+            fontes.push_back(argv[i]);
+        }
+    }
+
+    if (servidor) {
+        return executarServidor(soquete, opcoes);
+    }
+
+    // O fluxo nunca tem a árvore inteira, então nada que precise dela depois da análise
+    if (fluxo) {
+        if (fontes.size() != 1) {
+            cout << "--fluxo compila um único arquivo." << endl;
+            return 1;
+        }
+        if (opcoes.executar || opcoes.otimizar || opcoes.gerarC || opcoes.arvorePlana || opcoes.parserIterativo || opcoes.parserTabela || !opcoes.diretorioCache.empty()) {
+            cout << "--fluxo não pode ser usado com --executar, --otimizar, --gerar-c, --arvore-plana, --parser-iterativo, --parser-tabela nem --cache." << endl;
+            return 1;
+        }
+        Compilador compilador(opcoes);
+        return compilador.compilarEmFluxo(fontes[0], ".").sucesso ? 0 : 1;
+    }
+
+    // Compila no diretório atual. O cliente manda a compilação para o servidor e
+    // só compila aqui se não houver um. Com --executar os valores de 'ler()' vão
+    // junto no pedido, então uma entrada interativa continua local.
+    auto compilarAqui = [&](string_view fonte) {
+        istringstream valoresLer;
+        Compilador compilador(opcoes);
+#if defined(COMPILADORES_CLIENTE) && !defined(_WIN32)
+        if (!opcoes.executar || !isatty(STDIN_FILENO)) {
+            string entrada;
+            if (opcoes.executar) entrada.assign(istreambuf_iterator<char>(cin), istreambuf_iterator<char>());
+            int codigo = compilarNoServidor(soquete, opcoes, fonte, entrada, ".");
+            if (codigo >= 0) return codigo;
+            valoresLer.str(entrada);
+            if (opcoes.executar) compilador.entrada = &valoresLer;
+        }
+#endif
+        return compilador.compilar(fonte, ".").sucesso ? 0 : 1;
+    };
+
+    // Modo em lote: Compiladores [opções] <fonte> [<fonte> ...]
+    // Com um único arquivo as árvores vão para o diretório atual; com vários,
+    // as fontes são compiladas em paralelo e cada uma ganha o diretório '<fonte>.saida'.
+    if (fontes.size() > 1) {
+        return compilarEmLote(fontes, opcoes, threads);
+    }
+    if (fontes.size() == 1) {
+        ArquivoFonte fonte;
+        if (!abrirFonte(fontes[0], fonte)) {
+            cout << "Erro ao ler o arquivo de entrada '" << fontes[0] << "'." << endl;
+            return 1;
+        }
+        return compilarAqui(fonte.conteudo);
+    }
+
+    cout << "Digite o código de entrada (insira 'FIM' para finalizar):" << endl;
+
+    string line;
+    string entrada;
+
+    while (getline(cin, line)) {
+        if (line == "FIM") break;
+        entrada += line;
+        entrada += '\n';
+    }
+
+    cout << endl << endl << endl << endl;
+
+    if (compilarAqui(entrada) != 0) return 1;
 
     cout << "Análise sintática concluída. Veja 'arvore_sintatica.txt', 'arvore_semantica.txt' e 'tabela_de_simbolos.txt' para o resultado." << endl;
 
     return 0;
-}
\ No newline at end of file
+}